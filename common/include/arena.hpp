@@ -0,0 +1,124 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_COMMON_ARENA_HPP
+#define ROSETTA_COMMON_ARENA_HPP
+
+#include <string>
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace common {
+
+
+/// Monotonic memory arena.
+/// Hands out memory by bumping a pointer inside of a chain of blocks, and never frees individual allocations.
+/// Invoking reset() makes all memory available again, without returning any of the blocks to the operating system,
+/// which allows us to reuse the same memory for every request on a keep-alive connection.
+class arena final : public boost::noncopyable
+{
+public:
+
+  /// Creates an arena, with the specified size of its blocks.
+  explicit arena (size_t block_size = 4096);
+
+  /// Releases all blocks back to the operating system.
+  ~arena ();
+
+  /// Returns "size" bytes of memory, aligned according to "alignment".
+  void * allocate (size_t size, size_t alignment);
+
+  /// Makes all memory in arena available again, without freeing any blocks.
+  /// Notice, no objects allocated from arena can be used after this method is invoked.
+  void reset ();
+
+private:
+
+  /// Header for each block of memory, the actual memory follows immediately after the header.
+  struct block
+  {
+    block * next;
+    size_t size;
+  };
+
+  /// Makes the next block in chain current, creating a new block, unless the next block can hold "size" bytes.
+  void next_block (size_t size);
+
+  /// Returns the first usable byte of the given block.
+  static char * begin_of (block * current) { return reinterpret_cast<char*> (current + 1); }
+
+
+  /// Default size of a single block of memory.
+  const size_t _block_size;
+
+  /// First block in chain.
+  block * _first;
+
+  /// Block we are currently allocating from.
+  block * _current;
+
+  /// Next free byte in current block.
+  char * _position;
+
+  /// End of current block.
+  char * _end;
+};
+
+
+/// STL allocator, allocating its memory from an arena.
+/// Deallocation is a no-op, since memory is returned to the arena in bulk, when arena is reset.
+template<typename T> class arena_allocator
+{
+public:
+
+  typedef T value_type;
+
+  /// Creates an allocator allocating from the given arena.
+  arena_allocator (arena & memory) : _arena (&memory) { }
+
+  /// Rebinding copy constructor, required by STL containers.
+  template<typename U> arena_allocator (const arena_allocator<U> & rhs) : _arena (rhs._arena) { }
+
+  /// Allocates memory for "no" instances of T.
+  T * allocate (size_t no) { return static_cast<T*> (_arena->allocate (no * sizeof (T), alignof (T))); }
+
+  /// Does nothing, memory is returned to arena when it is reset.
+  void deallocate (T * pointer, size_t no) { }
+
+  /// Two allocators are equal if they allocate from the same arena.
+  template<typename U> bool operator == (const arena_allocator<U> & rhs) const { return _arena == rhs._arena; }
+  template<typename U> bool operator != (const arena_allocator<U> & rhs) const { return _arena != rhs._arena; }
+
+private:
+
+  /// Allowing other instantiations of allocator to access our arena.
+  template<typename U> friend class arena_allocator;
+
+  /// Arena this instance allocates from.
+  arena * _arena;
+};
+
+
+/// String type allocating its memory from an arena.
+typedef std::basic_string<char, std::char_traits<char>, arena_allocator<char>> arena_string;
+
+
+} // namespace common
+} // namespace rosetta
+
+#endif // ROSETTA_COMMON_ARENA_HPP
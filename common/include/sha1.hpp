@@ -19,16 +19,50 @@
 #define ROSETTA_SERVER_SHA1_HELPER_HPP
 
 #include <array>
+#include <memory>
 #include <vector>
+#include <cstddef>
 
 using std::array;
 using std::vector;
 
+namespace boost {
+namespace uuids {
+namespace detail {
+class sha1;
+} // namespace detail
+} // namespace uuids
+} // namespace boost
+
 namespace rosetta {
 namespace common {
 namespace sha1 {
 
 
+/// Incremental SHA1, for hashing content as it arrives, without having all of it in memory at once.
+class hasher final
+{
+public:
+
+  /// Creates an empty hash.
+  hasher ();
+
+  /// Destroys hash.
+  ~hasher ();
+
+  /// Adds size bytes from data to hash.
+  void update (const void * data, size_t size);
+
+  /// Returns hash of everything added. Can only be invoked once.
+  array<unsigned char, 20> digest ();
+
+private:
+
+  /// Actual implementation.
+  std::unique_ptr<boost::uuids::detail::sha1> _sha;
+};
+
+
 array<unsigned char, 20> compute (const vector<unsigned char> & data);
 
 
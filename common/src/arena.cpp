@@ -0,0 +1,104 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <new>
+#include <cstdlib>
+#include "common/include/arena.hpp"
+
+namespace rosetta {
+namespace common {
+
+
+arena::arena (size_t block_size)
+  : _block_size (block_size),
+    _first (nullptr),
+    _current (nullptr),
+    _position (nullptr),
+    _end (nullptr)
+{ }
+
+
+arena::~arena ()
+{
+  // Releasing all blocks back to the operating system.
+  while (_first != nullptr) {
+    block * next = _first->next;
+    std::free (_first);
+    _first = next;
+  }
+}
+
+
+void * arena::allocate (size_t size, size_t alignment)
+{
+  // Aligning next free byte of current block according to caller's requirements.
+  size_t padding = _position == nullptr ? 0 : (alignment - reinterpret_cast<size_t> (_position) % alignment) % alignment;
+  if (_position == nullptr || _position + padding + size > _end) {
+
+    // Current block cannot hold allocation, moving to next block, which is always aligned at its beginning.
+    next_block (size);
+    padding = (alignment - reinterpret_cast<size_t> (_position) % alignment) % alignment;
+  }
+
+  // Bumping pointer, and returning memory to caller.
+  char * return_value = _position + padding;
+  _position = return_value + size;
+  return return_value;
+}
+
+
+void arena::reset ()
+{
+  // Rewinding to first block, keeping all blocks around, such that they can be reused.
+  _current = _first;
+  _position = _first == nullptr ? nullptr : begin_of (_first);
+  _end = _first == nullptr ? nullptr : begin_of (_first) + _first->size;
+}
+
+
+void arena::next_block (size_t size)
+{
+  // Making sure we have room for worst case alignment padding.
+  size += alignof (std::max_align_t);
+
+  // Checking if we can reuse the next block in chain, from before arena was reset.
+  block * next = _current == nullptr ? _first : _current->next;
+  if (next == nullptr || next->size < size) {
+
+    // Creating a new block, large enough to hold the allocation, and inserting it into our chain.
+    size_t block_size = size > _block_size ? size : _block_size;
+    block * created = static_cast<block*> (std::malloc (sizeof (block) + block_size));
+    if (created == nullptr)
+      throw std::bad_alloc ();
+    created->size = block_size;
+    created->next = next;
+    if (_current == nullptr)
+      _first = created;
+    else
+      _current->next = created;
+    next = created;
+  }
+
+  // Making block current.
+  _current = next;
+  _position = begin_of (next);
+  _end = _position + next->size;
+}
+
+
+} // namespace common
+} // namespace rosetta
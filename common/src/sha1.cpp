@@ -29,13 +29,26 @@ namespace common {
 namespace sha1 {
 
 
-array<unsigned char, 20> compute (const vector<unsigned char> & data)
+hasher::hasher ()
+  : _sha (new detail::sha1 ())
+{ }
+
+
+hasher::~hasher ()
+{ }
+
+
+void hasher::update (const void * data, size_t size)
+{
+  _sha->process_bytes (data, size);
+}
+
+
+array<unsigned char, 20> hasher::digest ()
 {
   array<unsigned char, 20> return_value;
-  detail::sha1 sha;
-  sha.process_bytes (&data.front(), data.size());
   unsigned int digest [5];
-  sha.get_digest (digest);
+  _sha->get_digest (digest);
 
   for (int idx = 0; idx < 5; idx++)
   {
@@ -49,6 +62,14 @@ array<unsigned char, 20> compute (const vector<unsigned char> & data)
 }
 
 
+array<unsigned char, 20> compute (const vector<unsigned char> & data)
+{
+  hasher sha;
+  sha.update (data.data (), data.size ());
+  return sha.digest ();
+}
+
+
 } // namespace sha1
 } // namespace common
 } // namespace rosetta
@@ -48,9 +48,18 @@ public:
   /// Authorize a client's ticket.
   bool authorize (const authentication::ticket & ticket, class path path, const string & verb) const;
 
+  /// Authorize a client's ticket for folder, and for every folder below it with explicit access rights.
+  bool authorize_tree (const authentication::ticket & ticket, class path folder, const string & verb) const;
+
+  /// Forgets access rights for folder, and for every folder below it, since folder no longer exists.
+  void forget (class path folder);
+
   /// Updating a specific folder's authorization access rights.
   void update (class path path, const string & verb, const string & new_value);
 
+  /// Returns a number that changes every time access rights change, such that decisions made from them can be cached.
+  size_t generation () const { return _generation; }
+
 private:
 
   /// Making sure only server class can create instances.
@@ -71,6 +80,9 @@ private:
 
   /// Folders with explicit access rights.
   access_right _access;
+
+  /// Incremented every time access rights change.
+  size_t _generation = 0;
 };
 
 
@@ -21,6 +21,7 @@
 #include <memory>
 #include <boost/asio.hpp>
 #include "http_server/include/server.hpp"
+#include "http_server/include/helpers/timer_wheel.hpp"
 #include "http_server/include/connection/request.hpp"
 
 namespace rosetta {
@@ -76,8 +77,8 @@ private:
   /// Socket for connection.
   socket_ptr _socket;
 
-  /// Deadline timer for closing connection when a timeout period has elapsed.
-  deadline_timer _timer;
+  /// Timeout for closing connection when a timeout period has elapsed, armed in the server's timer wheel.
+  timer_wheel::timeout _timeout;
 
   /// Request stream buffer.
   boost::asio::streambuf _buffer;
@@ -0,0 +1,62 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_ERROR_RESPONSES_HPP
+#define ROSETTA_SERVER_ERROR_RESPONSES_HPP
+
+#include <map>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "common/include/configuration.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Complete HTTP responses for every error page, rendered when server starts, with status line, headers and page, such that an
+/// error can be written back to client in a single write, with only its "Date" header filled in for every response.
+class error_responses final : public boost::noncopyable
+{
+public:
+
+  /// Renders a response for every "<status code>.html" file in the given folder.
+  error_responses (const rosetta::common::configuration & configuration, const boost::filesystem::path & folder);
+
+  /// Creates the response for the given status code, returning false if there is no error page for it.
+  /// If close_connection is true, response tells client that connection is closed once response is written.
+  bool render (unsigned int status_code, bool close_connection, std::string & response) const;
+
+private:
+
+  /// A pre-rendered response, which is everything before the value of its "Date" header, and everything after it.
+  struct response
+  {
+    std::string head;
+    std::string tail;
+  };
+
+  /// Responses, by their status codes.
+  std::map<unsigned int, response> _responses;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_ERROR_RESPONSES_HPP
@@ -44,10 +44,19 @@ public:
   /// Creates a PUT handler.
   content_request_handler (class request * request);
 
+  /// Returns true, since handler reads the content of the request.
+  virtual bool reads_content () const override { return true; }
+
 protected:
 
   /// Returns Content-Length of request, and verifies there is any content, and that request is not malformed.
   size_t get_content_length (connection_ptr connection);
+
+  /// Returns the maximum number of bytes of content server accepts for a request.
+  virtual size_t get_max_content_length (connection_ptr connection);
+
+  /// Returns true if content of request is sent with "Transfer-Encoding: chunked".
+  bool has_chunked_content ();
 };
 
 
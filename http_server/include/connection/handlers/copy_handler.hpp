@@ -0,0 +1,68 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ROSETTA_SERVER_COPY_HANDLER_HPP
+#define ROSETTA_SERVER_COPY_HANDLER_HPP
+
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/connection/handlers/request_handler_base.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace rosetta::common;
+
+class request;
+class connection;
+
+
+/// COPY handler for files and folders, copying the requested path to the path given in the "Destination" header.
+/// Files are copied before we respond, while folders are copied in the background, returning 202 Accepted immediately.
+class copy_handler final : public request_handler_base
+{
+public:
+
+  /// Creates a COPY handler, where overwrite is false if client does not allow us to replace an existing destination.
+  copy_handler (class request * request, const path & destination, bool overwrite);
+
+  /// Handles the given request.
+  virtual void handle (connection_ptr connection, std::function<void()> on_success) override;
+
+private:
+
+  /// Copies a single file.
+  void copy_file (connection_ptr connection, std::function<void()> on_success);
+
+  /// Starts copying a folder in the background.
+  void copy_folder (connection_ptr connection, std::function<void()> on_success);
+
+  /// Writes a 202 Accepted response, telling client its request will be carried out, without waiting for it.
+  void write_accepted_envelope (connection_ptr connection, std::function<void()> on_success);
+
+
+  /// Where to copy to.
+  const path _destination;
+
+  /// False if client does not allow us to replace an existing destination.
+  const bool _overwrite;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_COPY_HANDLER_HPP
@@ -19,6 +19,7 @@
 #define ROSETTA_SERVER_STATIC_FILE_HANDLER_HPP
 
 #include <boost/filesystem.hpp>
+#include "http_server/include/helpers/open_file_cache.hpp"
 #include "http_server/include/connection/handlers/request_file_handler.hpp"
 
 using std::string;
@@ -31,24 +32,32 @@ class request;
 class connection;
 
 
-/// GET handler for static files.
+/// GET handler for static files, which is given the file already opened, together with its metadata, by the open file cache.
+/// If the cache does not know about file, the handler opens it on a disc I/O thread, and inserts it into cache.
 class get_file_handler final : public request_file_handler
 {
 public:
 
-  /// Creates a static file handler.
-  get_file_handler (class request * request);
+  /// Creates a static file handler, serving file with the given MIME type, which is empty if file type is not served.
+  /// File is nullptr if the open file cache does not know about it.
+  get_file_handler (class request * request, open_file_cache::file_ptr file, const string & mime_type);
 
   /// Handles the given request.
   virtual void handle (connection_ptr connection, std::function<void()> on_success) override;
 
 private:
 
-  /// Checks if file should be rendered back to client, or if we should return a 304.
-  bool should_write_file (path full_path);
+  /// Opens file on disc I/O thread, inserting it into the open file cache, before serving it.
+  void open_file (connection_ptr connection, std::function<void()> on_success);
 
-  /// Writes 304 response back to client.
-  void write_304_response (connection_ptr connection, std::function<void()> on_success);
+  /// Serves file to client.
+  void serve_file (connection_ptr connection, std::function<void()> on_success);
+
+  /// File to serve, which stays open until we're done with it, even if it is evicted from cache in the meantime.
+  open_file_cache::file_ptr _file;
+
+  /// MIME type of file.
+  const string _mime_type;
 };
 
 
@@ -18,8 +18,13 @@
 #ifndef ROSETTA_SERVER_STATIC_FOLDER_HANDLER_HPP
 #define ROSETTA_SERVER_STATIC_FOLDER_HANDLER_HPP
 
+#include <ctime>
+#include <memory>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include "common/include/exceptional_executor.hpp"
+#include "http_server/include/helpers/folder_walker.hpp"
+#include "http_server/include/helpers/archive_writer.hpp"
 #include "http_server/include/connection/handlers/request_handler_base.hpp"
 
 using std::string;
@@ -33,7 +38,7 @@ class request;
 class connection;
 
 
-/// GET handler for static files.
+/// GET handler for folders, returning either the content of the folder as JSON, or the entire subtree of the folder as a tar or zip archive.
 class get_folder_handler final : public request_handler_base
 {
 public:
@@ -52,14 +57,71 @@ private:
   /// Writes folder content back to client as JSON.
   void write_folder (connection_ptr connection, path folderpath, std::function<void()> on_success);
 
+  /// Writes the JSON created from folder content back to client.
+  void write_folder_content (connection_ptr connection,
+                             std::shared_ptr<std::vector<unsigned char>> buffer_ptr,
+                             const string & last_modified,
+                             std::function<void()> on_success);
+
   /// Writes objects of type either "files" or "folders" back to client as JSON.
+  /// Invoked on a disc I/O thread, hence it must not touch the connection or the request.
   void write_objects (const string & type,
-                      connection_ptr connection,
                       std::shared_ptr<std::vector<unsigned char>> buffer_ptr,
                       path folderpath);
 
   /// Writes 304 response back to client.
   void write_304_response (connection_ptr connection, std::function<void()> on_success);
+
+
+  /// State of an archive being streamed back to client, used by the network thread and disc I/O threads, but never at the same time.
+  struct archive_state
+  {
+    archive_state (path folder, archive_writer::format type);
+    ~archive_state ();
+
+    /// Closes the current file, if any.
+    void close_file ();
+
+    /// Walks the folder, and creates the archive.
+    folder_walker walker;
+    archive_writer writer;
+
+    /// Pending HTTP chunk, starting out with room for its size, such that we can write it with a single write operation.
+    std::vector<char> buffer;
+
+    /// Current file, its name in archive, its size and modification time, and how many bytes of its content we have yet to write.
+    int fd;
+    path file;
+    string name;
+    uint64_t size;
+    std::time_t modified;
+    uint64_t left;
+
+    /// True when there are no more files in folder.
+    bool done;
+  };
+  typedef std::shared_ptr<archive_state> archive_ptr;
+
+  /// Writes the entire subtree of folder back to client as an archive, using chunked transfer encoding.
+  void write_archive (connection_ptr connection, path folderpath, archive_writer::format type, std::function<void()> on_success);
+
+  /// Finds and opens the next file in folder on a disc I/O thread, for then to add it to archive, if client is authorized to GET it.
+  void archive_next_file (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success);
+
+  /// Reads the content of the current file into the pending chunk on a disc I/O thread, until file is done, or chunk is full.
+  void archive_file_content (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success);
+
+  /// Sends the content of the current file directly from file to socket, without copying it into user space.
+  void send_file_content (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success);
+
+  /// Writes zeros for content missing from a file that shrunk while we sent it, followed by the end of file, and of its HTTP chunk.
+  void pad_file_content (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success);
+
+  /// Writes the end of archive, followed by the last HTTP chunk.
+  void finish_archive (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success);
+
+  /// Writes the pending HTTP chunk to socket, declaring trailing bytes more content than it contains, which are written by caller.
+  void write_archive_chunk (connection_ptr connection, archive_ptr archive, uint64_t trailing, std::function<void()> on_written);
 };
 
 
@@ -0,0 +1,100 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_GET_MULTI_HANDLER_HPP
+#define ROSETTA_SERVER_GET_MULTI_HANDLER_HPP
+
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "http_server/include/connection/handlers/request_file_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+class request;
+class connection;
+
+
+/// GET handler for many files in the same folder at once, such as "/folder/?multi=a.json,b.json", returning all files as a single
+/// "multipart/mixed" response, with one part for each file. Every file is authorized exactly as if client had requested it directly,
+/// and its status code is given by a "Status" header in its part, which only contains the file's content if status is 200.
+/// Files are read in parallel on the disc I/O threads.
+class get_multi_handler final : public request_file_handler
+{
+public:
+
+  /// Creates a multi GET handler.
+  get_multi_handler (class request * request);
+
+  /// Handles the given request.
+  virtual void handle (connection_ptr connection, std::function<void()> on_success) override;
+
+private:
+
+  /// A single file requested by client.
+  struct part
+  {
+    /// Creates a part for the given file, which is not yet read.
+    part (const string & name, const path & file)
+      : name (name),
+        file (file),
+        status_code (0)
+    { }
+
+    /// Name of file, relative to folder, as client requested it.
+    string name;
+
+    /// Path of file.
+    path file;
+
+    /// Status code of file, 0 until file has been read.
+    unsigned int status_code;
+
+    /// MIME type, last modification date, and content of file.
+    string mime_type;
+    string last_modified;
+    std::vector<char> content;
+  };
+
+  /// Authorizes the given file, returning 0 if client is allowed to retrieve it, otherwise the status code client should see.
+  unsigned int authorize_part (connection_ptr connection, part & file);
+
+  /// Reads the given file on a disc I/O thread.
+  void read_part (connection_ptr connection, part & file, size_t max_size, std::function<void()> on_success);
+
+  /// Writes all files back to client, once all files have been read.
+  void write_parts (connection_ptr connection, std::function<void()> on_success);
+
+
+  /// Files requested by client.
+  std::vector<part> _parts;
+
+  /// Number of files we are still reading.
+  size_t _pending;
+
+  /// Response content.
+  std::vector<char> _response;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_GET_MULTI_HANDLER_HPP
@@ -0,0 +1,58 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_GET_PACK_HANDLER_HPP
+#define ROSETTA_SERVER_GET_PACK_HANDLER_HPP
+
+#include <boost/filesystem.hpp>
+#include "http_server/include/helpers/pack_storage.hpp"
+#include "http_server/include/connection/handlers/request_file_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+class request;
+class connection;
+
+
+/// GET handler for static files found in a pack, which never touches the file system, since everything it needs to know about
+/// the file is in the pack's index. Content is sent directly from pack to socket, unless socket is an SSL socket.
+class get_pack_handler final : public request_file_handler
+{
+public:
+
+  /// Creates a GET handler for the given file in a pack.
+  get_pack_handler (class request * request, const pack_file::entry & entry);
+
+  /// Handles the given request.
+  virtual void handle (connection_ptr connection, std::function<void()> on_success) override;
+
+private:
+
+  /// File in pack.
+  const pack_file::entry _entry;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_GET_PACK_HANDLER_HPP
@@ -0,0 +1,88 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_PUT_ARCHIVE_HANDLER_HPP
+#define ROSETTA_SERVER_PUT_ARCHIVE_HANDLER_HPP
+
+#include <memory>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/helpers/batch_extractor.hpp"
+#include "http_server/include/connection/handlers/content_request_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using std::shared_ptr;
+using namespace rosetta::common;
+
+class request;
+class connection;
+
+
+/// PUT handler for archives, extracting a tar archive, optionally gzip compressed, or the parts of a "multipart/mixed" request,
+/// into the requested folder as it arrives.
+/// Every file in archive is authorized the same way a PUT of it would be, and either all files are renamed into place once the entire
+/// archive has been extracted, or none of them are. Responds with the result of each entry in archive as JSON.
+class put_archive_handler final : public content_request_handler
+{
+public:
+
+  /// Creates a PUT archive handler, extracting a "multipart/mixed" request delimited by boundary, or a tar archive if boundary is empty.
+  put_archive_handler (class request * request, const string & boundary);
+
+  /// Handles the given request.
+  virtual void handle (connection_ptr connection, std::function<void()> on_success) override;
+
+protected:
+
+  /// Returns the maximum number of bytes of content server accepts for an archive.
+  virtual size_t get_max_content_length (connection_ptr connection) override;
+
+private:
+
+  /// Reads the next chunk of archive from socket, unless we already have parts of it in connection's buffer.
+  void read_archive (connection_ptr connection,
+                     shared_ptr<batch_extractor> extractor,
+                     size_t content_length,
+                     exceptional_executor x,
+                     std::function<void()> on_success);
+
+  /// Extracts chunk_size bytes of archive from connection's buffer, before reading more of it.
+  void extract_chunk (connection_ptr connection,
+                      shared_ptr<batch_extractor> extractor,
+                      size_t content_length,
+                      size_t chunk_size,
+                      exceptional_executor x,
+                      std::function<void()> on_success);
+
+  /// Invoked when the entire archive has been read, renaming files into place if all entries could be extracted.
+  void archive_extracted (connection_ptr connection, shared_ptr<batch_extractor> extractor, exceptional_executor x, std::function<void()> on_success);
+
+  /// Writes the result of every entry in archive back to client.
+  void write_entries (connection_ptr connection, int status_code, shared_ptr<batch_extractor> extractor, std::function<void()> on_success);
+
+
+  /// Boundary of a "multipart/mixed" request, empty for tar archives.
+  const string _boundary;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_PUT_ARCHIVE_HANDLER_HPP
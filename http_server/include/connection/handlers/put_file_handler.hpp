@@ -18,14 +18,13 @@
 #ifndef ROSETTA_SERVER_PUT_FILE_HANDLER_HPP
 #define ROSETTA_SERVER_PUT_FILE_HANDLER_HPP
 
-#include <array>
-#include <fstream>
-#include <iostream>
+#include <memory>
+#include "http_server/include/helpers/path_lock.hpp"
+#include "http_server/include/helpers/async_file.hpp"
+#include "http_server/include/helpers/splice_pipe.hpp"
 #include "http_server/include/connection/handlers/content_request_handler.hpp"
 
-using std::array;
 using std::string;
-using std::istream;
 using std::shared_ptr;
 using namespace rosetta::common;
 
@@ -34,7 +33,6 @@ namespace http_server {
 
 class request;
 class connection;
-const static size_t BUFFER_SIZE = 8192;
 
 
 /// PUT handler for static files.
@@ -53,17 +51,96 @@ private:
   /// Saves content of request to the specified file.
   void save_request_content (connection_ptr connection, path filename, std::function<void()> on_success);
 
-  /// Write request content to file.
-  void save_request_content_to_file (connection_ptr connection,
-                                     shared_ptr<std::ofstream> file_ptr,
-                                     shared_ptr<istream> socket_stream_ptr,
-                                     size_t content_length,
-                                     exceptional_executor x,
-                                     std::function<void()> on_success);
-
-
-  /// Buffer used for reading content from socket.
-  array<char, BUFFER_SIZE> _file_buffer;
+  /// Appends content of request to the end of the specified file, creating it if it does not exist.
+  /// Appends to the same file are serialized, and a failed append leaves the file as it was.
+  void append_request_content (connection_ptr connection, path filename, std::function<void()> on_success);
+
+  /// Appends content of request to file once lock on it is held, truncating file back to original_size if something goes wrong.
+  void append_content (connection_ptr connection,
+                       path filename,
+                       size_t original_size,
+                       path_lock::holder lock,
+                       std::function<void()> on_success);
+
+  /// Saves one range of a resumable upload, declared by the request's Content-Range header, appending it to the hidden partial file
+  /// of the upload. Ranges of the same upload are serialized, and must agree about its total length. A Content-Range of "bytes */total" without content only queries how many bytes of the upload the server has committed.
+  void save_range_content (connection_ptr connection, path filename, const string & content_range, std::function<void()> on_success);
+
+  /// Writes an empty response, telling the client how many bytes of its upload the server has committed, through a Range header.
+  /// Progress is reported with 204, since 308, which some resumable upload protocols use for this, is a permanent redirect.
+  void write_committed_range (connection_ptr connection, int status_code, size_t committed, std::function<void()> on_success);
+
+  /// Decodes chunked content as it arrives, saving each chunk to file, until the last chunk is seen.
+  void save_chunked_content (connection_ptr connection,
+                             shared_ptr<async_file> file_ptr,
+                             size_t content_length,
+                             exceptional_executor x,
+                             std::function<void()> on_success);
+
+  /// Skips trailers following the last chunk of chunked content.
+  void skip_chunk_trailers (connection_ptr connection,
+                            shared_ptr<async_file> file_ptr,
+                            exceptional_executor x,
+                            std::function<void()> on_success);
+
+  /// Reads a single line of chunked content, such as a chunk size, or a trailer, and invokes on_line with it, without CR/LF.
+  void read_chunk_line (connection_ptr connection, std::function<void(const string & line)> on_line);
+
+  /// Saves content_length bytes of content to file, invoking on_written with the file's exceptional_executor when done.
+  /// Whatever content was already read from socket together with the envelope is written first, before reading the rest.
+  void save_content (connection_ptr connection,
+                     shared_ptr<async_file> file_ptr,
+                     size_t content_length,
+                     exceptional_executor x,
+                     functor on_written);
+
+  /// Reads the rest of the content from socket, and writes it to file, choosing the fastest method available for socket.
+  void save_socket_content (connection_ptr connection,
+                            shared_ptr<async_file> file_ptr,
+                            size_t content_length,
+                            exceptional_executor x,
+                            functor on_written);
+
+  /// Reads content from socket in large chunks into connection's buffer, writing directly from buffer to file.
+  /// Used for SSL sockets, and whenever splice is not supported.
+  void read_content_to_file (connection_ptr connection,
+                             shared_ptr<async_file> file_ptr,
+                             size_t content_length,
+                             exceptional_executor x,
+                             functor on_written);
+
+  /// Moves content from socket to file with splice, through a pipe, without copying content into user space.
+  void splice_content_to_file (connection_ptr connection,
+                               shared_ptr<async_file> file_ptr,
+                               shared_ptr<splice_pipe> pipe_ptr,
+                               size_t content_length,
+                               exceptional_executor x,
+                               functor on_written);
+
+  /// Adds saved content to the content-addressed store, unless it is already there, and links it into place as filename.
+  /// An existing blob is only shared if its bytes are identical to the saved content, since hashes might collide, unless server is
+  /// configured to trust hash and size with "put-deduplicate-verify".
+  void link_from_store (connection_ptr connection,
+                        array<unsigned char, 20> digest,
+                        const string & partial_filename,
+                        path filename,
+                        std::function<void()> on_success);
+
+  /// Renames a saved file from its temporary name into place on the disc I/O thread, and invokes on_success once its new name is durable.
+  void rename_into_place (connection_ptr connection, const string & partial_filename, path filename, std::function<void()> on_success);
+
+  /// Makes sure content written to file is durable according to the "put-durability" setting, before on_durable is invoked.
+  void make_durable (connection_ptr connection, shared_ptr<async_file> file_ptr, exceptional_executor x, functor on_durable);
+
+  /// Makes sure the new name of a file that was renamed into place is durable according to the "put-durability" setting, by syncing
+  /// the folder it is inside of, before on_durable is invoked.
+  void make_rename_durable (connection_ptr connection, path filename, std::function<void()> on_durable);
+
+  /// Opens the file content is saved to, enabling write-behind for it, returning nullptr if it could not be opened.
+  shared_ptr<async_file> open_content_file (connection_ptr connection, const string & filename, async_file::open_mode mode);
+
+  /// Invoked when all content has been written to file, flushing and closing file, before on_success is invoked.
+  void content_saved (connection_ptr connection, shared_ptr<async_file> file_ptr, exceptional_executor x, std::function<void()> on_success);
 };
 
 
@@ -18,18 +18,21 @@
 #ifndef ROSETTA_SERVER_REQUEST_FILE_HANDLER_HPP
 #define ROSETTA_SERVER_REQUEST_FILE_HANDLER_HPP
 
+#include <array>
+#include <ctime>
+#include <cstdint>
+#include <vector>
 #include <memory>
-#include <fstream>
 #include <functional>
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
+#include "http_server/include/helpers/async_file.hpp"
 #include "http_server/include/connection/handlers/request_handler_base.hpp"
 
 namespace rosetta {
 namespace http_server {
 
 using std::string;
-using std::ifstream;
 using std::shared_ptr;
 using namespace boost::filesystem;
 
@@ -48,6 +51,13 @@ protected:
   /// Writing the given file's HTTP headers on socket back to client.
   void write_file_headers (connection_ptr connection, path file_path, bool last_modified, std::function<void()> on_success);
 
+  /// Writing HTTP headers for a file whose size and modification date caller already knows, without touching the file system.
+  void write_file_headers (connection_ptr connection, const string & mime_type, uint64_t size, std::time_t modified, std::function<void()> on_success);
+
+  /// Writes size bytes from offset of the given file descriptor on socket back to client, directly from file to socket, unless
+  /// socket is an SSL socket. File descriptor is only read from at explicit offsets, hence it can be shared with other requests.
+  void write_content (connection_ptr connection, int fd, uint64_t offset, uint64_t size, std::function<void()> on_success);
+
   /// Convenience method; Writes the given file on socket back to client, with a status code, using default headers for a file,
   /// standard headers for server, and basically the lot.
   /// If last_modified is true, it writes the last modification date of the file it is serving, otherwise it won't.
@@ -56,18 +66,64 @@ protected:
   /// Writes a file with the additional HTTP headers supplied, in addition to all the file standard headers, except "Last-Modified".
   void write_file (connection_ptr connection, path file_path, unsigned int status_code, collection headers, std::function<void()> on_success);
 
+  /// Checks if file should be rendered back to client, or if we should return a 304, according to when file was last modified.
+  bool should_write_file (std::time_t modified);
+
+  /// Writes 304 response back to client.
+  void write_304_response (connection_ptr connection, std::function<void()> on_success);
+
   /// Returns the MIME type according to file extension.
   string get_mime (connection_ptr connection, path filename);
 
 private:
 
+  /// Reads the next chunk of content into buffer, invoking callback with error::eof when there is nothing more to read.
+  typedef std::function<void (mutable_buffers_1 buffer, file_callback callback)> chunk_reader;
+
   /// Implementation of actual file write operation.
-  /// Will read _response_buffer.size() from file, and write buffer content to socket, before invoking self, until entire file has been written.
-  void write_file (connection_ptr connection, shared_ptr<ifstream> fs_ptr, std::function<void()> on_success);
+  /// Writes all chunks read from file on socket back to client.
+  void write_file (connection_ptr connection, shared_ptr<async_file> file_ptr, std::function<void()> on_success);
+
+  /// Reads the first chunk, for then to start the pipeline writing it to socket.
+  void write_chunks (connection_ptr connection, chunk_reader read_chunk, std::function<void()> on_success);
+
+  /// Writes the given buffer to socket, while reading the next chunk into the other buffer, before invoking self,
+  /// until all chunks have been written.
+  void write_chunk (connection_ptr connection, chunk_reader read_chunk, size_t index, size_t bytes, std::function<void()> on_success);
+
+  /// Doubles the chunk size, limited by the socket's send buffer size, and the maximum chunk size according to configuration.
+  void grow_chunk_size (connection_ptr connection);
+
+  /// Opens the given file for reading, and writes its content on socket back to client.
+  void open_and_write_file (connection_ptr connection, path filepath, std::function<void()> on_success);
+
+  /// Sends as much of content as socket accepts without blocking, directly from file, until all of it has been sent.
+  void send_content (connection_ptr connection, std::function<void()> on_success);
+
+  /// Reads the next chunk of content into buffer on the disc I/O threads, moving past it once it has been read.
+  void read_content (connection_ptr connection, mutable_buffers_1 buffer, file_callback callback);
+
+
+  /// Smallest chunk size used when sending files, which is what we start out with, before growing for fast clients.
+  const static size_t MIN_CHUNK_SIZE = 8192;
+
+  /// Buffers for sending content back to client in chunks, one is being written to socket, while the other is being read from file.
+  std::array<std::vector<char>, 2> _response_buffers;
+
+  /// Current chunk size.
+  size_t _chunk_size;
+
+  /// Maximum chunk size.
+  size_t _max_chunk_size;
+
+  /// File descriptor content is written from by write_content().
+  int _content_fd;
 
+  /// Offset of content not yet written.
+  uint64_t _content_offset;
 
-  /// Buffer for sending content back to client in chunks.
-  std::array<char, 8192> _response_buffer;
+  /// Offset of end of content.
+  uint64_t _content_end;
 };
 
 
@@ -23,6 +23,7 @@
 #include <functional>
 #include <boost/filesystem.hpp>
 #include <boost/noncopyable.hpp>
+#include "common/include/configuration.hpp"
 
 using std::string;
 using namespace boost::filesystem;
@@ -47,6 +48,21 @@ public:
   /// Handles the given request.
   virtual void handle (connection_ptr connection, std::function<void()> on_success) = 0;
 
+  /// Returns true if handler reads the content of the request, which means we should answer "Expect: 100-continue" with 100.
+  virtual bool reads_content () const { return false; }
+
+  /// Makes handler tell client that connection is closed once its response is written, with a "Connection: close" header.
+  void close_connection () { _close_connection = true; }
+
+  /// Returns true if connection is closed once the response of handler is written.
+  bool closes_connection () const { return _close_connection; }
+
+  /// Returns the HTTP status line for the given status code, including its CR/LF.
+  static string status_line (unsigned int status_code);
+
+  /// Returns the standard HTTP headers the server is configured to pass back on every response, except "Date", including their CR/LF.
+  static string standard_headers (const rosetta::common::configuration & configuration);
+
 protected:
 
   /// Protected constructor.
@@ -77,6 +93,9 @@ private:
 
   /// The request that owns this instance.
   class request * _request;
+
+  /// True if connection is closed once response is written.
+  bool _close_connection;
 };
 
 
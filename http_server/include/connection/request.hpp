@@ -19,6 +19,7 @@
 #define ROSETTA_SERVER_REQUEST_HPP
 
 #include <memory>
+#include "common/include/arena.hpp"
 #include "http_server/include/connection/request_envelope.hpp"
 #include "http_server/include/connection/create_request_handler.hpp"
 
@@ -30,13 +31,17 @@ typedef std::shared_ptr<connection> connection_ptr;
 
 
 /// Wraps a single HTTP request.
-class request
+class request : public boost::noncopyable
 {
 public:
 
   /// Creates a new request.
   request ();
 
+  /// Resets request, such that it can be reused for the next request on a keep-alive connection.
+  /// Rewinds the request's arena, without releasing its memory.
+  void reset ();
+
   /// Handles a request, on the given connection.
   void handle (connection_ptr connection);
 
@@ -46,8 +51,21 @@ public:
   /// Writes the given error response back to client.
   void write_error_response (connection_ptr connection, int status_code);
 
+  /// Returns the arena all request scoped strings and containers should allocate their memory from.
+  arena & memory() { return _memory; }
+
 private:
 
+  /// Invokes request handler, once client has been told to send its content, if necessary.
+  void handle_request (connection_ptr connection);
+
+  /// Returns true if client declared that request has content, with a non-zero Content-Length, or a Transfer-Encoding.
+  bool has_content () const;
+
+
+  /// Memory for request, must be declared before all members allocating from it.
+  arena _memory;
+
   /// Envelope for request, HTTP-Request line, HTTP headers and GET parameters.
   request_envelope _envelope;
 
@@ -23,6 +23,7 @@
 #include <vector>
 #include <functional>
 #include <boost/filesystem.hpp>
+#include "common/include/arena.hpp"
 #include "http_server/include/auth/authentication.hpp"
 
 namespace rosetta {
@@ -30,16 +31,16 @@ namespace http_server {
 
 using std::string;
 using namespace boost::filesystem;
+using namespace rosetta::common;
 
 class connection;
 typedef std::shared_ptr<connection> connection_ptr;
 
 class request;
 
-// Helpers for HTTP headers and GET parameters collections types.
-typedef std::tuple<string, string> collection_type;
-typedef std::vector<collection_type> collection;
-typedef const std::vector<collection_type> const_collection;
+// Helpers for HTTP headers and GET parameters collections types, allocating their memory from the request's arena.
+typedef std::tuple<arena_string, arena_string> envelope_collection_type;
+typedef std::vector<envelope_collection_type, arena_allocator<envelope_collection_type>> envelope_collection;
 
 
 /// Helper for reading the request envelope; HTTP-Request line, and HTTP headers.
@@ -53,6 +54,10 @@ public:
   /// Reads the request envelope from the connection, and invokes given callback afterwards.
   void read (connection_ptr connection, std::function<void()> on_success);
 
+  /// Resets envelope, such that it can be reused for the next request on a keep-alive connection.
+  /// Must be invoked before the arena of the request is reset.
+  void reset ();
+
 
   /// Returns the URI of the request.
   inline class path uri() const { return _uri; }
@@ -67,22 +72,25 @@ public:
   inline bool file_request () const { return !_folder_request; }
 
   /// Returns the type of the request.
-  inline const string & method() const { return _method; }
+  inline const arena_string & method() const { return _method; }
 
   /// Returns the HTTP version of the request.
-  inline const string & http_version() const { return _http_version; }
+  inline const arena_string & http_version() const { return _http_version; }
 
   /// Retrieves the value of the header with the specified name, or empty string if no such header exists.
-  const string & header (const string & name) const;
+  const arena_string & header (const char * name) const;
 
   /// Returns the headers collection for the current request.
-  const const_collection & headers () const { return _headers; }
+  const envelope_collection & headers () const { return _headers; }
 
   /// Returns the parameters collection for the current request.
-  const const_collection & parameters () const { return _parameters; }
+  const envelope_collection & parameters () const { return _parameters; }
   
   /// Returns true if parameter exists, even if it was supplied without a value.
-  bool has_parameter (const string & name) const;
+  bool has_parameter (const char * name) const;
+
+  /// Retrieves the value of the parameter with the specified name, or empty string if no such parameter exists.
+  const arena_string & parameter (const char * name) const;
 
   /// Returns authenticity ticket of request.
   const authentication::ticket & ticket() const { return _ticket; }
@@ -90,29 +98,35 @@ public:
 private:
 
   /// Parses the HTTP-Request line.
-  void parse_request_line (connection_ptr connection, const string & request_line);
+  void parse_request_line (connection_ptr connection, const arena_string & request_line);
 
   /// Parses and verifies correctness of the URI from the HTTP-Request line.
-  void parse_uri (connection_ptr connection, string uri);
+  void parse_uri (connection_ptr connection, const char * begin, const char * end);
 
   /// Reads the next HTTP headers from socket.
   void read_headers (connection_ptr connection, std::function<void()> on_success);
 
   /// Parses and verifies sanity of the given HTTP header line.
-  void parse_http_header_line (connection_ptr connection, const string & line);
+  void parse_http_header_line (connection_ptr connection, const arena_string & line);
 
   /// Parses the HTTP GET parameters.
-  void parse_parameters (const string & params);
+  void parse_parameters (const char * begin, const char * end);
 
   /// Authenticates client according to "Authorization" HTTP header value.
-  void authenticate_client (connection_ptr connection, const string & header_value);
+  void authenticate_client (connection_ptr connection, const arena_string & header_value);
+
+  /// Returns the next line from the connection's stream buffer, allocated from the request's arena.
+  arena_string get_line (connection_ptr connection);
+
+  /// Returns a new empty string, allocated from the request's arena.
+  arena_string create_string () const;
 
 
   /// Request this instance belongs to.
   request * _request;
 
   /// Type of request, GET/POST/DELETE/PUT etc.
-  string _method;
+  arena_string _method;
 
   /// Internal path to resource request is referring to.
   class path _path;
@@ -124,13 +138,13 @@ private:
   class path _uri;
 
   /// HTTP version of request.
-  string _http_version;
+  arena_string _http_version;
 
   /// Headers.
-  collection _headers;
+  envelope_collection _headers;
 
   /// GET parameters.
-  collection _parameters;
+  envelope_collection _parameters;
 
   /// Authentication ticket for request, if any.
   authentication::ticket _ticket;
@@ -74,6 +74,9 @@ public:
   /// Returns true if socket is closed by other side.
   virtual bool closed_by_other_side() = 0;
 
+  /// Returns the size of the socket's send buffer, or 0 if it cannot be determined.
+  virtual size_t send_buffer_size () = 0;
+
   /// Sets the connection instance for current instance.
   void set_connection (connection_ptr connection) { _connection = connection; };
 
@@ -124,6 +127,9 @@ public:
   /// Returns true if socket is closed by other side.
   bool closed_by_other_side() override {boost::system::error_code error; _socket.remote_endpoint (error); return error;}
 
+  /// Returns the size of the socket's send buffer.
+  size_t send_buffer_size () override {socket_base::send_buffer_size option; error_code error; _socket.get_option (option, error); return error ? 0 : option.value();}
+
 
   /// Returns socket to caller.
   ip::tcp::socket & socket() { return _socket; }
@@ -175,6 +181,9 @@ public:
   /// Returns true if socket is closed by other side.
   bool closed_by_other_side() override {boost::system::error_code error; _socket.lowest_layer().remote_endpoint (error); return error;}
 
+  /// Returns the size of the socket's send buffer.
+  size_t send_buffer_size () override {socket_base::send_buffer_size option; error_code error; _socket.lowest_layer().get_option (option, error); return error ? 0 : option.value();}
+
 
   /// Returns SSL stream wrapping socket to caller.
   ssl::stream<ip::tcp::socket> & ssl_stream() { return _socket; }
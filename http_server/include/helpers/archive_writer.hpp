@@ -0,0 +1,117 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_ARCHIVE_WRITER_HPP
+#define ROSETTA_SERVER_ARCHIVE_WRITER_HPP
+
+#include <ctime>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Creates a tar or zip archive as a stream, one file at the time, such that an archive can be sent while it is being created.
+/// Tar archives need nothing but the size of each file, which allows the content of files to be sent without ever looking at it,
+/// while zip archives need to see the content of each file, to calculate its checksum. Files are stored in zip archives without
+/// compression, and the central directory of a zip archive is kept in a temporary file until the end of the archive, which means
+/// that memory usage never depends on the number of files in archive.
+class archive_writer final : public boost::noncopyable
+{
+public:
+
+  /// Supported archive formats.
+  enum class format
+  {
+    tar,
+    zip
+  };
+
+  /// Creates a writer for the given format.
+  archive_writer (format type);
+
+  /// Removes temporary file, if any.
+  ~archive_writer ();
+
+  /// Returns the format of archive.
+  format type () const { return _type; }
+
+  /// Returns true if the content of every file must be given to update(), before end_file() is invoked.
+  bool needs_content () const { return _type == format::zip; }
+
+  /// Returns true if a file of the given size can be stored in archive. Zip archives are limited to files smaller than 4GB.
+  bool can_store (uint64_t size) const;
+
+  /// Appends the header of a file to buffer, which must be followed by exactly size bytes of content.
+  void begin_file (const std::string & name, uint64_t size, std::time_t modified, std::vector<char> & buffer);
+
+  /// Updates checksum of the current file with the next part of its content.
+  void update (const char * data, size_t size);
+
+  /// Returns the number of bytes end_file() will append to buffer for the current file.
+  size_t end_size () const;
+
+  /// Appends whatever follows the content of the current file to buffer. Blocks, since it might write to a temporary file.
+  void end_file (std::vector<char> & buffer);
+
+  /// Appends at most max bytes of whatever ends the archive to buffer, returning true once everything has been appended.
+  /// Blocks, since it might read from a temporary file.
+  bool finish (std::vector<char> & buffer, size_t max);
+
+private:
+
+  /// Appends the header of a tar file, and possibly a GNU long name preceding it, to buffer.
+  void begin_tar_file (const std::string & name, uint64_t size, std::time_t modified, std::vector<char> & buffer);
+
+  /// Appends the local header of a zip file to buffer.
+  void begin_zip_file (const std::string & name, uint64_t size, std::time_t modified, std::vector<char> & buffer);
+
+  /// Appends the end of the central directory of a zip archive to buffer.
+  void end_zip_archive (std::vector<char> & buffer);
+
+
+  /// Format of archive.
+  const format _type;
+
+  /// Name, size, modification time, checksum, and offset of local header, of the current file.
+  std::string _name;
+  uint64_t _size;
+  std::time_t _modified;
+  uint32_t _crc;
+  uint64_t _header_offset;
+
+  /// Number of bytes of archive created so far, and number of files in it.
+  uint64_t _offset;
+  uint64_t _files;
+
+  /// Temporary file containing central directory of a zip archive, and its size.
+  std::FILE * _directory;
+  uint64_t _directory_size;
+
+  /// True once we have started to finish the archive.
+  bool _finishing;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_ARCHIVE_WRITER_HPP
@@ -0,0 +1,159 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_ASYNC_FILE_HPP
+#define ROSETTA_SERVER_ASYNC_FILE_HPP
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "common/include/sha1.hpp"
+#include "http_server/include/helpers/io_worker_pool.hpp"
+
+#if defined(BOOST_ASIO_HAS_FILE)
+#include <boost/asio/stream_file.hpp>
+#endif // defined(BOOST_ASIO_HAS_FILE)
+
+using namespace boost::asio;
+using boost::system::error_code;
+
+namespace rosetta {
+namespace http_server {
+
+// Helper to make code more readable.
+typedef std::function<void (const error_code & error, size_t no_bytes)> file_callback;
+
+
+/// Wraps a file on disc, such that it can be read from and written to asynchronously, the same way we do with a rosetta_socket.
+/// If the server was built with io_uring support, and the kernel we're running on allows us to create a ring, reads and writes are
+/// submitted to io_uring, which means that disc I/O never blocks the event loop. Otherwise, we fall back to normal file descriptors,
+/// which are read from and written to on the disc I/O worker pool, resuming on the io_service when done.
+/// Notice, this is the only place io_uring is used. Sockets stay on epoll, and files served from the open file cache never use this class.
+class async_file final : public boost::noncopyable
+{
+public:
+
+  /// How to open file.
+  enum class open_mode
+  {
+    read,
+    write,
+    append,
+    append_only
+  };
+
+  /// Creates a file which is not yet opened.
+  async_file (io_service & service, io_worker_pool & pool);
+
+  /// Closes file, if it is open.
+  ~async_file ();
+
+  /// Opens the given file, returning false if file could not be opened.
+  /// If file is opened for writing, it is created if it doesn't exist, and truncated if it does.
+  /// If file is opened for appending, it is created if it doesn't exist, and positioned at its end.
+  /// If file is opened append only, every write ends up at the end of the file, even if somebody else writes to it too.
+  /// Such files cannot be the target of splice.
+  bool open (const boost::filesystem::path & filepath, open_mode mode);
+
+  /// Reads some bytes from file into buffer, invoking callback with error::eof when there is nothing more to read.
+  void async_read_some (mutable_buffers_1 buffer, file_callback callback);
+
+  /// Writes the entire buffer to file.
+  /// If write-behind is enabled, small buffers are copied and gathered, and only written once enough of them have been collected.
+  /// Large buffers are written together with whatever is pending, without copying them, except for their unaligned tail.
+  void async_write (const_buffers_1 buffer, file_callback callback);
+
+  /// Enables write-behind, making sure we write to file in large blocks, aligned with the file system's blocks.
+  void set_write_behind (size_t size);
+
+  /// Writes whatever is pending in the write-behind buffer to file.
+  void async_flush (file_callback callback);
+
+  /// Makes file hash everything written to it, such that content can be identified without reading it back from disc.
+  void enable_hashing ();
+
+  /// Returns true if file hashes everything written to it.
+  bool is_hashing () const { return _hasher != nullptr; }
+
+  /// Returns hash of everything written to file. Can only be invoked once, and only if hashing is enabled.
+  array<unsigned char, 20> digest () { return _hasher->digest (); }
+
+  /// Reserves disc space for length bytes from offset, without changing the size of file, such that large files stay unfragmented.
+  /// Only a hint, which is silently ignored if the file system does not support it.
+  void preallocate (size_t offset, size_t length);
+
+  /// Returns true if file was opened append only.
+  bool is_append_only () const { return _append_only; }
+
+  /// Returns true if file is open.
+  bool is_open () const;
+
+  /// Closes file, discarding anything pending in the write-behind buffer.
+  void close ();
+
+  /// Returns the file descriptor of file, for operations not wrapped by this class, such as splice.
+  int native_handle ();
+
+  /// Returns true if files are read from and written to with io_uring, which is decided once, the first time it is invoked,
+  /// by checking if the kernel allows us to create a ring at all.
+  static bool uses_io_uring ();
+
+private:
+
+  /// Writes the entire head and tail buffers to file, in that order, bypassing the write-behind buffer.
+  void write_to_file (const_buffer head, const_buffer tail, file_callback callback);
+
+  /// Writes the first bytes of the write-behind buffer to file, keeping the rest of it pending.
+  void write_pending (size_t bytes, file_callback callback);
+
+
+  /// The io_service callbacks are invoked on.
+  io_service & _service;
+
+  /// True if file was opened append only.
+  bool _append_only;
+
+  /// Size of write-behind buffer, 0 if write-behind is disabled.
+  size_t _write_behind;
+
+  /// Content not yet written to file.
+  std::vector<char> _pending;
+
+  /// Hash of everything written to file, if hashing is enabled.
+  std::unique_ptr<rosetta::common::sha1::hasher> _hasher;
+
+#if defined(BOOST_ASIO_HAS_FILE)
+
+  /// Actual io_uring backed file, only created if io_uring is available at run time.
+  std::unique_ptr<stream_file> _file;
+#endif // defined(BOOST_ASIO_HAS_FILE)
+
+  /// Worker pool doing the actual reading and writing, when io_uring is not available.
+  io_worker_pool & _pool;
+
+  /// Fallback file descriptor, used when io_uring is not available.
+  int _fd;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_ASYNC_FILE_HPP
@@ -0,0 +1,162 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_BATCH_EXTRACTOR_HPP
+#define ROSETTA_SERVER_BATCH_EXTRACTOR_HPP
+
+#include <set>
+#include <string>
+#include <vector>
+#include <functional>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "http_server/include/helpers/rename_journal.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Common base class for extracting many files into a folder as they arrive, such as the entries of an archive, or the parts of a
+/// multipart request, without ever keeping more than one chunk of them in memory.
+/// Parsing the content, and deciding what to do with its entries, is done by parse(), while the actual writing is done by write(),
+/// which blocks, and should be invoked on the disc I/O pool, after each invocation to parse(). Files are extracted into partial files
+/// first, which are renamed into place by commit() all at once, once everything has been extracted, or removed by rollback().
+class batch_extractor : public boost::noncopyable
+{
+public:
+
+  /// Decides if an entry can be extracted to the given path, returning the HTTP status code of the entry, which is 200 if it can.
+  typedef std::function<int (const boost::filesystem::path & target, bool folder)> entry_filter;
+
+  /// Result of a single entry.
+  struct entry
+  {
+    std::string name;
+    int status;
+    bool folder;
+    boost::filesystem::path target;
+    boost::filesystem::path partial;
+  };
+
+  /// Closes file currently being written to, if any.
+  virtual ~batch_extractor ();
+
+  /// Parses the next part of the content. If content cannot be extracted, error() tells why, and the rest of it is ignored.
+  virtual void parse (const char * data, size_t size) = 0;
+
+  /// Writes the content parsed so far to disc. Blocks, and throws if writing fails.
+  void write ();
+
+  /// Renames all files extracted into place as a single unit, using the given journal. Blocks, and throws if renaming fails.
+  void commit (rename_journal & journal);
+
+  /// Removes all partial files, and all folders created, leaving folder the way it was. Blocks.
+  void rollback ();
+
+  /// Returns the HTTP status code explaining why content could not be extracted, or 0 if nothing is wrong so far.
+  int error () const { return _error; }
+
+  /// Returns true if the end of the content has been seen.
+  bool finished () const { return _finished; }
+
+  /// Returns true if every entry can be extracted, ignoring entries of types we do not support.
+  bool succeeded () const;
+
+  /// Returns all entries seen so far.
+  const std::vector<entry> & entries () const { return _entries; }
+
+protected:
+
+  /// Creates an extractor, extracting into folder, asking filter about every entry, and refusing more than max_size bytes of content.
+  /// If durable is true, every file is flushed to disc before it is closed.
+  batch_extractor (const boost::filesystem::path & folder, entry_filter filter, size_t max_size, bool durable);
+
+  /// Starts extracting a file.
+  void begin_file (const std::string & name);
+
+  /// Writes the next part of the content of the current file, provided it can be extracted.
+  void write_content (const char * data, size_t size);
+
+  /// Done with the content of the current file.
+  void end_file ();
+
+  /// Starts extracting a folder.
+  void begin_folder (const std::string & name);
+
+  /// Adds an entry that cannot be extracted, with the given status code.
+  void skip_entry (const std::string & name, int status);
+
+
+  /// Max number of bytes of content.
+  const size_t _max_size;
+
+  /// Total number of bytes of content seen, whether we're done, and why content cannot be extracted, if it cannot.
+  size_t _total;
+  bool _finished;
+  int _error;
+
+private:
+
+  /// Something to do with the file system, decided by parse, and done by write.
+  struct operation
+  {
+    enum class type
+    {
+      create_folder,
+      open_file,
+      write_file,
+      close_file
+    } kind;
+    boost::filesystem::path path;
+    size_t offset;
+    size_t size;
+  };
+
+  /// Finds the target path of an entry, returning its HTTP status code.
+  int check_entry (const std::string & name, bool folder, boost::filesystem::path & target);
+
+  /// Makes sure folder, and all folders between it and the folder we extract into, are created.
+  void plan_folders (const boost::filesystem::path & folder);
+
+
+  /// Folder we extract into.
+  const boost::filesystem::path _folder;
+
+  /// Decides if entries can be extracted.
+  entry_filter _filter;
+
+  /// True if files should be flushed to disc before they are closed.
+  const bool _durable;
+
+  /// All entries seen so far, and folders we have decided to create.
+  std::vector<entry> _entries;
+  std::set<boost::filesystem::path> _planned_folders;
+
+  /// Operations decided by parse, not yet done by write, and the content they write.
+  std::vector<operation> _operations;
+  std::vector<char> _data;
+
+  /// File currently being written to, and folders write has created.
+  int _fd;
+  std::vector<boost::filesystem::path> _created_folders;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_BATCH_EXTRACTOR_HPP
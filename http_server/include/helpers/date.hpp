@@ -18,6 +18,7 @@
 #ifndef ROSETTA_SERVER_DATE_HELPER_HPP
 #define ROSETTA_SERVER_DATE_HELPER_HPP
 
+#include <ctime>
 #include <string>
 #include <boost/filesystem.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
@@ -37,9 +38,15 @@ public:
   /// Returns the "now" date.
   static date now ();
 
+  /// Returns the "now" date as a string, formatted according to RFC 1123, which is only formatted once every second.
+  static string now_string ();
+
   /// Returns a date according to when a file was last changed.
   static date from_path_change (path filepath);
 
+  /// Returns a date according to the given number of seconds since epoch.
+  static date from_time (std::time_t time);
+
   /// Parses a date from the given HTTP date format.
   static date parse (const string & value);
 
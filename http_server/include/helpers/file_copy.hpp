@@ -0,0 +1,54 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ROSETTA_SERVER_FILE_COPY_HPP
+#define ROSETTA_SERVER_FILE_COPY_HPP
+
+#include <boost/filesystem.hpp>
+
+using boost::filesystem::path;
+
+namespace rosetta {
+namespace http_server {
+namespace file_copy {
+
+
+/// Copies the given file, without passing its content through user space whenever the operating system allows it.
+/// First we try to clone the file, sharing all blocks between source and destination, then we let the kernel copy it,
+/// and only if neither is supported, we fall back to reading and writing it.
+/// Destination is created, or truncated if it exists, and removed again if copying fails.
+/// Throws a filesystem_error if something goes wrong. Blocking, hence never invoke on the network thread.
+void copy (const path & source, const path & destination);
+
+/// Recursively copies the given folder, skipping hidden files and folders. Destination must not exist.
+/// Blocking, hence never invoke on the network thread.
+void copy_folder (const path & source, const path & destination);
+
+/// Returns true if the given folder, or any of its sub folders, have their own access rights declared in an ".auth" file.
+bool contains_authorization_files (const path & folder);
+
+/// Returns the status code a COPY or MOVE of source to destination must be refused with, or 0 if destination can be replaced.
+/// An existing destination is refused with 412 if client does not allow us to overwrite it, the same way WebDAV does, and with 409
+/// if it cannot be replaced by a rename, which is the case if it is not of the same type as source, or if it is a folder that is not empty.
+/// Blocking, hence never invoke on the network thread.
+unsigned int check_destination (const path & source, const path & destination, bool overwrite);
+
+
+} // namespace file_copy
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_FILE_COPY_HPP
@@ -0,0 +1,60 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_FOLDER_WALKER_HPP
+#define ROSETTA_SERVER_FOLDER_WALKER_HPP
+
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Walks all files below a folder, one file at the time, the same way they would be listed with "?list", skipping hidden files and
+/// folders, partial uploads, and symbolic links. Only keeps one directory iterator for each level of folders it is inside of, which
+/// means that its memory usage depends upon the depth of the tree, and never on the number of files in it.
+class folder_walker final : public boost::noncopyable
+{
+public:
+
+  /// Creates a walker for all files below the given folder.
+  folder_walker (const boost::filesystem::path & folder);
+
+  /// Finds the next file, returning false if there are no more files. Blocks, hence it should be invoked on the disc I/O pool.
+  /// The name of the file is relative to folder, and only contains characters we accept in URIs.
+  bool next (boost::filesystem::path & file, std::string & name);
+
+private:
+
+  /// Folder we walk.
+  const boost::filesystem::path _folder;
+
+  /// Iterators for each level of folders we're currently inside of.
+  std::vector<boost::filesystem::directory_iterator> _iterators;
+
+  /// True once we have started walking.
+  bool _started;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_FOLDER_WALKER_HPP
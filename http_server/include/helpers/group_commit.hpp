@@ -0,0 +1,104 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ROSETTA_SERVER_GROUP_COMMIT_HPP
+#define ROSETTA_SERVER_GROUP_COMMIT_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include "http_server/include/helpers/io_worker_pool.hpp"
+
+using namespace boost::asio;
+using boost::system::error_code;
+
+namespace rosetta {
+namespace http_server {
+
+// Helper to make code more readable.
+typedef std::function<void (const error_code & error)> commit_callback;
+
+
+/// Makes files durable in batches, such that many small uploads can share the cost of flushing the disc.
+/// Files committed within a short window of each other are gathered into one batch, which is synced on the disc I/O pool,
+/// either by syncing each file, or by syncing the entire file system once. Only when the whole batch is durable, are the
+/// callbacks of its files invoked. Files committed while a batch is being synced, are gathered into the next batch.
+/// Folders can be committed the same way, once files are renamed into them, such that the new names of files are durable too.
+class group_commit final : public boost::noncopyable
+{
+public:
+
+  /// Creates a group commit stage, waiting at most window microseconds for more files, before it syncs at most max_files files at once.
+  /// If use_syncfs is true, batches are synced with a single syncfs, instead of one fdatasync for each file.
+  group_commit (io_service & service, io_worker_pool & pool, size_t window, size_t max_files, bool use_syncfs);
+
+  /// Adds the given file descriptor to the current batch, invoking callback when batch is durable.
+  /// Caller is responsible for keeping file descriptor open until callback is invoked.
+  void async_commit (int fd, commit_callback callback);
+
+  /// Adds the given folder to the current batch, invoking callback when batch is durable, including the names of files in folder.
+  /// A folder committed more than once in the same batch is only synced once.
+  void async_commit_folder (const std::string & folder, commit_callback callback);
+
+private:
+
+  /// A single file or folder waiting to become durable, where fd is -1 for folders, which are opened when batch is synced.
+  struct entry
+  {
+    int fd;
+    std::string folder;
+    commit_callback callback;
+  };
+
+  /// Adds the given entry to the current batch, opening window, or syncing batch immediately if it is full.
+  void add (entry value);
+
+  /// Syncs the current batch, unless a batch is already being synced.
+  void flush ();
+
+
+  /// Worker pool doing the actual syncing.
+  io_worker_pool & _pool;
+
+  /// Timer driving the window.
+  deadline_timer _timer;
+
+  /// How many microseconds to wait for more files before syncing a batch.
+  const size_t _window;
+
+  /// Max number of files in a single batch.
+  const size_t _max_files;
+
+  /// If true, we use syncfs to sync batches.
+  const bool _use_syncfs;
+
+  /// Files waiting for the next sync.
+  std::vector<entry> _batch;
+
+  /// True while timer is waiting for window to close.
+  bool _waiting;
+
+  /// True while a batch is being synced.
+  bool _flushing;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_GROUP_COMMIT_HPP
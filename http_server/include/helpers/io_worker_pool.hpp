@@ -0,0 +1,150 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_IO_WORKER_POOL_HPP
+#define ROSETTA_SERVER_IO_WORKER_POOL_HPP
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+using namespace boost::asio;
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Bounded pool of threads for blocking file system operations, such that a slow disc never stalls the network thread.
+/// Each worker has its own queue, and idle workers steal work from the back of the other workers' queues.
+/// When work is done, its completion handler is posted back to the io_service, which means that handlers resume
+/// on the network thread, and never need to synchronize with anything.
+/// If work throws an exception, the exception is rethrown on the network thread, instead of invoking the completion handler.
+/// Work is never executed on the network thread. When too many jobs are queued, connections wait with reading their next
+/// request until the queue has drained, which applies back pressure to clients, instead of stalling the network thread.
+class io_worker_pool final : public boost::noncopyable
+{
+public:
+
+  /// Creates a pool with the given number of threads, allowing at most max_queued jobs to wait for a thread.
+  /// The pool always has at least one thread, since work must never be executed on the network thread.
+  io_worker_pool (io_service & service, size_t threads, size_t max_queued);
+
+  /// Stops pool, waiting for all queued work to finish.
+  ~io_worker_pool ();
+
+  /// Executes work on a worker thread, for then to invoke on_done on the io_service's thread.
+  /// Work is always queued, also when the pool is saturated, and dropped without invoking on_done if the pool is stopped.
+  void post (std::function<void()> work, std::function<void()> on_done);
+
+  /// Invokes resume immediately if the pool is not saturated, and otherwise once enough queued jobs are done.
+  /// Must be invoked from the io_service's thread, and resume is invoked on that same thread.
+  void when_ready (std::function<void()> resume);
+
+  /// Returns true if max_queued or more jobs are waiting for a thread.
+  bool saturated () const { return _pending >= _max_queued; }
+
+  /// Stops pool, waiting for all queued work to finish.
+  void stop ();
+
+  /// Returns the number of jobs currently waiting for a thread.
+  size_t queue_depth () const { return _pending; }
+
+  /// Returns the number of jobs executed since pool was created.
+  size_t completed () const { return _completed; }
+
+  /// Returns the average time jobs have been waiting for a thread, in microseconds.
+  size_t average_wait () const { return _completed == 0 ? 0 : _total_wait / _completed; }
+
+  /// Returns the longest time a job has been waiting for a thread, in microseconds.
+  size_t max_wait () const { return _max_wait; }
+
+private:
+
+  /// A single piece of work.
+  struct job
+  {
+    std::function<void()> work;
+    std::function<void()> on_done;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  /// Queue belonging to a single worker.
+  struct worker_queue
+  {
+    std::mutex lock;
+    std::deque<job> jobs;
+  };
+
+  /// Main loop of worker thread.
+  void run (size_t index);
+
+  /// Retrieves the next job for the given worker, stealing from other workers if its own queue is empty.
+  bool pop (size_t index, job & result);
+
+  /// Executes the given job, and posts its completion handler back to io_service.
+  void execute (job & item);
+
+  /// Resumes callers waiting for the pool to no longer be saturated, invoked on the io_service's thread.
+  void resume_waiting ();
+
+
+  /// io_service completion handlers are posted to.
+  io_service & _service;
+
+  /// Maximum number of jobs that can wait for a thread.
+  const size_t _max_queued;
+
+  /// Queues, one for each worker.
+  std::vector<std::unique_ptr<worker_queue>> _queues;
+
+  /// Worker threads.
+  std::vector<std::thread> _threads;
+
+  /// Callers waiting for the pool to no longer be saturated, only touched on the io_service's thread.
+  std::deque<std::function<void()>> _waiting;
+
+  /// Lock and condition used to put idle workers to sleep.
+  std::mutex _lock;
+  std::condition_variable _wakeup;
+
+  /// True when pool is stopped.
+  std::atomic<bool> _stopped;
+
+  /// Round robin counter used to distribute work among queues.
+  std::atomic<size_t> _next;
+
+  /// Metrics.
+  std::atomic<size_t> _pending;
+  std::atomic<size_t> _completed;
+  std::atomic<size_t> _total_wait;
+  std::atomic<size_t> _max_wait;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_IO_WORKER_POOL_HPP
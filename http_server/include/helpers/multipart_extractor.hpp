@@ -0,0 +1,77 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_MULTIPART_EXTRACTOR_HPP
+#define ROSETTA_SERVER_MULTIPART_EXTRACTOR_HPP
+
+#include <string>
+#include <boost/filesystem.hpp>
+#include "http_server/include/helpers/batch_extractor.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Extracts the parts of a "multipart/mixed" request into a folder as they arrive, which is the same format a GET of many files at once
+/// returns. Every part is a file, named by its URI encoded "Content-Location" header, relative to the folder.
+class multipart_extractor final : public batch_extractor
+{
+public:
+
+  /// Creates an extractor for content delimited by the given boundary, extracting into folder, asking filter about every file,
+  /// and refusing more than max_size bytes of content. If durable is true, every file is flushed to disc before it is closed.
+  multipart_extractor (const boost::filesystem::path & folder, const std::string & boundary, entry_filter filter, size_t max_size, bool durable);
+
+  /// Returns the boundary given by a "multipart/mixed" Content-Type header, or an empty string if there is none.
+  static std::string boundary (const std::string & content_type);
+
+  /// Parses the next part of the content.
+  virtual void parse (const char * data, size_t size) override;
+
+private:
+
+  /// What we're currently parsing.
+  enum class state
+  {
+    preamble,
+    delimiter,
+    headers,
+    content
+  };
+
+  /// Parses as much as possible of what we have collected, returning false when we need more content.
+  bool parse_buffer ();
+
+  /// Parses the headers of a part, and starts extracting its file.
+  void parse_headers (const std::string & headers);
+
+
+  /// Delimiter between parts, which is CR/LF, followed by "--", and the boundary.
+  const std::string _delimiter;
+
+  /// What we're currently parsing.
+  state _state;
+
+  /// Content we have not yet parsed, since we might need more of it to decide what it is.
+  std::string _buffer;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_MULTIPART_EXTRACTOR_HPP
@@ -0,0 +1,233 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_OPEN_FILE_CACHE_HPP
+#define ROSETTA_SERVER_OPEN_FILE_CACHE_HPP
+
+#include <set>
+#include <list>
+#include <vector>
+#include <ctime>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Cache of open files, and their metadata, such that serving a file that was recently served needs neither stat nor open.
+/// Every file is cached for a short while, after which it is stat'ed again to see if it changed, and the folders of cached files
+/// are watched with inotify, such that files are removed from cache as soon as they are changed, moved or deleted. Pending changes
+/// are picked up every time a file is opened, hence a client that changes a file always sees its change in the next request.
+/// Only the folder a file is inside of is watched, hence if some other process moves one of the folders above it, the file is
+/// trusted until it expires.
+/// Files that do not exist are remembered the same way, in a separate list, watching the deepest folder of their path that does
+/// exist, such that broken links, and scanners looking for files we do not have, costs no system calls either, until something
+/// is created that might be the missing file, or one of the folders leading up to it. Only used from the network thread, except for
+/// load, which opens files the cache does not know about on a disc I/O thread.
+class open_file_cache final : public boost::noncopyable
+{
+public:
+
+  /// An open file, which is closed when the last request using it, and the cache, are done with it.
+  class file final : public boost::noncopyable
+  {
+  public:
+
+    /// Takes ownership of the given file descriptor.
+    file (int fd, const struct stat & info);
+
+    /// Closes file.
+    ~file ();
+
+    /// File descriptor, which must only be read from with an explicit offset, since it is shared by many requests.
+    const int fd;
+
+    /// Size of file when it was opened.
+    const uint64_t size;
+
+    /// When file was last modified when it was opened.
+    const std::time_t modified;
+
+  private:
+
+    friend class open_file_cache;
+
+    /// Device and inode of file, and its modification date in nanoseconds, used to figure out if file changed.
+    const uint64_t _device;
+    const uint64_t _inode;
+    const int64_t _modified_ns;
+  };
+
+  /// Shared pointer to an open file.
+  typedef std::shared_ptr<const file> file_ptr;
+
+  /// A file the cache did not know about, loaded on a disc I/O thread, waiting to be inserted into cache on the network thread.
+  struct loaded
+  {
+    /// Generation of cache when caller found out cache did not know about file, which must be set before file is loaded.
+    size_t generation = 0;
+
+    /// The open file, nullptr if it is not a regular file, or cannot be opened.
+    file_ptr file;
+
+    /// True if file does not exist.
+    bool missing = false;
+
+    /// Watch of the folder file is inside of, or of the deepest folder of its path that exists if it does not exist, -1 if none.
+    int watch = -1;
+
+    /// Name of the file or folder inside of the watched folder.
+    std::string name;
+  };
+
+  /// Creates a cache of at most max_files files, and max_missing files that do not exist, that are trusted for validity seconds
+  /// before they are stat'ed or looked for again. If max_files is 0, nothing is cached, and files are opened every time.
+  open_file_cache (size_t max_files, size_t max_missing, size_t validity);
+
+  /// Closes all files.
+  ~open_file_cache ();
+
+  /// Looks up the given file in cache, returning true if cache knows about it, at which point file is set to the open file, or missing
+  /// is set to true if file does not exist. Makes no system calls, besides reading what inotify has to say, and stat'ing an expired file.
+  /// If it returns false, caller must load file on a disc I/O thread, and insert it into cache on the network thread.
+  bool find (const boost::filesystem::path & filepath, file_ptr & file, bool & missing);
+
+  /// Opens the given file for reading, watching its folder before it is opened, such that no change to it is lost. Only reads members
+  /// that never change, hence it can be invoked on a disc I/O thread.
+  void load (const boost::filesystem::path & filepath, loaded & result) const;
+
+  /// Inserts a loaded file into cache, returning the open file, or nullptr if it could not be opened. The file is only cached if nothing
+  /// changed since result's generation, since we cannot know if a change we saw in the meantime was about the file being loaded.
+  file_ptr insert (const boost::filesystem::path & filepath, const loaded & result);
+
+  /// Generation of cache, which changes whenever something in the file system changes, or a watch is removed.
+  size_t generation () const { return _generation; }
+
+  /// Removes the given file, or every file inside the given folder, from cache, including files remembered as missing, for changes
+  /// inotify might not have told us about yet, or cannot tell us about, such as a folder being moved together with its parent.
+  void invalidate (const boost::filesystem::path & filepath);
+
+private:
+
+  /// A cached file.
+  struct entry
+  {
+    /// Path of file, as it was opened.
+    std::string path;
+
+    /// Name of file inside of its folder, as inotify reports it.
+    std::string name;
+
+    /// Watch of the folder file is inside of.
+    int watch;
+
+    /// The open file.
+    file_ptr file;
+
+    /// When we have to stat file again, to see if it changed.
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  /// Most recently used files first.
+  typedef std::list<entry> entry_list;
+
+  /// A file that does not exist.
+  struct missing_entry
+  {
+    /// Path of file.
+    std::string path;
+
+    /// Name of the file or folder inside of the watched folder, that would have to be created for file to exist.
+    std::string name;
+
+    /// Watch of the deepest folder of path that exists.
+    int watch;
+
+    /// When we have to look for file again.
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  /// Most recently requested missing files first.
+  typedef std::list<missing_entry> missing_list;
+
+  /// Paths of cached files, and missing files, inside of a watched folder.
+  struct watched_folder
+  {
+    std::set<std::string> files;
+    std::set<std::string> missing;
+  };
+
+  /// Opens file, without caching it, setting missing to true if it does not exist.
+  static file_ptr open_file (const boost::filesystem::path & filepath, bool & missing);
+
+  /// Removes the given entry from cache, and stops watching its folder if it was the last file in it.
+  void erase (entry_list::iterator iter);
+
+  /// Forgets the given missing file, and stops watching its folder if it was the last file in it.
+  void erase (missing_list::iterator iter);
+
+  /// Stops watching folder, if there are no more files in cache inside of it.
+  void release_watch (std::unordered_map<int, watched_folder>::iterator watch);
+
+  /// Reads whatever inotify has to say, without blocking, removing files that have changed.
+  void read_changes ();
+
+
+  /// Maximum number of cached files.
+  const size_t _max_files;
+
+  /// Maximum number of remembered missing files.
+  const size_t _max_missing;
+
+  /// How long files are trusted before they are stat'ed again.
+  const std::chrono::seconds _validity;
+
+  /// Non-blocking inotify instance, -1 if inotify is not available, in which case nothing is cached.
+  int _inotify;
+
+  /// Cached files.
+  entry_list _entries;
+
+  /// Cached files, by their paths.
+  std::unordered_map<std::string, entry_list::iterator> _paths;
+
+  /// Missing files.
+  missing_list _missing;
+
+  /// Missing files, by their paths.
+  std::unordered_map<std::string, missing_list::iterator> _missing_paths;
+
+  /// Paths of cached files, and missing files, by the inotify watch of their folder.
+  std::unordered_map<int, watched_folder> _watches;
+
+  /// Changes whenever inotify tells us something, a file is invalidated, or a watch is removed.
+  size_t _generation;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_OPEN_FILE_CACHE_HPP
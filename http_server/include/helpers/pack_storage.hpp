@@ -0,0 +1,165 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_PACK_STORAGE_HPP
+#define ROSETTA_SERVER_PACK_STORAGE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ctime>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Layout of a pack file, which is a single file containing many small immutable files, to save inodes, and the stat and open
+/// of every request. A pack starts out with a header, followed by the content of every file, followed by an index, starting
+/// at a page boundary, such that it can be memory mapped on its own. The index is a table of records, one for each file,
+/// followed by a hash table of record numbers, followed by the names and MIME types of files.
+namespace pack_format {
+
+  /// Magic bytes a pack starts out with, including the version of its format.
+  const char MAGIC[8] = {'R', 'P', 'A', 'C', 'K', '0', '0', '1'};
+
+  /// Value of empty buckets in the hash table.
+  const uint32_t EMPTY_BUCKET = 0xffffffff;
+
+  /// Header of a pack.
+  struct header
+  {
+    char magic[8];
+    uint64_t records;
+    uint64_t buckets;
+    uint64_t index_offset;
+    uint64_t index_size;
+  };
+
+  /// Record describing one file in a pack, where names and MIME types are offsets into the strings following the hash table.
+  struct record
+  {
+    uint64_t name_offset;
+    uint64_t mime_offset;
+    uint32_t name_size;
+    uint32_t mime_size;
+    uint64_t offset;
+    uint64_t size;
+    int64_t modified;
+  };
+
+  /// Hashes the name of a file, using FNV-1a, which is cheap for the short names we have, and spreads them well enough.
+  inline uint64_t hash (const char * name, size_t size)
+  {
+    uint64_t result = 14695981039346656037ULL;
+    for (size_t idx = 0; idx < size; ++idx)
+      result = (result ^ static_cast<unsigned char> (name [idx])) * 1099511628211ULL;
+    return result;
+  }
+}
+
+
+/// A read-only pack file, with its index memory mapped, such that finding a file in it is a single hash lookup.
+class pack_file final : public boost::noncopyable
+{
+public:
+
+  /// A file found in a pack.
+  struct entry
+  {
+    /// File descriptor of pack, to read or send content from.
+    int fd;
+
+    /// Offset of content in pack.
+    uint64_t offset;
+
+    /// Size of content.
+    uint64_t size;
+
+    /// When file was last modified, before it was packed.
+    std::time_t modified;
+
+    /// MIME type of file, if it was stored in pack, otherwise empty.
+    std::string mime;
+  };
+
+  /// Opens the given pack, and maps its index into memory. Throws if pack cannot be opened, or is not a valid pack.
+  pack_file (const boost::filesystem::path & filename);
+
+  /// Unmaps index, and closes pack.
+  ~pack_file ();
+
+  /// Finds the file with the given name, which is its URI, returning false if it is not in pack.
+  bool find (const std::string & name, entry & result) const;
+
+private:
+
+  /// File descriptor of pack.
+  int _fd;
+
+  /// Memory mapped index.
+  void * _index;
+
+  /// Header of pack.
+  pack_format::header _header;
+
+  /// Records of index.
+  const pack_format::record * _records;
+
+  /// Hash table of index.
+  const uint32_t * _buckets;
+
+  /// Names and MIME types of index.
+  const char * _strings;
+
+  /// Size of strings.
+  uint64_t _strings_size;
+
+  /// Size of pack.
+  uint64_t _size;
+};
+
+
+/// Storage backend for files packed into pack files, which are looked up before the file system, for files that never change.
+/// Packs are read-only, hence a file found in a pack shadows a file with the same name in the file system.
+class pack_storage final : public boost::noncopyable
+{
+public:
+
+  /// Opens all the given packs, where packs listed first shadows files in packs listed after it.
+  pack_storage (const std::vector<boost::filesystem::path> & packs);
+
+  /// Returns true if there are no packs.
+  bool empty () const { return _packs.empty (); }
+
+  /// Finds the file with the given name, which is its URI, returning false if it is not in any of the packs.
+  bool find (const std::string & name, pack_file::entry & result) const;
+
+private:
+
+  /// All packs.
+  std::vector<std::unique_ptr<pack_file>> _packs;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_PACK_STORAGE_HPP
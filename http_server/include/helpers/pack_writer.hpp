@@ -0,0 +1,85 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_PACK_WRITER_HPP
+#define ROSETTA_SERVER_PACK_WRITER_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "http_server/include/helpers/pack_storage.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Creates a pack file, one file at the time. The pack is written to a partial file, which is renamed into place once it is
+/// finished, such that a server never sees a pack that is half way written.
+class pack_writer final : public boost::noncopyable
+{
+public:
+
+  /// Creates a writer for the given pack.
+  pack_writer (const boost::filesystem::path & filename);
+
+  /// Removes partial pack, unless it was finished.
+  ~pack_writer ();
+
+  /// Adds the given file to pack, as the given name, which is the URI it is served as. If mime is empty, server uses its own
+  /// configuration to figure out the MIME type of file.
+  void add (const std::string & name, const boost::filesystem::path & file, const std::string & mime);
+
+  /// Writes index of pack, and renames it into place.
+  void finish ();
+
+private:
+
+  /// Pack we're creating.
+  const boost::filesystem::path _filename;
+
+  /// Partial pack we write to.
+  const boost::filesystem::path _partial;
+
+  /// Stream for partial pack.
+  std::ofstream _stream;
+
+  /// Records of files added so far.
+  std::vector<pack_format::record> _records;
+
+  /// Names and MIME types of files added so far.
+  std::string _strings;
+
+  /// Offsets of MIME types in strings, such that every MIME type is only stored once.
+  std::map<std::string, uint64_t> _mimes;
+
+  /// Names added so far, to make sure no name is added twice.
+  std::set<std::string> _names;
+
+  /// True once pack has been finished.
+  bool _finished;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_PACK_WRITER_HPP
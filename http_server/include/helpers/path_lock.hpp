@@ -0,0 +1,70 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_PATH_LOCK_HPP
+#define ROSETTA_SERVER_PATH_LOCK_HPP
+
+#include <map>
+#include <deque>
+#include <memory>
+#include <string>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+using namespace boost::asio;
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Serializes operations on the same path, such that only one of them runs at the time, while the rest waits in line, in the order they
+/// arrived. Operations on different paths never wait for each other. Only used from the network thread, hence it needs no mutex.
+class path_lock final : public boost::noncopyable
+{
+public:
+
+  /// Keeps a path locked for as long as it exists, unlocking it when the last copy of it is destroyed.
+  typedef std::shared_ptr<void> holder;
+
+  /// Creates a lock, invoking waiters on the given io_service.
+  path_lock (io_service & service);
+
+  /// Locks the given path, invoking on_locked with the holder of the lock once no other operation holds it.
+  void async_lock (const std::string & path, std::function<void(holder)> on_locked);
+
+private:
+
+  /// Unlocks the given path, handing it over to the next operation waiting for it, if any.
+  void unlock (const std::string & path);
+
+  /// Creates the holder of a lock on the given path.
+  holder create_holder (const std::string & path);
+
+
+  /// The io_service waiters are invoked on.
+  io_service & _service;
+
+  /// All paths currently locked, and the operations waiting for each of them.
+  std::map<std::string, std::deque<std::function<void(holder)>>> _locked;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_PATH_LOCK_HPP
@@ -0,0 +1,80 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_RENAME_JOURNAL_HPP
+#define ROSETTA_SERVER_RENAME_JOURNAL_HPP
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Renames a set of files into place as a single unit, such that either all of them are renamed, or none of them are.
+/// Before anything is renamed, the entire set is written to a journal in a hidden folder. If renaming fails, whatever was renamed
+/// is put back the way it was, using hard links to the files it replaced. If the server dies while renaming, recover() finishes the
+/// job the next time the server starts, since the journal is only written once every file in the set has been completely written.
+/// Sets are renamed one at the time, such that two sets renaming the same files never interleave.
+class rename_journal final : public boost::noncopyable
+{
+public:
+
+  /// List of files to rename, from their partial name, to their target.
+  typedef std::vector<std::pair<boost::filesystem::path, boost::filesystem::path>> rename_list;
+
+  /// Creates a journal in the given folder. If durable is true, the journal is flushed to disc before anything is renamed, and the
+  /// folders of the renamed files are flushed before the journal is removed.
+  rename_journal (const boost::filesystem::path & folder, bool durable);
+
+  /// Renames all files in list into place. Blocks, and throws if renaming fails, in which case nothing is renamed.
+  void commit (const rename_list & renames);
+
+  /// Finishes whatever set of files was being renamed when server stopped. Blocks, and should be invoked when server starts.
+  void recover ();
+
+private:
+
+  /// Writes the given list to a journal, returning its path.
+  boost::filesystem::path write_journal (const rename_list & renames);
+
+  /// Flushes the folders files in list were renamed into to disc, such that their new names are durable. Throws if it fails.
+  void sync_targets (const rename_list & renames);
+
+
+  /// Folder containing journals, and hard links to the files a set replaces while it is being renamed.
+  const boost::filesystem::path _folder;
+
+  /// True if journals should be flushed to disc.
+  const bool _durable;
+
+  /// Used to create unique names in folder.
+  std::atomic<size_t> _counter;
+
+  /// Makes sure only one set is renamed at the time.
+  std::mutex _lock;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_RENAME_JOURNAL_HPP
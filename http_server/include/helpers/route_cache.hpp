@@ -0,0 +1,102 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_ROUTE_CACHE_HPP
+#define ROSETTA_SERVER_ROUTE_CACHE_HPP
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+#include "http_server/include/helpers/pack_storage.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Cache of how requests for files were routed, by method, role of client, and path, such that the common static GET needs neither
+/// authorization, nor lookups in packs, nor lookups in configuration.
+/// Only decisions that do not depend upon the file system are cached, since configuration and packs never change while server is
+/// running, and the file system is left to the open file cache, which watches it with inotify. The whole cache is cleared when
+/// access rights change, which is known from the generation of our authorization object. Only used from the network thread.
+class route_cache final : public boost::noncopyable
+{
+public:
+
+  /// How a request is routed.
+  struct route
+  {
+    /// Kind of route.
+    enum kind_type
+    {
+      /// Client is not authorized.
+      unauthorized,
+
+      /// File is served from a pack.
+      packed,
+
+      /// File is served from the file system.
+      file,
+
+      /// Files of this type are not served.
+      not_served
+    } kind;
+
+    /// Packed file, if file is served from a pack.
+    pack_file::entry entry;
+
+    /// MIME type of file, empty if there is no MIME type for its extension.
+    std::string mime;
+  };
+
+  /// Creates a cache of at most max_routes routes, where 0 disables cache.
+  route_cache (size_t max_routes);
+
+  /// Looks for a route, returning false if it is not cached, or access rights changed since it was cached.
+  bool find (const std::string & key, size_t generation, route & result);
+
+  /// Caches a route, decided when access rights had the given generation.
+  void insert (const std::string & key, size_t generation, const route & value);
+
+private:
+
+  /// Most recently used routes first, with their keys.
+  typedef std::list<std::pair<std::string, route>> route_list;
+
+  /// Clears cache, if access rights changed since routes were cached.
+  void check_generation (size_t generation);
+
+
+  /// Maximum number of cached routes.
+  const size_t _max_routes;
+
+  /// Generation of access rights cached routes were decided with.
+  size_t _generation;
+
+  /// Cached routes.
+  route_list _routes;
+
+  /// Cached routes, by their keys.
+  std::unordered_map<std::string, route_list::iterator> _keys;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_ROUTE_CACHE_HPP
@@ -0,0 +1,69 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_SPLICE_PIPE_HPP
+#define ROSETTA_SERVER_SPLICE_PIPE_HPP
+
+#include <cstddef>
+#include <boost/system/error_code.hpp>
+#include <boost/noncopyable.hpp>
+
+using boost::system::error_code;
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Kernel pipe used to move bytes from a socket into a file with splice, without ever copying them into user space.
+/// Only available on Linux, on other systems is_supported() returns false, and callers must fall back to read and write.
+class splice_pipe final : public boost::noncopyable
+{
+public:
+
+  /// Creates a pipe, trying to make its capacity the given number of bytes.
+  splice_pipe (size_t capacity);
+
+  /// Closes both ends of pipe.
+  ~splice_pipe ();
+
+  /// Returns true if pipe was successfully created, and splice is supported on this system.
+  bool is_supported () const { return _fds [0] != -1; }
+
+  /// Returns how many bytes pipe can hold.
+  size_t capacity () const { return _capacity; }
+
+  /// Moves at most max bytes from the given non-blocking socket into pipe, returning the number of bytes moved.
+  /// Sets error to would_block if the socket has no data available, and returns 0 if the other side closed the socket.
+  size_t fill (int socket_fd, size_t max, error_code & error);
+
+  /// Moves exactly the given number of bytes from pipe into the given file, at the file's current position.
+  void drain (int file_fd, size_t bytes, error_code & error);
+
+private:
+
+  /// Read and write end of pipe.
+  int _fds [2];
+
+  /// Capacity of pipe.
+  size_t _capacity;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_SPLICE_PIPE_HPP
@@ -0,0 +1,108 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_TAR_EXTRACTOR_HPP
+#define ROSETTA_SERVER_TAR_EXTRACTOR_HPP
+
+#include <array>
+#include <memory>
+#include <string>
+#include <boost/filesystem.hpp>
+#include "http_server/include/helpers/batch_extractor.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Extracts a tar archive into a folder as the archive arrives, without ever keeping more than one chunk of it in memory.
+/// If the archive is gzip compressed, it is decompressed on the fly, provided the server was built with zlib.
+class tar_extractor final : public batch_extractor
+{
+public:
+
+  /// Creates an extractor, extracting into folder, asking filter about every entry, and refusing archives with more than max_size bytes
+  /// of content. If durable is true, every file is flushed to disc before it is closed.
+  tar_extractor (const boost::filesystem::path & folder, entry_filter filter, size_t max_size, bool durable);
+
+  /// Ends decompression, if archive was compressed.
+  ~tar_extractor ();
+
+  /// Returns true if server was built with support for gzip compressed archives.
+  static bool supports_gzip ();
+
+  /// Parses the next part of the archive.
+  virtual void parse (const char * data, size_t size) override;
+
+private:
+
+  /// What we're currently parsing.
+  enum class state
+  {
+    header,
+    file_content,
+    meta_content,
+    skip_content,
+    padding
+  };
+
+  /// Decompression state for gzip compressed archives.
+  struct inflater;
+
+  /// Feeds decompressed content to tar parser.
+  void decompress (const char * data, size_t size);
+
+  /// Parses decompressed content.
+  void parse_tar (const char * data, size_t size);
+
+  /// Parses the header block we have collected.
+  void parse_header ();
+
+  /// Starts reading the content of the entry whose header we just parsed.
+  void start_content (state next);
+
+  /// Invoked when all content of entry has been read.
+  void end_content ();
+
+
+  /// The first bytes of archive, used to figure out if archive is compressed.
+  std::string _magic;
+
+  /// Decompression state, if archive is compressed.
+  std::unique_ptr<inflater> _inflater;
+
+  /// What we're currently parsing, the header block we're collecting, and how many bytes of it we have.
+  state _state;
+  std::array<char, 512> _block;
+  size_t _block_size;
+
+  /// Size of current entry, and how many bytes of it, or its padding, that are left.
+  size_t _entry_size;
+  size_t _left;
+
+  /// Type and content of a GNU long name, or pax extended header, and the name it gives the next entry.
+  char _meta_type;
+  std::string _meta;
+  std::string _long_name;
+
+  /// Number of consecutive blocks of zeros seen.
+  size_t _zero_blocks;
+};
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_TAR_EXTRACTOR_HPP
@@ -0,0 +1,122 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_TIMER_WHEEL_HPP
+#define ROSETTA_SERVER_TIMER_WHEEL_HPP
+
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+using namespace boost::asio;
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Hashed timing wheel, owning all timeouts in the server, with a resolution of one second.
+/// Arming and canceling a timeout is O(1), since each timeout is an intrusive node in a doubly linked list,
+/// hashed into a slot according to when it expires. A single deadline_timer drives the wheel, which means asio
+/// only ever sees one timer, regardless of how many connections we have.
+/// Timeouts longer than the circumference of the wheel are handled by counting how many rounds they have left.
+class timer_wheel final : public boost::noncopyable
+{
+public:
+
+  /// A single timeout, embedded into the object that can time out.
+  /// Destroying an armed timeout automatically cancels it.
+  class timeout final : public boost::noncopyable
+  {
+  public:
+
+    /// Creates a timeout that is not armed.
+    timeout () : _previous (this), _next (this), _rounds (0) { }
+
+    /// Cancels timeout, if it is armed.
+    ~timeout () { unlink (); }
+
+    /// Returns true if timeout is armed.
+    bool armed () const { return _next != this; }
+
+  private:
+
+    /// Making sure only timer wheel can modify timeout.
+    friend class timer_wheel;
+
+    /// Removes timeout from whatever list it belongs to.
+    void unlink ();
+
+    /// Inserts timeout before the given node.
+    void link_before (timeout & node);
+
+
+    /// Previous timeout in slot, or timeout itself if not armed.
+    timeout * _previous;
+
+    /// Next timeout in slot, or timeout itself if not armed.
+    timeout * _next;
+
+    /// How many times the wheel needs to wrap around, before timeout expires.
+    size_t _rounds;
+
+    /// Callback invoked when timeout expires.
+    std::function<void()> _callback;
+  };
+
+  /// Creates a timer wheel with the given number of one second slots.
+  timer_wheel (io_service & service, size_t slots = 512);
+
+  /// Making sure no timeouts refers to our slots after we are destroyed.
+  ~timer_wheel ();
+
+  /// Starts turning the wheel.
+  void start ();
+
+  /// Stops turning the wheel, such that io_service can run out of work.
+  void stop ();
+
+  /// Arms the given timeout to invoke callback after the specified amount of seconds, re-arming it if it is already armed.
+  void arm (timeout & entry, size_t seconds, std::function<void()> callback);
+
+  /// Cancels the given timeout, if it is armed.
+  void cancel (timeout & entry);
+
+private:
+
+  /// Invoked once every second, expiring all timeouts in the next slot.
+  void tick ();
+
+
+  /// Timer driving the wheel.
+  deadline_timer _timer;
+
+  /// Slots of wheel, each slot is the sentinel of a circular list of timeouts.
+  std::vector<timeout> _slots;
+
+  /// Current position of the wheel.
+  size_t _current;
+
+  /// True if wheel is turning.
+  bool _running;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_TIMER_WHEEL_HPP
@@ -0,0 +1,93 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_TRASH_BIN_HPP
+#define ROSETTA_SERVER_TRASH_BIN_HPP
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include "http_server/include/helpers/io_worker_pool.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Removes folders in the background, such that deleting a huge folder never stalls the server.
+/// Folders are first moved into a trash folder outside of www-root, which is atomic as long as it is on the same file system, for then
+/// to have their content removed in batches on the disc I/O pool. Since trash is never inside of www-root, nothing in it can be
+/// served while it waits to be removed, even though the access rights of what was deleted are already forgotten.
+/// Only one batch is queued at the time, and each batch is queued behind whatever other work is already waiting, which means
+/// that emptying the trash never occupies more than one worker thread, and never gets in the way of serving requests.
+class trash_bin final : public boost::noncopyable
+{
+public:
+
+  /// Creates a trash bin in the given folder, removing at most batch_size files in each job it queues on pool.
+  trash_bin (io_worker_pool & pool, const boost::filesystem::path & folder, size_t batch_size);
+
+  /// Moves the given file or folder into trash, where it is no longer visible.
+  /// Blocks, hence it should be invoked on the disc I/O pool.
+  void discard (const boost::filesystem::path & object);
+
+  /// Starts emptying trash, unless it is already being emptied. Must be invoked on the network thread.
+  void empty ();
+
+  /// Stops emptying trash, leaving whatever is left in it, to be removed the next time the server starts.
+  void stop ();
+
+private:
+
+  /// Queues the next batch of removals on pool.
+  void queue_batch ();
+
+  /// Removes the next batch of files from trash, returning false if there was nothing left to remove, or trash could not be emptied.
+  /// Invoked on pool, but never from more than one thread at the time.
+  bool remove_batch ();
+
+
+  /// Pool batches are queued on.
+  io_worker_pool & _pool;
+
+  /// Folder containing trash.
+  const boost::filesystem::path _folder;
+
+  /// Max number of files removed in each batch.
+  const size_t _batch_size;
+
+  /// Used to create unique names for objects in trash.
+  std::atomic<size_t> _counter;
+
+  /// True while a batch is queued.
+  bool _emptying;
+
+  /// True if empty() was invoked while a batch was queued, at which point we start over, once we run out of things to remove.
+  bool _again;
+
+  /// True once trash bin has been stopped.
+  bool _stopped;
+
+  /// The object in trash we're currently removing, and where we are in it.
+  boost::filesystem::path _current;
+  boost::filesystem::recursive_directory_iterator _iterator;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_TRASH_BIN_HPP
@@ -19,6 +19,7 @@
 #define ROSETTA_SERVER_URL_ENCODE_HPP
 
 #include <string>
+#include "http_server/include/exceptions/request_exception.hpp"
 
 using std::string;
 
@@ -27,6 +28,40 @@ namespace http_server {
 namespace uri_encode {
 
 
+/// Returns the numeric value of the given hex character.
+unsigned char from_hex (unsigned char ch);
+
+
+/// Decodes the URI encoded range [begin, end), and appends the result to the given string, which might be using any allocator.
+template<typename string_type> void decode (const char * begin, const char * end, string_type & result)
+{
+  // Iterating through entire range, looking for either '+' or '%', which is specially handled.
+  for (const char * idx = begin; idx < end; ++idx) {
+
+    // Checking if this character should have special handling.
+    if (*idx == '+') {
+
+      // '+' equals space " ".
+      result.push_back (' ');
+    } else if (*idx == '%') {
+
+      // '%' notation of character, followed by two characters. Sanity checking input first.
+      if (idx + 2 >= end)
+        throw request_exception ("Syntax error in URI encoded string, no values after '%' notation.");
+
+      // The first character is bit shifted 4 places, and OR'ed with the value of the second character.
+      // Then we make sure we skip the next 2 characters, since they're already handled.
+      result.push_back ((from_hex (idx [1]) << 4) | from_hex (idx [2]));
+      idx += 2;
+    } else {
+
+      // Normal plain character.
+      result.push_back (*idx);
+    }
+  }
+}
+
+
 /// Decodes a URI encoded string.
 string decode (const string & uri);
 
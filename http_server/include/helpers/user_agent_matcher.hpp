@@ -0,0 +1,95 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROSETTA_SERVER_USER_AGENT_MATCHER_HPP
+#define ROSETTA_SERVER_USER_AGENT_MATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+
+namespace rosetta {
+namespace http_server {
+
+
+/// Matches User-Agent headers against the whitelist and the blacklist of server, which are entries separated by "|", where a
+/// User-Agent is in a list if it contains at least one of its entries. A list of "*" contains everything, and an empty list contains
+/// nothing. Both lists are compiled into one Aho-Corasick automaton when server starts, such that a User-Agent is checked against
+/// both of them in a single pass, in time linear to its length, regardless of how many entries the lists have.
+class user_agent_matcher final : public boost::noncopyable
+{
+public:
+
+  /// Compiles the given whitelist and blacklist.
+  user_agent_matcher (const std::string & whitelist, const std::string & blacklist);
+
+  /// Returns true if the given User-Agent is in whitelist, and not in blacklist.
+  bool accepts (const char * begin, const char * end) const;
+
+private:
+
+  /// Bits identifying lists.
+  enum list_bits : uint8_t
+  {
+    WHITELIST = 1,
+    BLACKLIST = 2
+  };
+
+  /// A state of automaton, where state 0 is the root, which is the state before anything is matched.
+  struct state
+  {
+    /// Index of first transition out of state, in our transitions, which are sorted by character for each state.
+    uint32_t first;
+
+    /// Number of transitions out of state.
+    uint32_t count;
+
+    /// State to continue from when there is no transition for the next character, which is the state of the longest proper
+    /// suffix of what is matched in this state, that is also the prefix of some entry.
+    uint32_t failure;
+
+    /// Lists with an entry ending in this state, or in any of the states we fail to from it.
+    uint8_t lists;
+  };
+
+  /// Adds the entries of the given list to the trie automaton is built from.
+  void add_list (const std::string & list, list_bits bit, std::vector<std::vector<std::pair<unsigned char, uint32_t>>> & trie);
+
+  /// Returns the state we move to from the given state with character, or 0 if there is no transition for it.
+  uint32_t transition (uint32_t from, unsigned char character) const;
+
+
+  /// Lists containing every User-Agent.
+  uint8_t _everything;
+
+  /// Lists containing every User-Agent that is not empty, since they have an empty entry.
+  uint8_t _not_empty;
+
+  /// States of automaton.
+  std::vector<state> _states;
+
+  /// Transitions between states, as characters and the states they move to.
+  std::vector<std::pair<unsigned char, uint32_t>> _transitions;
+};
+
+
+} // namespace http_server
+} // namespace rosetta
+
+#endif // ROSETTA_SERVER_USER_AGENT_MATCHER_HPP
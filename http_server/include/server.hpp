@@ -22,9 +22,21 @@
 #include <map>
 #include <memory>
 #include <functional>
+#include <boost/filesystem.hpp>
 #include "common/include/configuration.hpp"
+#include "http_server/include/helpers/timer_wheel.hpp"
+#include "http_server/include/helpers/path_lock.hpp"
+#include "http_server/include/helpers/trash_bin.hpp"
+#include "http_server/include/helpers/group_commit.hpp"
+#include "http_server/include/helpers/pack_storage.hpp"
+#include "http_server/include/helpers/open_file_cache.hpp"
+#include "http_server/include/helpers/route_cache.hpp"
+#include "http_server/include/helpers/user_agent_matcher.hpp"
+#include "http_server/include/helpers/rename_journal.hpp"
+#include "http_server/include/helpers/io_worker_pool.hpp"
 #include "http_server/include/auth/authorization.hpp"
 #include "http_server/include/auth/authentication.hpp"
+#include "http_server/include/connection/error_responses.hpp"
 #include "http_server/include/connection/rosetta_socket.hpp"
 
 using namespace boost::asio;
@@ -56,6 +68,46 @@ public:
   /// Returns the io_service belonging to this instance.
   io_service & service () { return _service; }
 
+  /// Returns the timer wheel, owning all timeouts in server.
+  timer_wheel & timeouts () { return _timeouts; }
+
+  /// Returns the thread pool used for blocking file system operations.
+  io_worker_pool & disk_io () { return _disk_io; }
+
+  /// Returns the group commit stage, making uploads durable in batches.
+  class group_commit & group_commit () { return _group_commit; }
+
+  /// Returns the locks serializing appends to the same file.
+  path_lock & append_locks () { return _append_locks; }
+
+  /// Returns the trash bin, removing deleted folders in the background.
+  trash_bin & trash () { return _trash; }
+
+  /// Returns the journal renaming many files into place as a single unit.
+  rename_journal & journal () { return _journal; }
+
+  /// Returns the packs, which files are served from before the file system is consulted.
+  const pack_storage & packs () const { return _packs; }
+
+  /// Returns the cache of open files, and their metadata, for files that are served from the file system.
+  open_file_cache & open_files () { return _open_files; }
+
+  /// Returns the cache of how requests for files were routed.
+  route_cache & routes () { return _routes; }
+
+  /// Returns the matcher for the User-Agent whitelist and blacklist.
+  const user_agent_matcher & user_agents () const { return _user_agents; }
+
+  /// Returns true if server is configured with a certificate and private key that exists, such that requests can be upgraded to SSL.
+  bool has_certificate () const { return _has_certificate; }
+
+  /// Returns the error responses, rendered from the error pages when server started.
+  const class error_responses & error_responses () const { return _error_responses; }
+
+  /// Returns the folder of the content-addressed store, where deduplicated uploads keep their content, which is outside of www-root,
+  /// such that it can never be served, but must be on the same file system, since files are hard linked from it.
+  boost::filesystem::path blob_store () const { return _configuration.get<boost::filesystem::path> ("blob-store", "blobs"); }
+
   /// Removes the specified connection.
   void remove_connection (connection_ptr connection);
 
@@ -87,13 +139,65 @@ private:
   /// Callback for accepting new HTTPS connections.
   void on_accept_ssl();
 
+  /// Schedules the next sweep for stale partial uploads.
+  void schedule_upload_sweep ();
+
+  /// Removes partial uploads that nobody has written to for a while, since their clients are probably never going to resume them,
+  /// and blobs in the content-addressed store that are no longer linked into www-root.
+  void collect_stale_uploads ();
+
+  /// Schedules the next report of disc I/O worker pool metrics, if server is configured to report them.
+  void schedule_disk_io_report ();
+
 
   /// Only io service object in application.
   io_service _service;
 
+  /// Timer wheel for connection timeouts, SSL handshake timeouts, and content read timeouts.
+  timer_wheel _timeouts;
+
   /// Configuration for server.
   const class configuration _configuration;
 
+  /// Thread pool for blocking file system operations.
+  io_worker_pool _disk_io;
+
+  /// Group commit stage for uploads.
+  class group_commit _group_commit;
+
+  /// Locks serializing appends to the same file.
+  path_lock _append_locks;
+
+  /// Trash bin for deleted folders.
+  trash_bin _trash;
+
+  /// Journal for renaming many files into place as a single unit.
+  rename_journal _journal;
+
+  /// Read-only packs of files.
+  pack_storage _packs;
+
+  /// Cache of open files.
+  open_file_cache _open_files;
+
+  /// Cache of routes.
+  route_cache _routes;
+
+  /// User-Agent whitelist and blacklist, compiled when server starts.
+  const user_agent_matcher _user_agents;
+
+  /// True if certificate and private key exists, which we only check once, since they are only loaded when server starts.
+  const bool _has_certificate;
+
+  /// Pre-rendered error responses.
+  class error_responses _error_responses;
+
+  /// Timeout kicking in when it is time to sweep for stale partial uploads.
+  timer_wheel::timeout _upload_sweep;
+
+  /// Timeout kicking in when it is time to report disc I/O worker pool metrics.
+  timer_wheel::timeout _disk_io_report;
+
   /// The signal_set is used to register for process termination notifications.
   signal_set _signals;
 
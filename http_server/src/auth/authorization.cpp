@@ -185,6 +185,34 @@ bool authorization::authorize_implementation (const authentication::ticket & tic
 }
 
 
+bool authorization::authorize_tree (const authentication::ticket & ticket, class path folder, const string & verb) const
+{
+  // Checking folder itself first.
+  if (!authorize (ticket, folder, verb))
+    return false;
+
+  // Then checking all folders below it with explicit access rights, which are sorted right after folder's path with a trailing "/".
+  const string prefix = folder.string () + "/";
+  for (auto idx = _access.lower_bound (prefix); idx != _access.end () && idx->first.compare (0, prefix.size (), prefix) == 0; ++idx) {
+    if (!authorize (ticket, idx->first, verb))
+      return false;
+  }
+  return true;
+}
+
+
+void authorization::forget (class path folder)
+{
+  // Removing access rights of folder itself, and all folders below it.
+  ++_generation;
+  _access.erase (folder.string ());
+  const string prefix = folder.string () + "/";
+  auto idx = _access.lower_bound (prefix);
+  while (idx != _access.end () && idx->first.compare (0, prefix.size (), prefix) == 0)
+    idx = _access.erase (idx);
+}
+
+
 void authorization::update (class path path, const string & verb, const string & new_value)
 {
   // Sanity checking new value for verb.
@@ -198,6 +226,7 @@ void authorization::update (class path path, const string & verb, const string &
     throw security_exception ("Illegal verb."); // Notice, POST cannot have its access rights changed.
 
   // Doing actual update, first erasing old value for verb.
+  ++_generation;
   verb_roles & roles_for_verb = _access [path.string()];
   auto existing_iter = roles_for_verb.find (verb);
   if (existing_iter != roles_for_verb.end())
@@ -35,7 +35,6 @@ connection_ptr connection::create (class server * server, socket_ptr socket)
 connection::connection (class server * server, socket_ptr socket)
   : _server (server),
     _socket (socket),
-    _timer (server->service()),
     _client_address (socket->remote_endpoint().address())
 { }
 
@@ -45,9 +44,18 @@ void connection::handle()
   // Setting deadline timer to "keep-alive" value.
   set_deadline_timer (_server->configuration().get<size_t> ("connection-keep-alive-timeout", 20));
 
-  // Creating a new request, and handling it on the current connection.
-  _request = request();
-  _request.handle (shared_from_this());
+  // Waiting with reading the next request until disc I/O pool has room for more work, to apply back pressure when disc is slow.
+  auto self = shared_from_this();
+  _server->disk_io().when_ready ([self] () {
+
+    // Connection might have timed out, or server might have been stopped, while we waited.
+    if (!self->_socket->is_open())
+      return;
+
+    // Resetting request, which reuses the memory of our previous request, and handling it on the current connection.
+    self->_request.reset ();
+    self->_request.handle (self);
+  });
 }
 
 
@@ -56,21 +64,13 @@ void connection::set_deadline_timer (int seconds)
   // Checking if caller only wants to destroy the current deadline timer, without creating a new.
   if (seconds == -1) {
 
-    // Canceling deadline timer, and returning immediately, without creating a new one.
-    _timer.cancel();
+    // Canceling timeout, and returning immediately, without arming a new one.
+    _server->timeouts().cancel (_timeout);
   } else {
 
-    // Updating the timer's expiration, which will implicitly invoke any existing handlers, with an "operation aborted" error code.
-    _timer.expires_from_now (boost::posix_time::seconds (seconds));
-
-    // Associating a handler with deadline timer, that ensures the closing of connection if it kicks in, unless timer is aborted.
-    _timer.async_wait ([this] (auto error) {
-
-      // We don't close if the operation was aborted, since when timer is canceled, the handler will be invoked with
-      // the "aborted" error_code, and every time we change the deadline timer, or cancel() the timer,
-        // we implicitly invoke any existing handlers.
-      if (error != error::operation_aborted)
-        close ();
+    // Arming timeout, which implicitly removes any existing timeout, and ensures the closing of connection if it kicks in.
+    _server->timeouts().arm (_timeout, seconds, [this] () {
+      close ();
     });
   }
 }
@@ -78,8 +78,8 @@ void connection::set_deadline_timer (int seconds)
 
 void connection::close()
 {
-  // Killing deadline timer, removing connection, and closing socket..
-  _timer.cancel ();
+  // Killing timeout, removing connection, and closing socket..
+  _server->timeouts().cancel (_timeout);
 
   // Removing connection from server, which means that as async handlers are invoked, with an error, due to socket being closed,
   // all shared_ptrs will be destroyed, until there are no more of them left.
@@ -17,9 +17,11 @@
 
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include "http_server/include/server.hpp"
 #include "http_server/include/helpers/uri_encode.hpp"
+#include "http_server/include/helpers/multipart_extractor.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
 #include "http_server/include/exceptions/request_exception.hpp"
@@ -30,9 +32,14 @@
 #include "http_server/include/connection/handlers/request_file_handler.hpp"
 #include "http_server/include/connection/handlers/get_file_handler.hpp"
 #include "http_server/include/connection/handlers/get_folder_handler.hpp"
+#include "http_server/include/connection/handlers/get_multi_handler.hpp"
+#include "http_server/include/connection/handlers/get_pack_handler.hpp"
 #include "http_server/include/connection/handlers/put_file_handler.hpp"
 #include "http_server/include/connection/handlers/put_folder_handler.hpp"
+#include "http_server/include/connection/handlers/put_archive_handler.hpp"
 #include "http_server/include/connection/handlers/delete_handler.hpp"
+#include "http_server/include/connection/handlers/copy_handler.hpp"
+#include "http_server/include/connection/handlers/move_handler.hpp"
 #include "http_server/include/connection/handlers/post_users_handler.hpp"
 #include "http_server/include/connection/handlers/post_authorization_handler.hpp"
 
@@ -52,53 +59,21 @@ using namespace boost::asio;
 using namespace boost::filesystem;
 using namespace rosetta::common;
 
+/// Returns true if the given range only contains non-control US ASCII characters.
+bool is_printable (const char * begin, const char * end);
 
-bool in_user_agent_list (connection_ptr connection, const class request * request, const string & list)
-{
-  // Making things more tidy in here.
-  using namespace std;
-  using namespace boost::algorithm;
-
-  // Retrieve the specified list from our configuration file.
-  const string configuration_list = connection->server()->configuration().get <string> ("user-agent-" + list, "*");
-  if (configuration_list == "*") {
-
-    // List matches everything.
-    return true;
-  } else if (configuration_list == "") {
-
-    // List matches nothing.
-    return false;
-  } else {
-
-    // Retrieving User-Agent header from request envelope.
-    const string & user_agent = request->envelope().header ("User-Agent");
-    if (user_agent.size() == 0)
-      return false;
-
-    // Checking if User-Agent string from client's request contains at least one of our list entries.
-    vector<string> list_entries;
-    split (list_entries, configuration_list, boost::is_any_of ("|"));
-    for (const auto & idx : list_entries) {
-      if (user_agent.find (idx) != string::npos)
-        return true; // Match in User-Agent for currently iterated list entity.
-    }
-
-    // Did not find a match in User-Agent.
-    return false;
-  }
-}
+/// Makes sure URI is "sane", and does not contain "/../", etc.
+bool sanity_check_path (path uri);
 
+/// Returns true if any of the folders or files in URI are hidden.
+bool is_hidden (const path & uri);
 
-bool in_user_agent_whitelist (connection_ptr connection, const class request * request)
-{
-  return in_user_agent_list (connection, request, "whitelist");
-}
 
-
-bool in_user_agent_blacklist (connection_ptr connection, const class request * request)
+bool accepts_user_agent (connection_ptr connection, const class request * request)
 {
-  return in_user_agent_list (connection, request, "blacklist");
+  // Checking User-Agent against whitelist and blacklist at once, with the matcher server compiled from them when it started.
+  const arena_string & user_agent = request->envelope().header ("User-Agent");
+  return connection->server()->user_agents().accepts (user_agent.data(), user_agent.data() + user_agent.size());
 }
 
 
@@ -113,20 +88,9 @@ bool should_upgrade_insecure_requests (connection_ptr connection, const class re
       // Checking if client prefers SSL sockets.
       if (request->envelope().header ("Upgrade-Insecure-Requests") == "1") {
 
-        // Checking if server is configured with key/certificate, and that certificate/private-key exists.
-        const string & certificate = connection->server()->configuration().get<string> ("ssl-certificate", "server.crt");
-        const string & key = connection->server()->configuration().get<string> ("ssl-private-key", "server.key");
-
-        // Checking if neither of the above values are empty.
-        if (certificate.size() > 0 && key.size() > 0) {
-
-          // Checking if certificate file and key file actually exists on disc.
-          if (exists (certificate) && exists (key)) {
-
-            // We can safely upgrade the current request!
-            return true;
-          }
-        }
+        // Checking if server is configured with key/certificate, and that certificate/private-key exists, which server checked when it started.
+        if (connection->server()->has_certificate())
+          return true; // We can safely upgrade the current request!
       }
     }
   }
@@ -155,10 +119,10 @@ request_handler_ptr upgrade_insecure_request (connection_ptr connection, class r
     } else {
       new_uri += "&";
     }
-    new_uri += uri_encode::encode (std::get<0> (idx));
-    auto val = std::get<1> (idx);
+    new_uri += uri_encode::encode (std::get<0> (idx).c_str());
+    auto & val = std::get<1> (idx);
     if (val.size() > 0)
-      new_uri += "=" + uri_encode::encode (val);
+      new_uri += "=" + uri_encode::encode (val.c_str());
   }
 
   // Returning Redirect Temporarily, with a "no-store" value for the "Cache-Control" header.
@@ -166,11 +130,9 @@ request_handler_ptr upgrade_insecure_request (connection_ptr connection, class r
 }
 
 
-bool authorize_request (connection_ptr connection, request * request)
+bool authorize_path (connection_ptr connection, request * request, const path & path, const string & method)
 {
   auto ticket = request->envelope().ticket();
-  auto path = request->envelope().path();
-  auto method = request->envelope().method();
 
   if (method == "PUT") {
 
@@ -201,6 +163,12 @@ bool authorize_request (connection_ptr connection, request * request)
 }
 
 
+bool authorize_request (connection_ptr connection, request * request)
+{
+  return authorize_path (connection, request, request->envelope().path(), request->envelope().method().c_str());
+}
+
+
 request_handler_ptr create_authorize_handler (connection_ptr connection, class request * request)
 {
   return request_handler_ptr (new unauthorized_handler (request, !request->envelope().ticket().authenticated()));
@@ -279,51 +247,179 @@ request_handler_ptr create_options_handler (connection_ptr connection, class req
 }
 
 
+bool find_packed_file (connection_ptr connection, class request * request, pack_file::entry & entry)
+{
+  // Files are packed with their URIs as names, which is their path relative to www-root.
+  if (connection->server()->packs().empty())
+    return false;
+  const string root = connection->server()->configuration().get<string> ("www-root", "www-root");
+  const string full = request->envelope().path().string ();
+  return full.size () > root.size () && connection->server()->packs().find (full.substr (root.size ()), entry);
+}
+
+
+route_cache::route resolve_file_route (connection_ptr connection, class request * request)
+{
+  route_cache::route result;
+
+  // Authorizing request.
+  if (!authorize_request (connection, request)) {
+    result.kind = route_cache::route::unauthorized;
+    return result;
+  }
+
+  // Figuring out handler to use according to request extension, and if document type is served/handled, which is the same for
+  // packed files, and files in the file system.
+  const string extension = request->envelope().path().extension().string ();
+  if (connection->server()->configuration().get<string> ("handler" + extension, "error") != "get-file-handler") {
+    result.kind = route_cache::route::not_served;
+    return result;
+  }
+
+  // Checking if file is in one of our packs, since then we need neither stat nor open it.
+  if (find_packed_file (connection, request, result.entry)) {
+    result.kind = route_cache::route::packed;
+    return result;
+  }
+
+  // File is served from the file system.
+  result.kind = route_cache::route::file;
+  result.mime = connection->server()->configuration().get<string> ("mime" + extension, "");
+  return result;
+}
+
+
 request_handler_ptr create_get_file_handler (connection_ptr connection, class request * request)
 {
-  // Figuring out handler to use according to request extension, and if document type is served/handled.
-  string extension = request->envelope().path().extension().string ();
-  string handler   = connection->server()->configuration().get<string> ("handler" + extension, "error");
+  // Looking up how file was routed the last time a client with the same role requested it, and figuring it out if it is not cached.
+  auto & routes = connection->server()->routes();
+  const size_t generation = connection->server()->authorization().generation();
+  const string key = string (request->envelope().method().c_str()) + "\n" + request->envelope().ticket().role + "\n" + request->envelope().path().string ();
+  route_cache::route route;
+  if (!routes.find (key, generation, route)) {
+    route = resolve_file_route (connection, request);
+    routes.insert (key, generation, route);
+  }
 
   // Returning the correct handler to caller.
-  if (handler == "get-file-handler") {
+  switch (route.kind) {
+  case route_cache::route::unauthorized:
 
-    // Static file GET handler.
-    return request_handler_ptr (new get_file_handler (request));
-  } else {
+    // Not authorized.
+    return create_authorize_handler (connection, request);
+  case route_cache::route::not_served:
 
     // Oops, these types of files are not served or handled.
     return request_handler_ptr (new error_handler (request, 404));
+  case route_cache::route::packed:
+
+    // Packed file GET handler.
+    return request_handler_ptr (new get_pack_handler (request, route.entry));
+  default:
+    break;
+  }
+
+  // Looking up file in the open file cache, which gives us the file, and everything we need to know about it, without any
+  // system calls, if it was recently served.
+  // Files we recently found to not exist are remembered too, such that requests for them costs no system calls either.
+  bool missing = false;
+  open_file_cache::file_ptr file;
+  if (!connection->server()->open_files().find (request->envelope().path(), file, missing) || file) {
+
+    // Static file GET handler, which opens file on disc I/O thread, if cache does not know about it.
+    return request_handler_ptr (new get_file_handler (request, file, route.mime));
+  } else {
+
+    // No such file.
+    return request_handler_ptr (new error_handler (request, 404));
   }
 }
 
 
 request_handler_ptr create_get_handler (connection_ptr connection, class request * request)
 {
+  // Requests for files are routed through our route cache.
+  if (request->envelope().file_request())
+    return create_get_file_handler (connection, request);
+
   // Authorizing request.
   if (authorize_request (connection, request)) {
 
-    // Checking that path actually exists.
-    if (!exists (request->envelope().path())) {
+    // Checking that folder actually exists.
+    if (!is_directory (request->envelope().path())) {
 
-      // No such path.
+      // No such folder, or user tries to GET a file as a folder.
       return request_handler_ptr (new error_handler (request, 404));
-    } else {
+    }
 
-      // Figuring out if user requested a file or a folder.
-      if (is_regular_file (request->envelope().path()) && request->envelope().file_request()) {
+    // Checking if this is a request for many files in folder at once, making sure client does not ask for too many files.
+    if (request->envelope().has_parameter ("multi")) {
+      const arena_string & list = request->envelope().parameter ("multi");
+      const size_t max_files = connection->server()->configuration().get<size_t> ("max-multi-files", 64);
+      if (static_cast<size_t> (std::count (list.begin (), list.end (), ',')) >= max_files)
+        return request_handler_ptr (new error_handler (request, 414));
+      return request_handler_ptr (new get_multi_handler (request));
+    }
 
-        // Returning the correct file handler according to configuration
-        return create_get_file_handler (connection, request);
-      } else if (is_directory (request->envelope().path()) && request->envelope().folder_request()) {
+    // This is a request for a folder's content, either as JSON, or as an archive, in which case we must support the requested format.
+    const arena_string & format = request->envelope().parameter ("archive");
+    if (request->envelope().has_parameter ("archive") && format != "tar" && format != "zip")
+      return request_handler_ptr (new error_handler (request, 501));
+    return request_handler_ptr (new get_folder_handler (request));
+  } else {
 
-        // This is a request for a folder's content.
-        return request_handler_ptr (new get_folder_handler (request));
-      } else {
+    // Not authorized.
+    return create_authorize_handler (connection, request);
+  }
+}
 
-        // User tries to GET something that's neither a folder, nor a file, or a file/folder, as something it is not.
-        return request_handler_ptr (new error_handler (request, 404));
-      }
+
+unsigned int refuse_content (connection_ptr connection, const class request * request, const char * key, size_t default_max)
+{
+  // Checking if client declared a Content-Length we cannot make sense of, or that is larger than what we accept, which we can only
+  // know up front if content is not chunked.
+  const arena_string & content_length = request->envelope().header ("Content-Length");
+  if (content_length.size() == 0)
+    return 0;
+  size_t length = 0;
+  if (content_length.find_first_not_of ("0123456789") != arena_string::npos ||
+      !boost::conversion::try_lexical_convert (content_length.c_str(), length))
+    return 400;
+  const size_t max_content_length = connection->server()->configuration().get<size_t> (key, default_max);
+  return length > max_content_length ? 413 : 0;
+}
+
+
+request_handler_ptr create_put_archive_handler (connection_ptr connection, class request * request)
+{
+  // Client needs to be allowed to PUT to folder, in addition to every file in archive, which is authorized as archive is extracted.
+  if (connection->server()->authorization().authorize (request->envelope().ticket(), request->envelope().path(), "PUT")) {
+
+    // Checking that folder actually exists.
+    if (!request->envelope().folder_request() || !is_directory (request->envelope().path())) {
+
+      // No such folder.
+      return request_handler_ptr (new error_handler (request, 404));
+    } else if (const unsigned int status_code = refuse_content (connection, request, "max-extract-content-length", 104857600)) {
+
+      // Refusing content up front, such that client does not send it, if it asked us with "Expect: 100-continue".
+      return request_handler_ptr (new error_handler (request, status_code));
+    } else if (request->envelope().header ("Transfer-Encoding").size() != 0 ||
+               request->envelope().header ("Content-Length").find_first_not_of ("0") == arena_string::npos) {
+
+      // Archives are extracted as they are read, which requires us to know their size up front, such that chunked content is refused.
+      return request_handler_ptr (new error_handler (request, 411));
+    } else if (request->envelope().has_parameter ("multi")) {
+
+      // Many files at once, as a "multipart/mixed" request, which needs a boundary.
+      const string boundary = multipart_extractor::boundary (request->envelope().header ("Content-Type").c_str());
+      if (boundary.empty ())
+        return request_handler_ptr (new error_handler (request, 415));
+      return request_handler_ptr (new put_archive_handler (request, boundary));
+    } else {
+
+      // Extracting archive into folder.
+      return request_handler_ptr (new put_archive_handler (request, ""));
     }
   } else {
 
@@ -335,6 +431,10 @@ request_handler_ptr create_get_handler (connection_ptr connection, class request
 
 request_handler_ptr create_put_handler (connection_ptr connection, class request * request)
 {
+  // Checking if client wants to extract an archive into a folder, or PUT many files into it at once.
+  if (request->envelope().has_parameter ("extract") || request->envelope().has_parameter ("multi"))
+    return create_put_archive_handler (connection, request);
+
   // Authorizing request.
   if (authorize_request (connection, request)) {
 
@@ -343,6 +443,10 @@ request_handler_ptr create_put_handler (connection_ptr connection, class request
 
       // Client tries to PUT something to a location that does not exist.
       return request_handler_ptr (new error_handler (request, 404));
+    } else if (const unsigned int status_code = refuse_content (connection, request, "max-request-content-length", 4194304)) {
+
+      // Refusing content up front, such that client does not send it, if it asked us with "Expect: 100-continue".
+      return request_handler_ptr (new error_handler (request, status_code));
     } else {
 
       // Figuring out if client wants to PUT a file or a folder.
@@ -364,6 +468,33 @@ request_handler_ptr create_put_handler (connection_ptr connection, class request
 }
 
 
+request_handler_ptr create_append_handler (connection_ptr connection, class request * request)
+{
+  // Appending to a file requires the same rights as a PUT to it, since it changes the file.
+  if (authorize_path (connection, request, request->envelope().path(), "PUT")) {
+
+    // Checking that parent folder of file actually exists, and that client does not try to append to a folder.
+    if (!exists (request->envelope().path().parent_path()) || !request->envelope().file_request()) {
+
+      // No such file.
+      return request_handler_ptr (new error_handler (request, 404));
+    } else if (const unsigned int status_code = refuse_content (connection, request, "max-request-content-length", 4194304)) {
+
+      // Refusing content up front, such that client does not send it, if it asked us with "Expect: 100-continue".
+      return request_handler_ptr (new error_handler (request, status_code));
+    } else {
+
+      // The PUT file handler knows how to append to files.
+      return request_handler_ptr (new put_file_handler (request));
+    }
+  } else {
+
+    // Not authorized.
+    return create_authorize_handler (connection, request);
+  }
+}
+
+
 request_handler_ptr create_delete_handler (connection_ptr connection, class request * request)
 {
   // Checking if client is authorized to use the DELETE verb towards path.
@@ -374,6 +505,12 @@ request_handler_ptr create_delete_handler (connection_ptr connection, class requ
     
       // No such path.
       return request_handler_ptr (new error_handler (request, 404));
+    } else if (request->envelope().uri() == "/" ||
+               (request->envelope().has_parameter ("recursive") &&
+                !connection->server()->authorization().authorize_tree (request->envelope().ticket(), request->envelope().path(), "DELETE"))) {
+
+      // Client tries to delete the root folder, or is not allowed to delete all folders inside of folder.
+      return request_handler_ptr (new error_handler (request, 403));
     } else {
     
       // User tries to DELETE a file or a folder.
@@ -387,6 +524,102 @@ request_handler_ptr create_delete_handler (connection_ptr connection, class requ
 }
 
 
+path destination_path (connection_ptr connection, const class request * request)
+{
+  // Destination is either an absolute URI, or an absolute path, and we only care about its path, without any parameters.
+  string destination = request->envelope().header ("Destination").c_str();
+  const size_t scheme = destination.find ("://");
+  if (scheme != string::npos) {
+    const size_t path_start = destination.find ('/', scheme + 3);
+    destination = path_start == string::npos ? "" : destination.substr (path_start);
+  }
+  destination = destination.substr (0, destination.find ('?'));
+  if (destination.empty () || destination [0] != '/')
+    return path ();
+
+  // Decoding path, and removing trailing slashes, since we figure out if this is a file or a folder from the source.
+  string uri;
+  uri_encode::decode (destination.data (), destination.data () + destination.size (), uri);
+  while (uri.size () > 1 && uri.back () == '/')
+    uri.pop_back ();
+  if (uri == "/" || !is_printable (uri.data (), uri.data () + uri.size ()))
+    return path ();
+
+  // Making sure path is sane, the same way we do with the path of the request itself.
+  path result = connection->server()->configuration().get<string> ("www-root", "www-root") + uri;
+  if (!sanity_check_path (result))
+    return path ();
+  return result;
+}
+
+
+bool is_hidden (const path & uri)
+{
+  // Checking if any of the folders or files in path are hidden, such as ".users", ".auth", or the content-addressed store.
+  // Notice, we check the string, since iterating a path yields "." for a trailing slash, which is simply a folder request.
+  const string & value = uri.string ();
+  return value.find ("/.") != string::npos || (!value.empty () && value [0] == '.');
+}
+
+
+request_handler_ptr create_transfer_handler (connection_ptr connection, class request * request, bool move)
+{
+  // Figuring out where to copy or move to.
+  const path source = request->envelope().path();
+  const path destination = destination_path (connection, request);
+  if (destination.empty ()) {
+
+    // Missing or malformed "Destination" header.
+    return request_handler_ptr (new error_handler (request, 400));
+  }
+
+  // Client must be allowed to GET source, and DELETE it too if it is moved, and PUT destination, exactly as if client had done so itself.
+  // Notice, an existing folder can never be PUT, but it might be replaced if it is empty, which requires DELETE and PUT rights on it.
+  const bool replaces_folder = is_directory (destination);
+  if (!authorize_path (connection, request, source, "GET") ||
+      (move && !authorize_path (connection, request, source, "DELETE")) ||
+      (replaces_folder && !authorize_path (connection, request, destination, "DELETE")) ||
+      (replaces_folder && !connection->server()->authorization().authorize (request->envelope().ticket(), destination, "PUT")) ||
+      (!replaces_folder && !authorize_path (connection, request, destination, "PUT"))) {
+
+    // Not authorized.
+    return create_authorize_handler (connection, request);
+  }
+
+  // Making sure hidden files, such as ".users" and ".auth", can never be copied or moved, neither from nor to.
+  const string www_root = connection->server()->configuration().get<string> ("www-root", "www-root");
+  if (is_hidden (request->envelope().uri()) || is_hidden (destination.string ().substr (www_root.size ()))) {
+
+    // Forbidden.
+    return request_handler_ptr (new error_handler (request, 403));
+  }
+
+  // Checking that source exists, and that parent folder of destination exists.
+  if (!exists (source) || !exists (destination.parent_path())) {
+
+    // No such path.
+    return request_handler_ptr (new error_handler (request, 404));
+  }
+
+  // Making sure we never copy or move anything into itself.
+  const string source_str = source.string () + "/";
+  if (destination == source || destination.string ().compare (0, source_str.size (), source_str) == 0) {
+
+    // Forbidden.
+    return request_handler_ptr (new error_handler (request, 403));
+  }
+
+  // Checking if client allows us to replace an existing destination, which is the default, unless it passes in "Overwrite: F".
+  const bool overwrite = request->envelope().header ("Overwrite") != "F";
+
+  // Returning the correct handler.
+  if (move)
+    return request_handler_ptr (new move_handler (request, destination, overwrite));
+  else
+    return request_handler_ptr (new copy_handler (request, destination, overwrite));
+}
+
+
 request_handler_ptr create_post_users_handler (connection_ptr connection, class request * request)
 {
   // No need to authorize these types of request, since all authenticated clients are allowed to post to the ".users" file, though
@@ -472,6 +705,18 @@ request_handler_ptr create_verb_handler (connection_ptr connection, class reques
 
     // Returning a DELETE file/folder handler.
     return create_delete_handler (connection, request);
+  } else if (request->envelope().method() == "COPY") {
+
+    // Returning a COPY file/folder handler.
+    return create_transfer_handler (connection, request, false);
+  } else if (request->envelope().method() == "MOVE") {
+
+    // Returning a MOVE file/folder handler.
+    return create_transfer_handler (connection, request, true);
+  } else if ((request->envelope().method() == "POST" || request->envelope().method() == "PATCH") && request->envelope().has_parameter ("append")) {
+
+    // Returning an append to file handler.
+    return create_append_handler (connection, request);
   } else if (request->envelope().method() == "POST") {
 
     // Returning the correct POST data handler.
@@ -487,7 +732,7 @@ request_handler_ptr create_verb_handler (connection_ptr connection, class reques
 request_handler_ptr create_request_handler (connection_ptr connection, class request * request, int status_code)
 {
   // Checking if we can accept User-Agent according whitelist and blacklist definitions.
-  if (!in_user_agent_whitelist (connection, request) || in_user_agent_blacklist (connection, request)) {
+  if (!accepts_user_agent (connection, request)) {
 
     // User-Agent not accepted!
     return request_handler_ptr (new error_handler (request, 403));
@@ -514,6 +759,14 @@ request_handler_ptr create_request_handler (connection_ptr connection, class req
     return create_authorize_handler (connection, request);
   }
 
+  // Making sure hidden files and folders, such as ".users" and ".auth" files, can never be reached, except through the POST requests
+  // changing users and access rights, which only accepts those two files.
+  if (is_hidden (request->envelope().uri()) && (request->envelope().method() != "POST" || request->envelope().has_parameter ("append"))) {
+
+    // Forbidden.
+    return request_handler_ptr (new error_handler (request, 403));
+  }
+
   // Letting our verb parser take care of this.
   return create_verb_handler (connection, request);
 }
@@ -0,0 +1,77 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <iterator>
+#include <boost/lexical_cast.hpp>
+#include "http_server/include/helpers/date.hpp"
+#include "http_server/include/connection/error_responses.hpp"
+#include "http_server/include/connection/handlers/request_handler_base.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+using namespace rosetta::common;
+
+
+error_responses::error_responses (const configuration & configuration, const path & folder)
+{
+  // Rendering a response for every error page we have, skipping files that are not named by a status code.
+  boost::system::error_code ec;
+  for (directory_iterator iter (folder, ec), end; !ec && iter != end; iter.increment (ec)) {
+
+    unsigned int status_code = 0;
+    if (iter->path ().extension () != ".html" ||
+        !boost::conversion::try_lexical_convert (iter->path ().stem ().string (), status_code) ||
+        status_code < 400 || status_code > 599)
+      continue;
+    std::ifstream file (iter->path ().string (), std::ios::binary);
+    const string page ((std::istreambuf_iterator<char> (file)), std::istreambuf_iterator<char> ());
+
+    // Rendering everything but the value of the "Date" header, which changes every second.
+    response & result = _responses [status_code];
+    result.head = request_handler_base::status_line (status_code) +
+                  "Content-Type: " + configuration.get<string> ("mime.html", "text/html; charset=utf-8") + "\r\n" +
+                  "Content-Length: " + boost::lexical_cast<string> (page.size ()) + "\r\n" +
+                  request_handler_base::standard_headers (configuration) +
+                  "Date: ";
+    result.tail = "\r\n\r\n" + page;
+  }
+}
+
+
+bool error_responses::render (unsigned int status_code, bool close_connection, string & response) const
+{
+  auto iter = _responses.find (status_code);
+  if (iter == _responses.end ())
+    return false;
+  const string now = date::now_string ();
+  static const string CLOSE_HEADER = "\r\nConnection: close";
+  response.reserve (iter->second.head.size () + now.size () + CLOSE_HEADER.size () + iter->second.tail.size ());
+  response.append (iter->second.head).append (now);
+  if (close_connection)
+    response.append (CLOSE_HEADER);
+  response.append (iter->second.tail);
+  return true;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
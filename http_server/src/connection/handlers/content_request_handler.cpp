@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/algorithm/string.hpp>
 #include "http_server/include/server.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/exceptions/request_exception.hpp"
@@ -35,10 +36,10 @@ content_request_handler::content_request_handler (class request * request)
 size_t content_request_handler::get_content_length (connection_ptr connection)
 {
   // Max allowed length of content.
-  const size_t MAX_REQUEST_CONTENT_LENGTH = connection->server()->configuration().get<size_t> ("max-request-content-length", 4194304);
+  const size_t MAX_REQUEST_CONTENT_LENGTH = get_max_content_length (connection);
 
   // Checking if there is any content first.
-  string content_length_str = request()->envelope().header ("Content-Length");
+  string content_length_str = request()->envelope().header ("Content-Length").c_str();
 
   // Checking if there is any Content-Length
   if (content_length_str.size() == 0) {
@@ -58,5 +59,21 @@ size_t content_request_handler::get_content_length (connection_ptr connection)
 }
 
 
+size_t content_request_handler::get_max_content_length (connection_ptr connection)
+{
+  return connection->server()->configuration().get<size_t> ("max-request-content-length", 4194304);
+}
+
+
+bool content_request_handler::has_chunked_content ()
+{
+  // Checking if the last encoding applied to content is "chunked", which is the only transfer coding we support.
+  string transfer_encoding = request()->envelope().header ("Transfer-Encoding").c_str();
+  boost::algorithm::to_lower (transfer_encoding);
+  boost::algorithm::trim (transfer_encoding);
+  return boost::algorithm::ends_with (transfer_encoding, "chunked");
+}
+
+
 } // namespace http_server
 } // namespace rosetta
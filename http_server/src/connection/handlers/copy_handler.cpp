@@ -0,0 +1,171 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/server.hpp"
+#include "http_server/include/helpers/file_copy.hpp"
+#include "http_server/include/connection/request.hpp"
+#include "http_server/include/connection/connection.hpp"
+#include "http_server/include/connection/handlers/copy_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace rosetta::common;
+
+
+// Returns a hidden temporary path next to destination, which is unique for every copy, such that concurrent copies never share it.
+// Notice, the name ends with its own suffix, such that it never collides with the temporary files of other requests.
+static path temporary_path (const path & destination)
+{
+  static std::atomic<size_t> counter (0);
+  const auto now = std::chrono::system_clock::now ().time_since_epoch ();
+  const string unique = std::to_string (std::chrono::duration_cast<std::chrono::microseconds> (now).count ()) + "-" + std::to_string (counter++);
+  return destination.parent_path () / ("." + destination.filename ().string () + "." + unique + ".copy.partial");
+}
+
+
+copy_handler::copy_handler (class request * request, const path & destination, bool overwrite)
+  : request_handler_base (request),
+    _destination (destination),
+    _overwrite (overwrite)
+{ }
+
+
+void copy_handler::handle (connection_ptr connection, std::function<void()> on_success)
+{
+  // Checking if client wants to copy a file or a folder.
+  if (boost::filesystem::is_directory (request()->envelope().path()))
+    copy_folder (connection, on_success);
+  else
+    copy_file (connection, on_success);
+}
+
+
+void copy_handler::copy_file (connection_ptr connection, std::function<void()> on_success)
+{
+  // Copying to a temporary file first, such that an existing destination is atomically replaced once copy is complete.
+  const path source = request()->envelope().path();
+  const path destination = _destination;
+  const path temporary = temporary_path (destination);
+
+  // Making sure connection is closed, if copying file throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Copying file on disc I/O thread, unless destination cannot be replaced.
+  const bool overwrite = _overwrite;
+  auto status_ptr = std::make_shared<unsigned int> (0);
+  connection->server()->disk_io().post ([source, destination, temporary, overwrite, status_ptr] () {
+
+    *status_ptr = file_copy::check_destination (source, destination, overwrite);
+    if (*status_ptr == 0) {
+      file_copy::copy (source, temporary);
+      boost::filesystem::rename (temporary, destination);
+    }
+
+  }, [this, connection, status_ptr, x, on_success] () {
+
+    // Releasing exception helper, and returning result to client.
+    // Notice, writing an error response destroys "this", hence we return immediately.
+    x.release ();
+    if (*status_ptr != 0)
+      request()->write_error_response (connection, *status_ptr);
+    else
+      write_success_envelope (connection, on_success);
+  });
+}
+
+
+void copy_handler::copy_folder (connection_ptr connection, std::function<void()> on_success)
+{
+  const path source = request()->envelope().path();
+  const path destination = _destination;
+
+  // Making sure connection is closed, if checking folder throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Checking if any of the folders we copy have their own access rights, on disc I/O thread, since we have to traverse all folders.
+  // If they do, we refuse to copy them, since the copy would get the access rights of its destination instead.
+  // Destination is checked before we answer too, since client is never told if the copy fails once we have accepted it.
+  const bool overwrite = _overwrite;
+  auto status_ptr = std::make_shared<unsigned int> (0);
+  connection->server()->disk_io().post ([source, destination, overwrite, status_ptr] () {
+
+    if (file_copy::contains_authorization_files (source))
+      *status_ptr = 403;
+    else
+      *status_ptr = file_copy::check_destination (source, destination, overwrite);
+
+  }, [this, connection, source, destination, status_ptr, x, on_success] () {
+
+    // Releasing exception helper.
+    x.release ();
+    if (*status_ptr != 0) {
+
+      // Notice, this destroys "this", hence we return immediately.
+      request()->write_error_response (connection, *status_ptr);
+      return;
+    }
+
+    // Copying folder in the background, into a temporary folder, which is renamed once all files are copied.
+    // This way, destination never appears half way copied, and a failed copy leaves nothing behind.
+    // Since client has already been answered, failures are logged, and never thrown into the network thread.
+    const path temporary = temporary_path (destination);
+    connection->server()->disk_io().post ([source, destination, temporary] () {
+
+      try {
+        file_copy::copy_folder (source, temporary);
+        boost::filesystem::rename (temporary, destination);
+      } catch (const std::exception & error) {
+        boost::system::error_code ignored;
+        boost::filesystem::remove_all (temporary, ignored);
+        std::cerr << "Couldn't copy '" << source.string () << "' to '" << destination.string () << "'; " << error.what () << std::endl;
+      }
+
+    }, [] () { });
+
+    // Telling client we have accepted its request, without waiting for the copy to finish.
+    write_accepted_envelope (connection, on_success);
+  });
+}
+
+
+void copy_handler::write_accepted_envelope (connection_ptr connection, std::function<void()> on_success)
+{
+  // Writing status code 202 (Accepted) back to client.
+  write_status (connection, 202, [this, connection, on_success] () {
+
+    // Writing standard headers back to client.
+    write_standard_headers (connection, [this, connection, on_success] () {
+
+      // Making sure client knows there is no content.
+      write_headers (connection, {{"Content-Length", "0"}}, [this, connection, on_success] () {
+
+        // Ensuring envelope is closed.
+        ensure_envelope_finished (connection, on_success);
+      });
+    });
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
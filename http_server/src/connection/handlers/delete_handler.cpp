@@ -16,6 +16,7 @@
  */
 
 #include <boost/filesystem.hpp>
+#include "common/include/exceptional_executor.hpp"
 #include "http_server/include/server.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
@@ -38,11 +39,45 @@ void delete_handler::handle (connection_ptr connection, std::function<void()> on
   // Retrieving URI from request.
   auto path = request()->envelope().path();
 
-  // Deleting file.
-  boost::filesystem::remove (path);
+  // Making sure connection is closed, if deleting file throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
 
-  // Returning success to client.
-  write_success_envelope (connection, on_success);
+  // Checking if client wants to delete a folder with all of its content.
+  if (request()->envelope().has_parameter ("recursive") && boost::filesystem::is_directory (path)) {
+
+    // Moving folder into trash on disc I/O thread, which is atomic, and leaving it to the trash bin to remove its content.
+    auto server = connection->server();
+    server->disk_io().post ([server, path] () {
+
+      server->trash().discard (path);
+
+    }, [this, connection, path, x, on_success] () {
+
+      // Folder is gone, hence so are its access rights, and its files, which inotify only tells us about for their own folders.
+      connection->server()->authorization().forget (path);
+      connection->server()->open_files().invalidate (path);
+      connection->server()->trash().empty ();
+
+      // Returning success to client.
+      x.release ();
+      write_success_envelope (connection, on_success);
+    });
+    return;
+  }
+
+  // Deleting file on disc I/O thread.
+  // If file was deduplicated, this only drops its link to the blob in the content-addressed store, and the blob is
+  // removed by the server's periodic sweep once no files link to it anymore.
+  connection->server()->disk_io().post ([path] () {
+
+    boost::filesystem::remove (path);
+
+  }, [this, connection, x, on_success] () {
+
+    // Returning success to client.
+    x.release ();
+    write_success_envelope (connection, on_success);
+  });
 }
 
 
@@ -16,8 +16,8 @@
  */
 
 #include <boost/filesystem.hpp>
+#include "common/include/exceptional_executor.hpp"
 #include "http_server/include/server.hpp"
-#include "http_server/include/helpers/date.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
 #include "http_server/include/exceptions/request_exception.hpp"
@@ -31,68 +31,91 @@ using boost::system::error_code;
 using namespace rosetta::common;
 
 
-get_file_handler::get_file_handler (class request * request)
-  : request_file_handler (request)
+get_file_handler::get_file_handler (class request * request, open_file_cache::file_ptr file, const string & mime_type)
+  : request_file_handler (request),
+    _file (file),
+    _mime_type (mime_type)
 { }
 
 
 void get_file_handler::handle (connection_ptr connection, std::function<void()> on_success)
 {
-  // Retrieving root path, and checking if we should write it.
-  path full_path = request()->envelope().path();
-  if (should_write_file (full_path)) {
-
-    // Returning file to client.
-    write_file (connection, full_path, 200, true, on_success);
-  } else {
-
-    // File has not been tampered with since the "If-Modified-Since" HTTP header, returning 304 response, without file content.
-    write_304_response (connection, on_success);
-  }
+  // Opening file first, unless the open file cache already gave it to us.
+  if (_file)
+    serve_file (connection, on_success);
+  else
+    open_file (connection, on_success);
 }
 
 
-bool get_file_handler::should_write_file (path full_path)
+void get_file_handler::open_file (connection_ptr connection, std::function<void()> on_success)
 {
-  // Checking if client passed in an "If-Modified-Since" header.
-  string if_modified_since = request()->envelope().header ("If-Modified-Since");
-  if (if_modified_since != "") {
+  // Making sure connection is closed, if opening file throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Opening file on disc I/O thread, since open might block on disc, remembering what cache looked like before we did.
+  const path filepath = request()->envelope().path();
+  open_file_cache * cache = &connection->server()->open_files();
+  auto result = std::make_shared<open_file_cache::loaded> ();
+  result->generation = cache->generation ();
+  auto forbidden = std::make_shared<bool> (false);
+  connection->server()->disk_io().post ([cache, filepath, result, forbidden] () {
+
+    // A file that exists, but cannot be opened, is one we're not allowed to open.
+    cache->load (filepath, *result);
+    *forbidden = !result->file && !result->missing && is_regular_file (filepath);
+
+  }, [this, connection, filepath, result, forbidden, x, on_success] () {
+
+    // Releasing exception helper, and inserting file into cache.
+    x.release ();
+    _file = connection->server()->open_files().insert (filepath, *result);
+    if (_file) {
+
+      // Serving file.
+      serve_file (connection, on_success);
+    } else {
+
+      // Not allowed to open file, no such file, or user tries to GET a folder as a file.
+      // Notice, this destroys "this".
+      request()->write_error_response (connection, *forbidden ? 403 : 404);
+    }
+  });
+}
 
-    // We have an "If-Modified-Since" HTTP header, checking if file was tampered with since that date.
-    date if_modified_date = date::parse (if_modified_since);
-    date file_modify_date = date::from_path_change (full_path);
 
-    // Comparing dates.
-    if (file_modify_date > if_modified_date) {
+void get_file_handler::serve_file (connection_ptr connection, std::function<void()> on_success)
+{
+  // Checking if we should write file at all.
+  if (!should_write_file (_file->modified)) {
 
-      // File was modified after "If-Modified-Since" header, hence we should write file to client.
-      return true;
-    } else {
+    // File has not been tampered with since the "If-Modified-Since" HTTP header, returning 304 response, without file content.
+    write_304_response (connection, on_success);
+    return;
+  }
 
-      // File has not been tampered with since the "If-Modified-Since" HTTP header, hence we should not write file back to client.
-      return false;
-    }
-  } else {
+  // Verifying this is a type of file we actually serve.
+  if (_mime_type == "") {
 
-    // Client sent no "If-Modified-Since" header, hence we should write file back to client.
-    return true;
+    // File type is not served according to configuration of server.
+    request()->write_error_response (connection, 403);
+    return;
   }
-}
 
+  // Writing status code, and headers, from metadata of file, which we already have, since the file is already opened.
+  write_status (connection, 200, [this, connection, on_success] () {
 
-void get_file_handler::write_304_response (connection_ptr connection, std::function<void()> on_success)
-{
-  // Writing status code 304 (Not-Modified) back to client.
-  write_status (connection, 304, [this, connection, on_success] () {
+    write_file_headers (connection, _mime_type, _file->size, _file->modified, [this, connection, on_success] () {
 
-    // Writing standard HTTP headers to connection.
-    write_standard_headers (connection, [this, connection, on_success] () {
+      // Writing standard headers to client.
+      write_standard_headers (connection, [this, connection, on_success] () {
 
-      // Making sure we close envelope.      
-      ensure_envelope_finished (connection, [on_success] () {
+        // Make sure we close envelope.
+        ensure_envelope_finished (connection, [this, connection, on_success] () {
 
-        // invoking callback, since we're done writing the response.
-        on_success ();
+          // Writing content of file back to client.
+          write_content (connection, _file->fd, 0, _file->size, on_success);
+        });
       });
     });
   });
@@ -17,7 +17,15 @@
 
 #include <tuple>
 #include <vector>
+#include <cerrno>
+#include <cstdio>
 #include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -35,6 +43,18 @@ using std::string;
 using boost::system::error_code;
 using namespace rosetta::common;
 
+// Size of the HTTP chunks we send archives in.
+const static size_t ARCHIVE_CHUNK_SIZE = 262144;
+
+// Room reserved in front of every HTTP chunk for its size, as 16 hexadecimal digits followed by CR/LF.
+const static size_t CHUNK_HEADER_SIZE = 18;
+
+// Smallest file we send directly from file to socket, since below this size, the additional write operations costs more than the copy.
+const static uint64_t SENDFILE_THRESHOLD = 65536;
+
+// Largest number of bytes we ask sendfile to send at once, to give other connections a chance to run in between.
+const static size_t SENDFILE_CHUNK_SIZE = 1048576;
+
 
 get_folder_handler::get_folder_handler (class request * request)
   : request_handler_base (request)
@@ -43,9 +63,15 @@ get_folder_handler::get_folder_handler (class request * request)
 
 void get_folder_handler::handle (connection_ptr connection, std::function<void()> on_success)
 {
-  // Retrieving root path, and checking if we should write it.
+  // Retrieving root path, and checking if client wants the entire subtree of folder as an archive.
+  // Notice, the modification date of a folder says nothing about its subtree, hence archives are always written.
   path full_path = request()->envelope().path();
-  if (should_write_folder (full_path)) {
+  if (request()->envelope().has_parameter ("archive")) {
+
+    // Returning archive to client, factory has already verified that format is supported.
+    auto type = request()->envelope().parameter ("archive") == "zip" ? archive_writer::format::zip : archive_writer::format::tar;
+    write_archive (connection, full_path, type, on_success);
+  } else if (should_write_folder (full_path)) {
 
     // Returning file to client.
     write_folder (connection, full_path, on_success);
@@ -60,7 +86,7 @@ void get_folder_handler::handle (connection_ptr connection, std::function<void()
 bool get_folder_handler::should_write_folder (path full_path)
 {
   // Checking if client passed in an "If-Modified-Since" header.
-  string if_modified_since = request()->envelope().header ("If-Modified-Since");
+  string if_modified_since = request()->envelope().header ("If-Modified-Since").c_str();
   if (if_modified_since != "") {
 
     // We have an "If-Modified-Since" HTTP header, checking if file was tampered with since that date.
@@ -110,18 +136,42 @@ void get_folder_handler::write_304_response (connection_ptr connection, std::fun
 
 void get_folder_handler::write_folder (connection_ptr connection, path folderpath, std::function<void()> on_success)
 {
-  // Using shared_ptr of vector to hold folder information.
+  // Using shared_ptr of vector to hold folder information, and a shared_ptr of string to hold last modification date of folder.
   auto buffer_ptr = std::make_shared<std::vector<unsigned char>> ();
-  buffer_ptr->push_back ('{');
-  write_objects ("folders", connection, buffer_ptr, folderpath);
-  write_objects ("files", connection, buffer_ptr, folderpath);
-  buffer_ptr->push_back ('}');
+  auto last_modified_ptr = std::make_shared<string> ();
+
+  // Making sure connection is closed, if iterating folder throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Iterating folder on disc I/O thread, since this might be slow.
+  connection->server()->disk_io().post ([this, buffer_ptr, last_modified_ptr, folderpath] () {
+
+    // Building JSON for folder content.
+    buffer_ptr->push_back ('{');
+    write_objects ("folders", buffer_ptr, folderpath);
+    write_objects ("files", buffer_ptr, folderpath);
+    buffer_ptr->push_back ('}');
+    *last_modified_ptr = date::from_path_change (folderpath).to_string ();
+
+  }, [this, connection, buffer_ptr, last_modified_ptr, x, on_success] () {
+
+    // Releasing exception helper, and writing folder content back to client.
+    x.release ();
+    write_folder_content (connection, buffer_ptr, *last_modified_ptr, on_success);
+  });
+}
 
+
+void get_folder_handler::write_folder_content (connection_ptr connection,
+                                               std::shared_ptr<std::vector<unsigned char>> buffer_ptr,
+                                               const string & last_modified,
+                                               std::function<void()> on_success)
+{
   // Writing status code.
-  write_status (connection, 200, [this, connection, buffer_ptr, folderpath, on_success] () {
+  write_status (connection, 200, [this, connection, buffer_ptr, last_modified, on_success] () {
 
     // Writing standard headers to client.
-    write_standard_headers (connection, [this, connection, buffer_ptr, folderpath, on_success] () {
+    write_standard_headers (connection, [this, connection, buffer_ptr, last_modified, on_success] () {
 
       // Writing headers for folder information.
       size_t size = buffer_ptr->size();
@@ -131,7 +181,7 @@ void get_folder_handler::write_folder (connection_ptr connection, path folderpat
         {"Content-Type", "application/json; charset=utf-8"},
         {"Vary", "Authorization"},
         {"Content-Length", boost::lexical_cast<string> (size)},
-        {"Last-Modified", date::from_path_change (folderpath).to_string ()}};
+        {"Last-Modified", last_modified}};
 
       // Writing special handler headers to connection.
       write_headers (connection, headers, [this, connection, buffer_ptr, on_success] () {
@@ -153,7 +203,6 @@ void get_folder_handler::write_folder (connection_ptr connection, path folderpat
 
 
 void get_folder_handler::write_objects (const string & type,
-                                        connection_ptr connection,
                                         std::shared_ptr<std::vector<unsigned char>> buffer_ptr,
                                         path folderpath)
 {
@@ -218,5 +267,327 @@ void get_folder_handler::write_objects (const string & type,
 }
 
 
+get_folder_handler::archive_state::archive_state (path folder, archive_writer::format type)
+  : walker (folder),
+    writer (type),
+    fd (-1),
+    size (0),
+    modified (0),
+    left (0),
+    done (false)
+{
+  buffer.reserve (ARCHIVE_CHUNK_SIZE + CHUNK_HEADER_SIZE + 2);
+  buffer.resize (CHUNK_HEADER_SIZE);
+}
+
+
+get_folder_handler::archive_state::~archive_state ()
+{
+  close_file ();
+}
+
+
+void get_folder_handler::archive_state::close_file ()
+{
+  if (fd != -1) {
+    ::close (fd);
+    fd = -1;
+  }
+}
+
+
+void get_folder_handler::write_archive (connection_ptr connection, path folderpath, archive_writer::format type, std::function<void()> on_success)
+{
+  // Making sure connection is closed, if creating archive fails somehow, since we cannot return an error once we have started writing it.
+  exceptional_executor x ([connection] () { connection->close (); });
+  auto archive = std::make_shared<archive_state> (folderpath, type);
+
+  // Archive is named after folder, or "www-root" if this is the root folder.
+  string filename = folderpath.filename().string() + (type == archive_writer::format::zip ? ".zip" : ".tar");
+  collection headers {
+    {"Content-Type", type == archive_writer::format::zip ? "application/zip" : "application/x-tar"},
+    {"Content-Disposition", "attachment; filename=\"" + filename + "\""},
+    {"Vary", "Authorization"},
+    {"Transfer-Encoding", "chunked"}};
+
+  // Writing status code, and headers, before we start walking folder.
+  write_status (connection, 200, [this, connection, archive, headers, x, on_success] () {
+
+    write_standard_headers (connection, [this, connection, archive, headers, x, on_success] () {
+
+      write_headers (connection, headers, [this, connection, archive, x, on_success] () {
+
+        ensure_envelope_finished (connection, [this, connection, archive, x, on_success] () {
+
+          // Adding the first file to archive.
+          archive_next_file (connection, archive, x, on_success);
+        });
+      });
+    });
+  });
+}
+
+
+void get_folder_handler::archive_next_file (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success)
+{
+  // Walking folder and opening file on disc I/O thread, since this might be slow.
+  connection->server()->disk_io().post ([archive] () {
+
+    // Looping until we find a file we can open, or there are no more files in folder.
+    while (archive->walker.next (archive->file, archive->name)) {
+
+      archive->fd = ::open (archive->file.string().c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+      if (archive->fd == -1)
+        continue; // File was removed after we found it, or we are not allowed to read it.
+
+      struct stat info;
+      if (::fstat (archive->fd, &info) != 0 || !S_ISREG (info.st_mode) || !archive->writer.can_store (info.st_size)) {
+        archive->close_file ();
+        continue;
+      }
+      archive->size = info.st_size;
+      archive->left = info.st_size;
+      archive->modified = info.st_mtime;
+      return;
+    }
+    archive->done = true;
+
+  }, [this, connection, archive, x, on_success] () {
+
+    // Checking if we are done with folder.
+    if (archive->done) {
+      finish_archive (connection, archive, x, on_success);
+      return;
+    }
+
+    // Making sure file would be served if client requested it directly, and that client is authorized to GET it.
+    // Notice, authorization is not thread safe, hence this must be done on the network thread.
+    string handler = connection->server()->configuration().get<string> ("handler" + archive->file.extension().string(), "error");
+    if (handler != "get-file-handler" ||
+        !connection->server()->authorization().authorize (request()->envelope().ticket(), archive->file, "GET")) {
+
+      archive->close_file ();
+      archive_next_file (connection, archive, x, on_success);
+      return;
+    }
+
+    // Adding header of file to pending chunk.
+    archive->writer.begin_file (archive->name, archive->size, archive->modified, archive->buffer);
+
+    // Tar archives does not need to see the content of large files, hence we can send them directly from file to socket, unless
+    // socket is an SSL socket, which needs to encrypt content in user space.
+    if (!archive->writer.needs_content () && !connection->is_secure () && archive->size >= SENDFILE_THRESHOLD) {
+
+      // Making sure socket never blocks when we send file to it.
+      error_code ec;
+      static_cast<rosetta_socket_plain &> (connection->socket ()).socket ().native_non_blocking (true, ec);
+      if (!ec) {
+
+        // Hinting the kernel that we will read the entire file, since sendfile will read it on the network thread.
+        ::posix_fadvise (archive->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        // Writing pending chunk, declaring file's content, and end of file, as part of it, for then to send content directly from file.
+        write_archive_chunk (connection, archive, archive->size + archive->writer.end_size (), [this, connection, archive, x, on_success] () {
+          send_file_content (connection, archive, x, on_success);
+        });
+        return;
+      }
+    }
+
+    // Reading content of file into pending chunk.
+    archive_file_content (connection, archive, x, on_success);
+  });
+}
+
+
+void get_folder_handler::archive_file_content (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success)
+{
+  // Reading file on disc I/O thread, since this might block.
+  connection->server()->disk_io().post ([archive] () {
+
+    // Reading until chunk is full, or we have read the entire file.
+    while (archive->left > 0 && archive->buffer.size () < ARCHIVE_CHUNK_SIZE + CHUNK_HEADER_SIZE) {
+
+      const size_t offset = archive->buffer.size ();
+      const size_t bytes = std::min<uint64_t> (archive->left, ARCHIVE_CHUNK_SIZE + CHUNK_HEADER_SIZE - offset);
+      archive->buffer.resize (offset + bytes);
+      ssize_t bytes_read = ::read (archive->fd, archive->buffer.data () + offset, bytes);
+      if (bytes_read < 0)
+        throw std::runtime_error ("Couldn't read file while creating archive.");
+
+      // If file shrunk after we wrote its header, we pad it with zeros, since header promised its original size.
+      if (bytes_read == 0) {
+        std::fill (archive->buffer.begin () + offset, archive->buffer.end (), 0);
+        bytes_read = bytes;
+      } else {
+        archive->buffer.resize (offset + bytes_read);
+      }
+      if (archive->writer.needs_content ())
+        archive->writer.update (archive->buffer.data () + offset, bytes_read);
+      archive->left -= bytes_read;
+    }
+
+    // Ending file, if we have added all of it to chunk.
+    if (archive->left == 0) {
+      archive->close_file ();
+      archive->writer.end_file (archive->buffer);
+    }
+
+  }, [this, connection, archive, x, on_success] () {
+
+    // Writing chunk if it is full, and continuing with the current file, or the next file.
+    auto next = [this, connection, archive, x, on_success] () {
+      if (archive->fd != -1)
+        archive_file_content (connection, archive, x, on_success);
+      else
+        archive_next_file (connection, archive, x, on_success);
+    };
+    if (archive->buffer.size () >= ARCHIVE_CHUNK_SIZE + CHUNK_HEADER_SIZE)
+      write_archive_chunk (connection, archive, 0, next);
+    else
+      next ();
+  });
+}
+
+
+void get_folder_handler::send_file_content (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success)
+{
+  // Sending as much of file as socket accepts without blocking.
+  auto & socket = static_cast<rosetta_socket_plain &> (connection->socket ()).socket ();
+  while (archive->left > 0) {
+
+    ssize_t sent = ::sendfile (socket.native_handle (), archive->fd, nullptr, std::min<uint64_t> (archive->left, SENDFILE_CHUNK_SIZE));
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+
+      // Waiting for socket to become writable, before we continue sending file.
+      socket.async_wait (socket_base::wait_write, [this, connection, archive, x, on_success] (const error_code & error) {
+
+        // Checking for socket errors.
+        if (error)
+          connection->close();
+        else
+          send_file_content (connection, archive, x, on_success);
+      });
+      return;
+    } else if (sent < 0) {
+
+      // Something went wrong.
+      connection->close();
+      return;
+    } else if (sent == 0) {
+
+      // File shrunk after we wrote its header.
+      break;
+    }
+    archive->left -= sent;
+  }
+
+  // Done with content of file, padding it, and ending its chunk.
+  archive->close_file ();
+  pad_file_content (connection, archive, x, on_success);
+}
+
+
+void get_folder_handler::pad_file_content (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success)
+{
+  // Writing zeros for whatever is left of content, if file shrunk, followed by end of file, and end of chunk, without any chunk size,
+  // since this is the end of the chunk we declared before we started sending file.
+  archive->buffer.clear ();
+  const size_t padding = std::min<uint64_t> (archive->left, ARCHIVE_CHUNK_SIZE);
+  archive->buffer.resize (padding, 0);
+  archive->left -= padding;
+  if (archive->left == 0) {
+    archive->writer.end_file (archive->buffer);
+    archive->buffer.push_back ('\r');
+    archive->buffer.push_back ('\n');
+  }
+  connection->socket().async_write (buffer (archive->buffer), [this, connection, archive, x, on_success] (auto error, auto bytes_written) {
+
+    // Checking for socket errors.
+    if (error) {
+      connection->close();
+      return;
+    }
+
+    // Starting a new chunk if we are done with file, otherwise writing more padding.
+    if (archive->left == 0) {
+      archive->buffer.resize (CHUNK_HEADER_SIZE);
+      archive_next_file (connection, archive, x, on_success);
+    } else {
+      pad_file_content (connection, archive, x, on_success);
+    }
+  });
+}
+
+
+void get_folder_handler::finish_archive (connection_ptr connection, archive_ptr archive, exceptional_executor x, std::function<void()> on_success)
+{
+  // Retrieving end of archive on disc I/O thread, since zip archives reads their central directory from a temporary file.
+  auto done = std::make_shared<bool> (false);
+  connection->server()->disk_io().post ([archive, done] () {
+
+    const size_t room = ARCHIVE_CHUNK_SIZE + CHUNK_HEADER_SIZE - std::min (archive->buffer.size (), ARCHIVE_CHUNK_SIZE + CHUNK_HEADER_SIZE);
+    *done = archive->writer.finish (archive->buffer, room);
+
+  }, [this, connection, archive, done, x, on_success] () {
+
+    // Writing chunk, and continuing until we have the entire end of archive.
+    write_archive_chunk (connection, archive, 0, [this, connection, archive, done, x, on_success] () {
+
+      if (!*done) {
+        finish_archive (connection, archive, x, on_success);
+        return;
+      }
+
+      // Writing last chunk, which is empty, to signal end of content.
+      connection->socket().async_write (buffer ("0\r\n\r\n", 5), [connection, x, on_success] (auto error, auto bytes_written) {
+
+        // Checking for socket errors.
+        if (error) {
+          connection->close();
+          return;
+        }
+
+        // Done with archive.
+        x.release ();
+        on_success ();
+      });
+    });
+  });
+}
+
+
+void get_folder_handler::write_archive_chunk (connection_ptr connection, archive_ptr archive, uint64_t trailing, std::function<void()> on_written)
+{
+  // Not writing anything if chunk is empty, since an empty chunk signals the end of content.
+  const uint64_t size = archive->buffer.size () - CHUNK_HEADER_SIZE + trailing;
+  if (size == 0) {
+    on_written ();
+    return;
+  }
+
+  // Filling in size of chunk, and ending chunk, unless caller writes trailing content.
+  char header [CHUNK_HEADER_SIZE + 1];
+  std::snprintf (header, sizeof (header), "%016llx\r\n", static_cast<unsigned long long> (size));
+  std::copy (header, header + CHUNK_HEADER_SIZE, archive->buffer.begin ());
+  if (trailing == 0) {
+    archive->buffer.push_back ('\r');
+    archive->buffer.push_back ('\n');
+  }
+  connection->socket().async_write (buffer (archive->buffer), [connection, archive, on_written] (auto error, auto bytes_written) {
+
+    // Checking for socket errors.
+    if (error) {
+      connection->close();
+      return;
+    }
+
+    // Starting a new chunk.
+    archive->buffer.resize (CHUNK_HEADER_SIZE);
+    on_written ();
+  });
+}
+
+
 } // namespace http_server
 } // namespace rosetta
@@ -0,0 +1,212 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/stat.h>
+#include <boost/algorithm/string.hpp>
+#include "http_server/include/server.hpp"
+#include "http_server/include/helpers/date.hpp"
+#include "http_server/include/helpers/uri_encode.hpp"
+#include "http_server/include/connection/request.hpp"
+#include "http_server/include/connection/connection.hpp"
+#include "http_server/include/connection/handlers/get_multi_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace rosetta::common;
+
+bool sanity_check_path (path uri);
+bool is_hidden (const path & uri);
+
+
+get_multi_handler::get_multi_handler (class request * request)
+  : request_file_handler (request),
+    _pending (0)
+{ }
+
+
+void get_multi_handler::handle (connection_ptr connection, std::function<void()> on_success)
+{
+  // Splitting up list of files, ignoring empty names, factory has already verified that client did not request too many files.
+  std::vector<string> names;
+  const string list = request()->envelope().parameter ("multi").c_str();
+  boost::split (names, list, boost::is_any_of (","));
+  for (auto & idx : names) {
+    if (!idx.empty ())
+      _parts.emplace_back (idx, request()->envelope().path() / idx);
+  }
+
+  // Authorizing all files on the network thread, since authorization is not thread safe, before reading them in parallel.
+  const size_t max_size = connection->server()->configuration().get<size_t> ("max-multi-file-size", 262144);
+  for (auto & idx : _parts) {
+    idx.status_code = authorize_part (connection, idx);
+    if (idx.status_code == 0)
+      ++_pending;
+  }
+  if (_pending == 0) {
+
+    // No files to read.
+    write_parts (connection, on_success);
+    return;
+  }
+  for (auto & idx : _parts) {
+    if (idx.status_code == 0)
+      read_part (connection, idx, max_size, on_success);
+  }
+}
+
+
+unsigned int get_multi_handler::authorize_part (connection_ptr connection, part & file)
+{
+  // Making sure name is sane, and not hidden, the same way we check the path of a request.
+  const path name = file.name;
+  if (name.is_absolute () || !sanity_check_path (name) || is_hidden (name))
+    return 404;
+
+  // Making sure file would be served if client requested it directly.
+  string handler = connection->server()->configuration().get<string> ("handler" + file.file.extension().string(), "error");
+  file.mime_type = get_mime (connection, file.file);
+  if (handler != "get-file-handler" || file.mime_type == "")
+    return 404;
+
+  // Making sure client is authorized to GET file.
+  if (!connection->server()->authorization().authorize (request()->envelope().ticket(), file.file, "GET"))
+    return request()->envelope().ticket().authenticated() ? 403 : 401;
+  return 0;
+}
+
+
+void get_multi_handler::read_part (connection_ptr connection, part & file, size_t max_size, std::function<void()> on_success)
+{
+  // Reading file on disc I/O thread, since this might block.
+  connection->server()->disk_io().post ([&file, max_size] () {
+
+    // Any error reading a file only affects its own part of response.
+    int fd = ::open (file.file.string().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      file.status_code = 404;
+      return;
+    }
+    struct stat info;
+    if (::fstat (fd, &info) != 0 || !S_ISREG (info.st_mode)) {
+      file.status_code = 404;
+    } else if (static_cast<size_t> (info.st_size) > max_size) {
+
+      // Too large to include, client must GET this file the normal way.
+      file.status_code = 413;
+    } else {
+
+      // Reading entire file.
+      file.content.resize (info.st_size);
+      size_t offset = 0;
+      while (offset < file.content.size ()) {
+        ssize_t bytes_read = ::read (fd, file.content.data () + offset, file.content.size () - offset);
+        if (bytes_read <= 0)
+          break;
+        offset += bytes_read;
+      }
+      file.content.resize (offset);
+      file.last_modified = date::from_path_change (file.file).to_string ();
+      file.status_code = 200;
+    }
+    ::close (fd);
+
+  }, [this, connection, on_success] () {
+
+    // Writing response once all files have been read.
+    if (--_pending == 0)
+      write_parts (connection, on_success);
+  });
+}
+
+
+void get_multi_handler::write_parts (connection_ptr connection, std::function<void()> on_success)
+{
+  // Finding a boundary that does not occur in the content of any of our files.
+  unsigned int counter = 0;
+  string boundary;
+  bool unique = false;
+  while (!unique) {
+    char buffer [32];
+    std::snprintf (buffer, sizeof (buffer), "rosetta-multi-%08x", counter++);
+    boundary = buffer;
+    unique = std::none_of (_parts.begin (), _parts.end (), [&boundary] (const part & idx) {
+      return std::search (idx.content.begin (), idx.content.end (), boundary.begin (), boundary.end ()) != idx.content.end () ||
+             idx.name.find (boundary) != string::npos;
+    });
+  }
+
+  // Building response, where each file gets its own part, with its status code, and its content if we could retrieve it.
+  // Notice, Content-Location is a URI, hence the name of file is URI encoded.
+  for (auto & idx : _parts) {
+    string headers = "--" + boundary + "\r\n";
+    headers += "Content-Location: " + uri_encode::encode (idx.name) + "\r\n";
+    headers += "Status: " + boost::lexical_cast<string> (idx.status_code) + "\r\n";
+    if (idx.status_code == 200) {
+      headers += "Content-Type: " + idx.mime_type + "\r\n";
+      headers += "Content-Length: " + boost::lexical_cast<string> (idx.content.size ()) + "\r\n";
+      headers += "Last-Modified: " + idx.last_modified + "\r\n";
+    }
+    headers += "\r\n";
+    _response.insert (_response.end (), headers.begin (), headers.end ());
+    _response.insert (_response.end (), idx.content.begin (), idx.content.end ());
+    _response.push_back ('\r');
+    _response.push_back ('\n');
+    idx.content = std::vector<char> ();
+  }
+  const string end = "--" + boundary + "--\r\n";
+  _response.insert (_response.end (), end.begin (), end.end ());
+
+  // Writing status code.
+  write_status (connection, 200, [this, connection, boundary, on_success] () {
+
+    // Writing standard headers to client.
+    write_standard_headers (connection, [this, connection, boundary, on_success] () {
+
+      // Building headers for a multipart response, making sure it is reloaded if user is authorized, since it depends upon authorization.
+      collection headers {
+        {"Content-Type", "multipart/mixed; boundary=" + boundary},
+        {"Vary", "Authorization"},
+        {"Content-Length", boost::lexical_cast<string> (_response.size ())}};
+      write_headers (connection, headers, [this, connection, on_success] () {
+
+        // Make sure we close envelope.
+        ensure_envelope_finished (connection, [this, connection, on_success] () {
+
+          // Now writing all files.
+          connection->socket().async_write (buffer (_response), [connection, on_success] (auto error, auto bytes_written) {
+
+            // Checking for socket errors, and if there were none, we're finished.
+            if (error)
+              connection->close();
+            else
+              on_success ();
+          });
+        });
+      });
+    });
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
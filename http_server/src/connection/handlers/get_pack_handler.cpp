@@ -0,0 +1,77 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "http_server/include/server.hpp"
+#include "http_server/include/connection/request.hpp"
+#include "http_server/include/connection/connection.hpp"
+#include "http_server/include/connection/handlers/get_pack_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace rosetta::common;
+
+
+get_pack_handler::get_pack_handler (class request * request, const pack_file::entry & entry)
+  : request_file_handler (request),
+    _entry (entry)
+{ }
+
+
+void get_pack_handler::handle (connection_ptr connection, std::function<void()> on_success)
+{
+  // Checking if we should write file at all.
+  if (!should_write_file (_entry.modified)) {
+
+    // File has not been tampered with since the "If-Modified-Since" HTTP header, returning 304 response, without file content.
+    write_304_response (connection, on_success);
+    return;
+  }
+
+  // Using MIME type stored in pack, if any, otherwise the one from configuration, verifying this is a type of file we actually serve.
+  string mime_type = _entry.mime.empty () ? get_mime (connection, request()->envelope().path()) : _entry.mime;
+  if (mime_type == "") {
+
+    // File type is not served according to configuration of server.
+    request()->write_error_response (connection, 403);
+    return;
+  }
+
+  // Writing status code, and headers, which we already know everything about from index of pack.
+  write_status (connection, 200, [this, connection, mime_type, on_success] () {
+
+    write_file_headers (connection, mime_type, _entry.size, _entry.modified, [this, connection, on_success] () {
+
+      // Writing standard headers to client.
+      write_standard_headers (connection, [this, connection, on_success] () {
+
+        // Make sure we close envelope.
+        ensure_envelope_finished (connection, [this, connection, on_success] () {
+
+          // Writing content directly from pack.
+          write_content (connection, _entry.fd, _entry.offset, _entry.size, on_success);
+        });
+      });
+    });
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "http_server/include/server.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
 #include "http_server/include/exceptions/server_exception.hpp"
@@ -39,6 +40,21 @@ error_handler::error_handler (class request * request, unsigned int status_code)
 
 void error_handler::handle (connection_ptr connection, std::function<void()> on_success)
 {
+  // Writing pre-rendered response in a single write, if we have an error page for status code, making sure response stays around
+  // until write is finished.
+  auto response = std::make_shared<string> ();
+  if (connection->server()->error_responses().render (_status_code, closes_connection (), *response)) {
+    connection->socket().async_write (buffer (*response), [connection, response, on_success] (auto error, auto bytes_written) {
+
+      // Sanity check.
+      if (error)
+        connection->close();
+      else
+        on_success ();
+    });
+    return;
+  }
+
   // Figuring out which file to serve.
   string error_file = "error-pages/" + boost::lexical_cast<string> (_status_code) + ".html";
 
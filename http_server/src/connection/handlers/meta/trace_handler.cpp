@@ -98,11 +98,11 @@ std::shared_ptr<std::vector<unsigned char> > trace_handler::build_content ()
     }
 
     // Adding name of parameter, making sure we URI encode it.
-    const auto name = uri_encode (std::get<0> (idx));
+    const auto name = uri_encode (std::get<0> (idx).c_str());
     buffer_ptr->insert (buffer_ptr->end(), name.begin(), name.end());
 
     // Adding value of parameter, making sure we URI encode it.
-    const auto value = uri_encode (std::get<1> (idx));
+    const auto value = uri_encode (std::get<1> (idx).c_str());
     if (value.size() > 0) {
 
       // We only add '=' and value, if there actually is any value.
@@ -120,7 +120,7 @@ std::shared_ptr<std::vector<unsigned char> > trace_handler::build_content ()
   buffer_ptr->push_back ('\n');
 
   // Returning all HTTP headers.
-  for (auto idx : request()->envelope().headers ()) {
+  for (auto & idx : request()->envelope().headers ()) {
 
     // Header name and colon.
     buffer_ptr->insert (buffer_ptr->end(), std::get<0> (idx).begin(), std::get<0> (idx).end());
@@ -0,0 +1,82 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <boost/filesystem.hpp>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/server.hpp"
+#include "http_server/include/helpers/file_copy.hpp"
+#include "http_server/include/connection/request.hpp"
+#include "http_server/include/connection/connection.hpp"
+#include "http_server/include/connection/handlers/move_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace rosetta::common;
+
+
+move_handler::move_handler (class request * request, const path & destination, bool overwrite)
+  : request_handler_base (request),
+    _destination (destination),
+    _overwrite (overwrite)
+{ }
+
+
+void move_handler::handle (connection_ptr connection, std::function<void()> on_success)
+{
+  const path source = request()->envelope().path();
+  const path destination = _destination;
+
+  // Making sure connection is closed, if moving throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Moving on disc I/O thread, since we might have to traverse folders.
+  const bool overwrite = _overwrite;
+  auto status_ptr = std::make_shared<unsigned int> (0);
+  connection->server()->disk_io().post ([source, destination, overwrite, status_ptr] () {
+
+    // Access rights are associated with the path of their folder, hence we refuse to move folders that have their own access rights.
+    // Otherwise, the moved folder would get the access rights of its destination instead.
+    if (boost::filesystem::is_directory (source) && file_copy::contains_authorization_files (source))
+      *status_ptr = 403;
+    else
+      *status_ptr = file_copy::check_destination (source, destination, overwrite);
+    if (*status_ptr == 0)
+      boost::filesystem::rename (source, destination);
+
+  }, [this, connection, status_ptr, x, on_success] () {
+
+    // Releasing exception helper.
+    x.release ();
+    if (*status_ptr != 0) {
+
+      // Notice, this destroys "this", hence we return immediately.
+      request()->write_error_response (connection, *status_ptr);
+    } else {
+
+      // Forgetting files inside of whatever we moved, since inotify only tells us about files moved together with their own folder.
+      connection->server()->open_files().invalidate (request()->envelope().path());
+
+      // Returning success to client.
+      write_success_envelope (connection, on_success);
+    }
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,247 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <boost/filesystem.hpp>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/server.hpp"
+#include "http_server/include/connection/request.hpp"
+#include "http_server/include/helpers/tar_extractor.hpp"
+#include "http_server/include/helpers/multipart_extractor.hpp"
+#include "http_server/include/connection/connection.hpp"
+#include "http_server/include/connection/handlers/put_archive_handler.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace rosetta::common;
+
+// Size of chunks read from socket.
+const static size_t CONTENT_CHUNK_SIZE = 262144;
+
+/// Authorizes the given verb for path, the same way as if client had requested path itself.
+bool authorize_path (connection_ptr connection, request * request, const path & path, const string & method);
+
+
+put_archive_handler::put_archive_handler (class request * request, const string & boundary)
+  : content_request_handler (request),
+    _boundary (boundary)
+{ }
+
+
+void put_archive_handler::handle (connection_ptr connection, std::function<void()> on_success)
+{
+  // Setting deadline timer for content read.
+  const int CONTENT_READ_TIMEOUT = connection->server()->configuration().get<int> ("request-content-read-timeout", 300);
+  connection->set_deadline_timer (CONTENT_READ_TIMEOUT);
+
+  // We need to know the size of archive up front, which factory should already have verified.
+  const size_t content_length = has_chunked_content () ? 0 : get_content_length (connection);
+  if (content_length == 0) {
+
+    // Client did not tell us how large archive is.
+    request()->write_error_response (connection, 411);
+    return;
+  }
+
+  // Every file in archive is authorized as if client had done a PUT of it, and the size of archive once extracted is limited too,
+  // since a small compressed archive might expand into something huge.
+  const size_t max_size = connection->server()->configuration().get<size_t> ("max-extract-size", 1073741824);
+  const bool durable = connection->server()->configuration().get<string> ("put-durability", "none") != "none";
+  auto filter = [this, connection] (const path & target, bool folder) {
+    return authorize_path (connection, request(), target, "PUT") ? 200 : 403;
+  };
+  shared_ptr<batch_extractor> extractor;
+  if (_boundary.empty ())
+    extractor = std::make_shared<tar_extractor> (request()->envelope().path(), filter, max_size, durable);
+  else
+    extractor = std::make_shared<multipart_extractor> (request()->envelope().path(), _boundary, filter, max_size, durable);
+
+  // Creating exceptional_executor, to make sure everything extracted is removed, unless entire operation succeeds.
+  exceptional_executor x ([connection, extractor] () {
+
+    // Removing files on disc I/O thread, since archive might have contained many files.
+    connection->server()->disk_io().post ([extractor] () { extractor->rollback (); }, [] () { });
+    connection->close ();
+  });
+
+  // Reading archive.
+  read_archive (connection, extractor, content_length, x, on_success);
+}
+
+
+size_t put_archive_handler::get_max_content_length (connection_ptr connection)
+{
+  return connection->server()->configuration().get<size_t> ("max-extract-content-length", 104857600);
+}
+
+
+void put_archive_handler::read_archive (connection_ptr connection,
+                                        shared_ptr<batch_extractor> extractor,
+                                        size_t content_length,
+                                        exceptional_executor x,
+                                        std::function<void()> on_success)
+{
+  // Checking if we read parts of the archive while reading the envelope.
+  const size_t buffered = std::min (connection->buffer().size(), content_length);
+  if (buffered > 0) {
+    extract_chunk (connection, extractor, content_length, buffered, x, on_success);
+    return;
+  }
+
+  // Reading next chunk from socket.
+  const size_t chunk_size = std::min (content_length, CONTENT_CHUNK_SIZE);
+  connection->socket().async_read (connection->buffer(),
+                                   transfer_exactly (chunk_size),
+                                   [this, connection, extractor, content_length, chunk_size, x, on_success] (auto error, auto bytes_read) {
+
+    // Checking for socket errors.
+    if (error)
+      connection->close();
+    else
+      extract_chunk (connection, extractor, content_length, chunk_size, x, on_success);
+  });
+}
+
+
+void put_archive_handler::extract_chunk (connection_ptr connection,
+                                         shared_ptr<batch_extractor> extractor,
+                                         size_t content_length,
+                                         size_t chunk_size,
+                                         exceptional_executor x,
+                                         std::function<void()> on_success)
+{
+  // Parsing chunk on network thread, since parsing it authorizes entries, which is not thread safe.
+  extractor->parse (buffer_cast<const char*> (connection->buffer().data()), chunk_size);
+  connection->buffer().consume (chunk_size);
+  if (extractor->error () != 0) {
+
+    // Removing whatever we have extracted so far, and returning error to client.
+    // Notice, this destroys "this", hence we return immediately.
+    connection->server()->disk_io().post ([extractor] () { extractor->rollback (); }, [] () { });
+    x.release ();
+    request()->write_error_response (connection, extractor->error ());
+    return;
+  }
+
+  // Writing content of chunk to disc on disc I/O thread, before we read more of the archive.
+  connection->server()->disk_io().post ([extractor] () {
+
+    extractor->write ();
+
+  }, [this, connection, extractor, content_length, chunk_size, x, on_success] () {
+
+    // Checking if we have more of the archive to read.
+    if (content_length > chunk_size)
+      read_archive (connection, extractor, content_length - chunk_size, x, on_success);
+    else
+      archive_extracted (connection, extractor, x, on_success);
+  });
+}
+
+
+void put_archive_handler::archive_extracted (connection_ptr connection,
+                                             shared_ptr<batch_extractor> extractor,
+                                             exceptional_executor x,
+                                             std::function<void()> on_success)
+{
+  // Making sure archive was complete, since a truncated archive is something client must fix.
+  if (!extractor->finished ()) {
+
+    // Notice, this destroys "this", hence we return immediately.
+    connection->server()->disk_io().post ([extractor] () { extractor->rollback (); }, [] () { });
+    x.release ();
+    request()->write_error_response (connection, 400);
+    return;
+  }
+
+  // Renaming all files into place as a single unit if every entry could be extracted, and otherwise removing all of them.
+  const bool succeeded = extractor->succeeded ();
+  auto server = connection->server();
+  server->disk_io().post ([server, extractor, succeeded] () {
+
+    if (succeeded)
+      extractor->commit (server->journal ());
+    else
+      extractor->rollback ();
+
+  }, [this, connection, extractor, succeeded, x, on_success] () {
+
+    // Returning result of every entry to client.
+    x.release ();
+    write_entries (connection, succeeded ? 200 : 403, extractor, on_success);
+  });
+}
+
+
+void put_archive_handler::write_entries (connection_ptr connection,
+                                         int status_code,
+                                         shared_ptr<batch_extractor> extractor,
+                                         std::function<void()> on_success)
+{
+  // Building JSON for entries, escaping names, which can only contain printable characters, since we refuse anything else.
+  auto content_ptr = std::make_shared<string> ("{\"entries\":[");
+  bool first = true;
+  for (auto & idx : extractor->entries ()) {
+    if (first)
+      first = false;
+    else
+      content_ptr->push_back (',');
+    *content_ptr += "{\"name\":\"";
+    for (auto c : idx.name) {
+      if (c == '"' || c == '\\')
+        content_ptr->push_back ('\\');
+      if (c >= 32 && c <= 126)
+        content_ptr->push_back (c);
+    }
+    *content_ptr += "\",\"status\":" + std::to_string (idx.status) + "}";
+  }
+  *content_ptr += "]}";
+
+  // Writing status code.
+  write_status (connection, status_code, [this, connection, content_ptr, on_success] () {
+
+    // Writing standard headers to client.
+    write_standard_headers (connection, [this, connection, content_ptr, on_success] () {
+
+      // Building our standard response headers for a JSON result.
+      collection headers {
+        {"Content-Type", "application/json; charset=utf-8"},
+        {"Content-Length", boost::lexical_cast<string> (content_ptr->size ())}};
+
+      // Writing special handler headers to connection.
+      write_headers (connection, headers, [this, connection, content_ptr, on_success] () {
+
+        // Make sure we close envelope.
+        ensure_envelope_finished (connection, [this, connection, content_ptr, on_success] () {
+
+          // Now writing result.
+          connection->socket().async_write (buffer (*content_ptr), [on_success, content_ptr] (auto error, auto bytes_written) {
+
+            // Finished!
+            on_success ();
+          });
+        });
+      });
+    });
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
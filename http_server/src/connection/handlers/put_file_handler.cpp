@@ -15,9 +15,23 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <istream>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
 #include "common/include/exceptional_executor.hpp"
 #include "http_server/include/server.hpp"
+#include "http_server/include/helpers/file_copy.hpp"
+#include "http_server/include/helpers/match_condition.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
 #include "http_server/include/connection/handlers/put_file_handler.hpp"
@@ -28,6 +42,90 @@ namespace http_server {
 using std::string;
 using namespace rosetta::common;
 
+// Size of chunks read from socket, when we cannot use splice.
+const static size_t CONTENT_CHUNK_SIZE = 262144;
+
+// Capacity of pipe we try to create when splicing content from socket to file.
+const static size_t SPLICE_PIPE_CAPACITY = 1048576;
+
+// Smallest amount of content we bother splicing.
+const static size_t SPLICE_THRESHOLD = 65536;
+
+// Max length of chunk size lines and trailers in chunked content.
+const static size_t MAX_CHUNK_LINE_LENGTH = 4096;
+
+
+// Parses a Content-Range header, such as "bytes 0-1023/4096", or "bytes */4096", returning false if it is malformed.
+// The latter form is a query for how much of an upload the server has, at which point query is set to true.
+static bool parse_content_range (const string & content_range, bool & query, size_t & start, size_t & end, size_t & total)
+{
+  // Helper to check that a string is a non-empty decimal number, that fits into a size_t.
+  auto is_number = [] (const string & str) {
+    return !str.empty () && str.size () < 20 && str.find_first_not_of ("0123456789") == string::npos;
+  };
+
+  // We only support byte ranges.
+  const string value = boost::algorithm::trim_copy (content_range);
+  if (!boost::algorithm::istarts_with (value, "bytes "))
+    return false;
+
+  // Splitting range from total length of upload.
+  const string range_and_total = boost::algorithm::trim_copy (value.substr (6));
+  const size_t slash = range_and_total.find ('/');
+  if (slash == string::npos || !is_number (range_and_total.substr (slash + 1)))
+    return false;
+  const string range = range_and_total.substr (0, slash);
+  total = std::stoull (range_and_total.substr (slash + 1));
+
+  // Checking if this is a query.
+  query = range == "*";
+  if (query) {
+    start = end = 0;
+    return true;
+  }
+
+  // Parsing first and last byte of range, which are both inclusive.
+  const size_t dash = range.find ('-');
+  if (dash == string::npos || !is_number (range.substr (0, dash)) || !is_number (range.substr (dash + 1)))
+    return false;
+  start = std::stoull (range.substr (0, dash));
+  end = std::stoull (range.substr (dash + 1));
+  return start <= end && end < total;
+}
+
+
+// Returns a hidden temporary filename next to filename, which is unique for every PUT, such that concurrent PUTs of the same file never
+// share it. The name ends with the given suffix, and ".partial", such that the stale upload sweep removes it if server crashes.
+static string temporary_filename (const path & filename, const string & suffix)
+{
+  static std::atomic<size_t> counter (0);
+  const auto now = std::chrono::system_clock::now ().time_since_epoch ();
+  const string unique = std::to_string (std::chrono::duration_cast<std::chrono::microseconds> (now).count ()) + "-" + std::to_string (counter++);
+  return (filename.parent_path () / ("." + filename.filename ().string () + "." + unique + "." + suffix + ".partial")).string ();
+}
+
+
+// Returns true if both files have the exact same content, which we check before sharing a blob, since hashes might collide.
+static bool same_content (const path & lhs, const path & rhs)
+{
+  if (boost::filesystem::file_size (lhs) != boost::filesystem::file_size (rhs))
+    return false;
+
+  std::ifstream lhs_stream (lhs.string (), std::ios::binary);
+  std::ifstream rhs_stream (rhs.string (), std::ios::binary);
+  if (!lhs_stream || !rhs_stream)
+    throw std::runtime_error ("Couldn't open file to compare its content.");
+
+  std::vector<char> lhs_chunk (CONTENT_CHUNK_SIZE), rhs_chunk (CONTENT_CHUNK_SIZE);
+  while (lhs_stream && rhs_stream) {
+    lhs_stream.read (lhs_chunk.data (), lhs_chunk.size ());
+    rhs_stream.read (rhs_chunk.data (), rhs_chunk.size ());
+    if (lhs_stream.gcount () != rhs_stream.gcount () || !std::equal (lhs_chunk.begin (), lhs_chunk.begin () + lhs_stream.gcount (), rhs_chunk.begin ()))
+      return false;
+  }
+  return true;
+}
+
 
 put_file_handler::put_file_handler (class request * request)
   : content_request_handler (request)
@@ -36,9 +134,15 @@ put_file_handler::put_file_handler (class request * request)
 
 void put_file_handler::handle (connection_ptr connection, std::function<void()> on_success)
 {
-  // Retrieving URI from request.
+  // Retrieving URI from request, and checking if this is an append, or one range of a resumable upload.
   auto path = request()->envelope().path();
-  save_request_content (connection, path, on_success);
+  const string content_range = request()->envelope().header ("Content-Range").c_str();
+  if (request()->envelope().has_parameter ("append"))
+    append_request_content (connection, path, on_success);
+  else if (content_range.size () == 0)
+    save_request_content (connection, path, on_success);
+  else
+    save_range_content (connection, path, content_range, on_success);
 }
 
 
@@ -51,57 +155,537 @@ void put_file_handler::save_request_content (connection_ptr connection, path fil
   const int CONTENT_READ_TIMEOUT = connection->server()->configuration().get<int> ("request-content-read-timeout", 300);
   connection->set_deadline_timer (CONTENT_READ_TIMEOUT);
 
-  // Retrieving Content-Length of request.
-  size_t content_length = get_content_length (connection);
-  if (content_length == 0) {
+  // Retrieving Content-Length of request, unless content is chunked, at which point we don't know its length in advance.
+  const bool chunked = has_chunked_content ();
+  size_t content_length = chunked ? 0 : get_content_length (connection);
+  if (content_length == 0 && !chunked) {
 
     // This is a logical error.
     request()->write_error_response (connection, 500);
   } else {
 
     // Creating file, to pass in as shared_ptr, to make sure it stays valid, until process is finished.
-    auto file_ptr = make_shared<std::ofstream> (filename.string () + ".partial", ios::binary | ios::trunc | ios::out);
+    // The file is hidden, such that clients can never address it, and unique, such that concurrent PUTs of the same file never share it.
+    const string partial_filename = temporary_filename (filename, "put");
+    auto file_ptr = open_content_file (connection, partial_filename, async_file::open_mode::write);
+    if (!file_ptr) {
+
+      // Couldn't create file.
+      request()->write_error_response (connection, 500);
+      return;
+    }
+
+    // Reserving disc space for entire file up front if we know its size, such that it stays unfragmented.
+    if (!chunked)
+      file_ptr->preallocate (0, content_length);
 
-    // Creating an input stream wrapping the asio stream buffer.
-    auto ss_ptr = make_shared<istream> (&connection->buffer());
+    // Hashing content as it arrives if server is configured to deduplicate uploads.
+    if (connection->server()->configuration().get<bool> ("put-deduplicate", false))
+      file_ptr->enable_hashing ();
 
-    // Creating exceptional_executor, to make sure file becomes deleted, unless entire operation succeeds.
-    exceptional_executor x ([file_ptr, filename] () {
+    // Creating exceptional_executor, to make sure temporary file becomes deleted, unless entire operation succeeds.
+    exceptional_executor x ([file_ptr, partial_filename] () {
 
       // Closing existing file pointer, and deleting file, since operation was not successful.
       file_ptr->close ();
       boost::system::error_code ec;
-      boost::filesystem::remove (filename, ec);
+      boost::filesystem::remove (partial_filename, ec);
     });
 
+    // Invoked when entire content has been saved.
+    auto on_saved = [this, connection, file_ptr, filename, partial_filename, on_success] () {
+
+      // Checking if content should be deduplicated, at which point it is linked into place from the content-addressed store.
+      if (file_ptr->is_hashing ()) {
+        link_from_store (connection, file_ptr->digest (), partial_filename, filename, on_success);
+        return;
+      }
+
+      // Renaming file from its temporary name, and returning success to client, once the new name of file is as durable as its content.
+      rename_into_place (connection, partial_filename, filename, [this, connection, on_success] () {
+        write_success_envelope (connection, on_success);
+      });
+    };
+
     // Invoking implementation, that reads from socket, and saves to file.
-    save_request_content_to_file (connection, file_ptr, ss_ptr, content_length, x, [this, connection, filename, on_success] () {
+    if (chunked) {
 
-      // Renaming file from its temporary name.
-      boost::filesystem::rename (filename.string () + ".partial", filename);
+      // Decoding chunks as they arrive.
+      save_chunked_content (connection, file_ptr, 0, x, on_saved);
+    } else {
 
-      // Returning success to client.
-      write_success_envelope (connection, on_success);
+      // Content-Length is known.
+      save_content (connection, file_ptr, content_length, x, [this, connection, file_ptr, on_saved] (exceptional_executor x) {
+        content_saved (connection, file_ptr, x, on_saved);
+      });
+    }
+  }
+}
+
+
+void put_file_handler::append_request_content (connection_ptr connection, path filename, std::function<void()> on_success)
+{
+  // Setting deadline timer for content read.
+  const int CONTENT_READ_TIMEOUT = connection->server()->configuration().get<int> ("request-content-read-timeout", 300);
+  connection->set_deadline_timer (CONTENT_READ_TIMEOUT);
+
+  // Making sure request has content, which is either chunked, or has a Content-Length.
+  if (!has_chunked_content () && get_content_length (connection) == 0) {
+
+    // This is a logical error.
+    request()->write_error_response (connection, 500);
+    return;
+  }
+
+  // Serializing appends to the same file, such that content of different requests never ends up interleaved in it.
+  connection->server()->append_locks().async_lock (filename.string (), [this, connection, filename, on_success] (path_lock::holder lock) {
+
+    // Making sure connection is closed, if preparing file throws an exception.
+    exceptional_executor x ([connection] () { connection->close (); });
+
+    // Preparing file on disc I/O thread, since copying it might be slow.
+    auto original_size = std::make_shared<size_t> (0);
+    connection->server()->disk_io().post ([filename, original_size] () {
+
+      // A deduplicated file shares its content with the content-addressed store, and possibly other files, hence it gets its own copy
+      // before we change it. Notice, hard_link_count returns -1 if file does not exist.
+      boost::system::error_code ec;
+      const size_t links = boost::filesystem::hard_link_count (filename, ec);
+      if (!ec && links > 1) {
+        const string copy_filename = (filename.parent_path () / ("." + filename.filename ().string () + ".link.partial")).string ();
+        file_copy::copy (filename, copy_filename);
+        boost::filesystem::rename (copy_filename, filename);
+      }
+
+      // Remembering size of file, such that we can undo a failed append.
+      *original_size = boost::filesystem::file_size (filename, ec);
+      if (ec)
+        *original_size = 0;
+
+    }, [this, connection, filename, original_size, lock, x, on_success] () {
+
+      // Releasing exception helper, and appending content to file.
+      x.release ();
+      append_content (connection, filename, *original_size, lock, on_success);
     });
+  });
+}
+
+
+void put_file_handler::append_content (connection_ptr connection,
+                                       path filename,
+                                       size_t original_size,
+                                       path_lock::holder lock,
+                                       std::function<void()> on_success)
+{
+  // Opening file append only, such that content ends up at its end, even if something besides us writes to it.
+  auto file_ptr = open_content_file (connection, filename.string (), async_file::open_mode::append_only);
+  if (!file_ptr) {
+
+    // Couldn't open file.
+    request()->write_error_response (connection, 500);
+    return;
+  }
+
+  // Creating exceptional_executor, to make sure we cut away whatever was appended, unless entire operation succeeds.
+  // Notice, lock is kept until file has been restored.
+  exceptional_executor x ([file_ptr, original_size, lock] () {
+
+    // There is nothing more we can do if truncating file fails too.
+    int result = ::ftruncate (file_ptr->native_handle (), original_size);
+    (void) result;
+    file_ptr->close ();
+  });
+
+  // Invoked when entire content has been appended.
+  auto on_saved = [this, connection, lock, on_success] () {
+    connection->server()->open_files().invalidate (request()->envelope().path());
+    write_success_envelope (connection, on_success);
+  };
+
+  // Invoking implementation, that reads from socket, and saves to file.
+  if (has_chunked_content ()) {
+
+    // Decoding chunks as they arrive.
+    save_chunked_content (connection, file_ptr, 0, x, on_saved);
+  } else {
+
+    // Content-Length is known, hence we can reserve disc space for it.
+    const size_t content_length = get_content_length (connection);
+    file_ptr->preallocate (original_size, content_length);
+    save_content (connection, file_ptr, content_length, x, [this, connection, file_ptr, on_saved] (exceptional_executor x) {
+      content_saved (connection, file_ptr, x, on_saved);
+    });
+  }
+}
+
+
+void put_file_handler::save_range_content (connection_ptr connection,
+                                           path filename,
+                                           const string & content_range,
+                                           std::function<void()> on_success)
+{
+  // Making things more tidy in here.
+  using namespace std;
+
+  // Setting deadline timer for content read.
+  const int CONTENT_READ_TIMEOUT = connection->server()->configuration().get<int> ("request-content-read-timeout", 300);
+  connection->set_deadline_timer (CONTENT_READ_TIMEOUT);
+
+  // Parsing range, making sure request contains exactly the bytes of its range, and nothing if it is a query.
+  // Notice, a range must end before the total length of upload, which parse_content_range verifies.
+  bool query = false;
+  size_t start = 0, end = 0, total = 0;
+  if (has_chunked_content () || !parse_content_range (content_range, query, start, end, total)) {
+
+    // Malformed Content-Range, or chunked content, which we cannot know matches range.
+    request()->write_error_response (connection, 400);
+    return;
   }
+  const size_t content_length = get_content_length (connection);
+  if (content_length != (query ? 0 : end - start + 1)) {
+
+    // Content-Length does not match range.
+    request()->write_error_response (connection, 400);
+    return;
+  }
+
+  // Making sure the entire upload does not exceed max request content length, and not only this range of it.
+  if (total > get_max_content_length (connection)) {
+
+    // Notice, this destroys "this", hence we return immediately.
+    request()->write_error_response (connection, 413);
+    return;
+  }
+
+  // The upload is identified by a hidden partial file next to the file being uploaded, derived from its path. Temporary files of other
+  // requests end with another suffix, and clients cannot address hidden files, hence nothing else ever writes to it, or removes it.
+  // Whatever it contains, is what we have committed of the upload so far.
+  const string partial_filename = (filename.parent_path () / ("." + filename.filename ().string () + ".upload.partial")).string ();
+
+  // The total length of upload is remembered in another hidden file when its first range arrives, such that later ranges of the same
+  // upload cannot disagree with it.
+  const string total_filename = (filename.parent_path () / ("." + filename.filename ().string () + ".upload.total.partial")).string ();
+
+  // Serializing ranges of the same upload, such that a client reconnecting while its old request is still alive, never has both
+  // requests append to it at once. The lock is held until range is appended, and a completed upload is renamed into place.
+  connection->server()->append_locks().async_lock (filename.string (),
+                                                   [this, connection, filename, partial_filename, total_filename, query, start, end, total, content_length, on_success]
+                                                   (path_lock::holder lock) {
+
+    // Making sure connection is closed, if figuring out how much we have committed throws an exception.
+    exceptional_executor x ([connection] () { connection->close (); });
+
+    // Checking size of partial file, and total length of upload, on disc I/O thread.
+    auto committed = std::make_shared<size_t> (0);
+    auto conflict = std::make_shared<bool> (false);
+    connection->server()->disk_io().post ([partial_filename, total_filename, query, total, committed, conflict] () {
+
+      boost::system::error_code ec;
+      *committed = boost::filesystem::file_size (partial_filename, ec);
+      if (ec)
+        *committed = 0;
+
+      // Comparing total length with the one remembered by earlier ranges, unless this is a new upload.
+      // If it was not remembered, for instance because the stale upload sweep removed it, we trust this range.
+      size_t remembered = 0;
+      std::ifstream in (total_filename);
+      if (*committed > 0 && in >> remembered) {
+        *conflict = remembered != total;
+      } else if (!query) {
+        std::ofstream out (total_filename, std::ios::trunc);
+        out << total;
+        if (!out)
+          throw std::runtime_error ("Couldn't remember total length of upload.");
+      }
+
+    }, [this, connection, filename, partial_filename, total_filename, query, start, end, total, content_length, committed, conflict, lock, x, on_success] () {
+
+      // Making sure all ranges of upload agree about its total length.
+      x.release ();
+      if (*conflict) {
+
+        // Notice, this destroys "this", hence we return immediately.
+        request()->write_error_response (connection, 400);
+        return;
+      }
+
+      // Checking if client only wants to know where to resume its upload from.
+      if (query) {
+        write_committed_range (connection, 204, *committed, on_success);
+        return;
+      }
+
+      // Range must continue exactly where the committed part of the upload ends.
+      if (start != *committed) {
+
+        // Since we have not read the content of the request, we close connection once client knows where to resume from.
+        write_committed_range (connection, 416, *committed, [connection] () { connection->close (); });
+        return;
+      }
+
+      // Opening partial file for appending range to it.
+      auto file_ptr = open_content_file (connection, partial_filename, async_file::open_mode::append);
+      if (!file_ptr) {
+
+        // Couldn't open file.
+        request()->write_error_response (connection, 500);
+        return;
+      }
+
+      // Reserving disc space for range.
+      file_ptr->preallocate (start, content_length);
+
+      // Contrary to a normal PUT, we keep the partial file if something goes wrong, such that client can resume its upload later.
+      exceptional_executor x2 ([file_ptr, lock] () {
+        file_ptr->close ();
+      });
+
+      // Appending content to partial file.
+      save_content (connection, file_ptr, content_length, x2, [this, connection, file_ptr, filename, partial_filename, total_filename, end, total, lock, on_success] (exceptional_executor x) {
+
+        content_saved (connection, file_ptr, x, [this, connection, filename, partial_filename, total_filename, end, total, lock, on_success] () {
+
+          // Checking if this was the last range of upload.
+          if (end + 1 == total) {
+
+            // Upload is complete, renaming file from its temporary name, and forgetting its total length, on disc I/O thread.
+            exceptional_executor x ([connection] () { connection->close (); });
+            connection->server()->disk_io().post ([partial_filename, total_filename, filename] () {
+
+              boost::filesystem::rename (partial_filename, filename);
+              boost::system::error_code ec;
+              boost::filesystem::remove (total_filename, ec);
+
+            }, [this, connection, filename, lock, x, on_success] () {
+
+              // Returning success to client, once the new name of file is durable, making sure we forget whatever we knew about it.
+              x.release ();
+              connection->server()->open_files().invalidate (filename);
+              make_rename_durable (connection, filename, [this, connection, lock, on_success] () {
+                write_success_envelope (connection, on_success);
+              });
+            });
+          } else {
+
+            // Telling client how much we have, such that it can send the next range.
+            write_committed_range (connection, 204, end + 1, on_success);
+          }
+        });
+      });
+    });
+  });
 }
 
 
-void put_file_handler::save_request_content_to_file (connection_ptr connection,
-                                                     std::shared_ptr<std::ofstream> file_ptr,
-                                                     std::shared_ptr<std::istream> ss_ptr,
-                                                     size_t content_length,
-                                                     exceptional_executor x,
-                                                     std::function<void()> on_success)
+void put_file_handler::write_committed_range (connection_ptr connection, int status_code, size_t committed, std::function<void()> on_success)
 {
-  // Making sure we read content in chunks of BUFFER_SIZE (8192 bytes) from stream buffer.
-  size_t chunk_size = content_length > BUFFER_SIZE ? BUFFER_SIZE : content_length;
-  content_length = content_length > BUFFER_SIZE ? content_length - BUFFER_SIZE : 0;
+  // Writing status code.
+  write_status (connection, status_code, [this, connection, status_code, committed, on_success] () {
+
+    // Writing standard headers to client.
+    write_standard_headers (connection, [this, connection, status_code, committed, on_success] () {
+
+      // Range header is only written if we have committed anything, since an empty range cannot be expressed.
+      // Notice, a 204 response never has content, and must not have a Content-Length header either.
+      collection headers;
+      if (status_code != 204)
+        headers.push_back (collection_type {"Content-Length", "0"});
+      if (committed > 0)
+        headers.push_back (collection_type {"Range", "bytes=0-" + boost::lexical_cast<string> (committed - 1)});
+
+      // Writing headers, and making sure we close envelope.
+      write_headers (connection, headers, [this, connection, on_success] () {
+        ensure_envelope_finished (connection, on_success);
+      });
+    });
+  });
+}
+
+
+void put_file_handler::save_chunked_content (connection_ptr connection,
+                                             shared_ptr<async_file> file_ptr,
+                                             size_t content_length,
+                                             exceptional_executor x,
+                                             std::function<void()> on_success)
+{
+  // Reading chunk size line, which might contain chunk extensions after a ";", which we ignore.
+  read_chunk_line (connection, [this, connection, file_ptr, content_length, x, on_success] (const string & line) {
+
+    // Parsing chunk size, which is a hexadecimal number.
+    const string size_str = boost::algorithm::trim_copy (line.substr (0, line.find (';')));
+    if (size_str.empty () || size_str.size () > sizeof (size_t) * 2 || size_str.find_first_not_of ("0123456789abcdefABCDEF") != string::npos) {
+
+      // Malformed chunk.
+      connection->close ();
+      return;
+    }
+    const size_t chunk_size = std::stoull (size_str, nullptr, 16);
+
+    // Checking if this is the last chunk.
+    if (chunk_size == 0) {
+
+      // Skipping trailers, if any, before we're done.
+      skip_chunk_trailers (connection, file_ptr, x, on_success);
+      return;
+    }
+
+    // Making sure content does not exceed max request content length, even though we don't know its total length in advance.
+    if (chunk_size > get_max_content_length (connection) - content_length) {
+
+      // Notice, this destroys "this", hence we return immediately.
+      request()->write_error_response (connection, 413);
+      return;
+    }
+
+    // Saving chunk data to file.
+    save_content (connection, file_ptr, chunk_size, x, [this, connection, file_ptr, content_length, chunk_size, on_success] (exceptional_executor x) {
+
+      // Chunk data is followed by CRLF.
+      read_chunk_line (connection, [this, connection, file_ptr, content_length, chunk_size, x, on_success] (const string & line) {
+
+        if (!line.empty ()) {
+
+          // Malformed chunk.
+          connection->close ();
+        } else {
+
+          // Reading next chunk.
+          save_chunked_content (connection, file_ptr, content_length + chunk_size, x, on_success);
+        }
+      });
+    });
+  });
+}
+
+
+void put_file_handler::skip_chunk_trailers (connection_ptr connection,
+                                            shared_ptr<async_file> file_ptr,
+                                            exceptional_executor x,
+                                            std::function<void()> on_success)
+{
+  // Reading trailer lines, until we see the empty line terminating the content.
+  read_chunk_line (connection, [this, connection, file_ptr, x, on_success] (const string & line) {
+
+    if (line.empty ())
+      content_saved (connection, file_ptr, x, on_success);
+    else
+      skip_chunk_trailers (connection, file_ptr, x, on_success);
+  });
+}
+
+
+void put_file_handler::read_chunk_line (connection_ptr connection, std::function<void(const string & line)> on_line)
+{
+  // Reading until LF, making sure a malicious client cannot make us buffer an infinite line.
+  match_condition match (MAX_CHUNK_LINE_LENGTH);
+  connection->socket().async_read_until (connection->buffer(), match, [connection, match, on_line] (auto error, auto bytes_read) {
+
+    // Checking for socket errors, or a line that is too long.
+    if (error || match.has_error ()) {
+
+      // Something went wrong.
+      connection->close();
+      return;
+    }
+
+    // Retrieving line, without its CR/LF.
+    std::istream stream (&connection->buffer());
+    string line;
+    std::getline (stream, line);
+    if (!line.empty () && line.back () == '\r')
+      line.pop_back ();
+    on_line (line);
+  });
+}
+
+
+void put_file_handler::save_content (connection_ptr connection,
+                                     shared_ptr<async_file> file_ptr,
+                                     size_t content_length,
+                                     exceptional_executor x,
+                                     functor on_written)
+{
+  // Checking if we read parts of the content while reading the envelope, and if not, reading content from socket.
+  size_t buffered = std::min (connection->buffer().size(), content_length);
+  if (buffered == 0) {
+    save_socket_content (connection, file_ptr, content_length, x, on_written);
+    return;
+  }
+
+  // Writing buffered content directly from connection's buffer to file.
+  file_ptr->async_write (buffer (connection->buffer().data(), buffered),
+                         [this, connection, file_ptr, content_length, buffered, x, on_written] (auto error, auto bytes_written) {
+
+    // Checking for file errors.
+    if (error) {
+
+      // Something went wrong, making sure we close connection, which will also delete file, since "x" is not released.
+      connection->close();
+    } else {
+
+      // Removing written content from buffer, and reading the rest of the content from socket.
+      connection->buffer().consume (buffered);
+      if (content_length == buffered)
+        on_written (x);
+      else
+        save_socket_content (connection, file_ptr, content_length - buffered, x, on_written);
+    }
+  });
+}
+
+
+void put_file_handler::save_socket_content (connection_ptr connection,
+                                            shared_ptr<async_file> file_ptr,
+                                            size_t content_length,
+                                            exceptional_executor x,
+                                            functor on_written)
+{
+  // SSL sockets needs to decrypt content in user space, hence we can only splice content from plain sockets.
+  // In addition, creating a pipe is not worth it for small amounts of content, such as small chunks of a chunked request.
+  // Neither can we splice content we need to hash, since we would never see it, nor content appended to a file opened append only.
+  if (!connection->is_secure () && !file_ptr->is_hashing () && !file_ptr->is_append_only () && content_length >= SPLICE_THRESHOLD) {
+
+    auto pipe_ptr = std::make_shared<splice_pipe> (std::min (content_length, SPLICE_PIPE_CAPACITY));
+    if (pipe_ptr->is_supported ()) {
+
+      // Making sure socket never blocks when we splice from it.
+      error_code ec;
+      static_cast<rosetta_socket_plain &> (connection->socket ()).socket ().native_non_blocking (true, ec);
+      if (!ec) {
+
+        // Splice bypasses the write-behind buffer of file, hence we must write whatever is pending in it first.
+        file_ptr->async_flush ([this, connection, file_ptr, pipe_ptr, content_length, x, on_written] (auto error, auto bytes_written) {
+
+          // Checking for file errors.
+          if (error)
+            connection->close();
+          else
+            splice_content_to_file (connection, file_ptr, pipe_ptr, content_length, x, on_written);
+        });
+        return;
+      }
+    }
+  }
+
+  // Falling back to reading content into user space.
+  read_content_to_file (connection, file_ptr, content_length, x, on_written);
+}
+
+
+void put_file_handler::read_content_to_file (connection_ptr connection,
+                                             shared_ptr<async_file> file_ptr,
+                                             size_t content_length,
+                                             exceptional_executor x,
+                                             functor on_written)
+{
+  // Making sure we read content in chunks of CONTENT_CHUNK_SIZE from socket.
+  size_t chunk_size = std::min (content_length, CONTENT_CHUNK_SIZE);
 
   // Reading next chunk from socket.
   connection->socket().async_read (connection->buffer(),
-                                     transfer_exactly (chunk_size),
-                                     [this, connection, file_ptr, ss_ptr, content_length, x, on_success] (auto error, auto bytes_read) {
+                                   transfer_exactly (chunk_size),
+                                   [this, connection, file_ptr, content_length, chunk_size, x, on_written] (auto error, auto bytes_read) {
 
     // Checking for socket errors.
     if (error) {
@@ -110,37 +694,319 @@ void put_file_handler::save_request_content_to_file (connection_ptr connection,
       connection->close();
     } else {
 
-      // Making sure we close connection, in case an exception occurs.
-      exceptional_executor x2 ([connection] () { connection->close(); });
+      // Writing chunk directly from connection's buffer to file.
+      file_ptr->async_write (buffer (connection->buffer().data(), chunk_size),
+                             [this, connection, file_ptr, content_length, chunk_size, x, on_written] (auto error, auto bytes_written) {
+
+        // Checking for file errors.
+        if (error) {
+
+          // Something went wrong, making sure we close connection, which will also delete file, since "x" is not released.
+          connection->close();
+          return;
+        }
+
+        // Removing written content from buffer, and checking if we have more bytes to read, and if so, invoke self.
+        connection->buffer().consume (chunk_size);
+        if (content_length > chunk_size)
+          read_content_to_file (connection, file_ptr, content_length - chunk_size, x, on_written);
+        else
+          on_written (x);
+      });
+    }
+  });
+}
 
-      // Then reading from wrapped input stream, and flushing to output file.
-      ss_ptr->readsome (_file_buffer.data(), _file_buffer.size());
-      file_ptr->write (_file_buffer.data(), ss_ptr->gcount ());
 
-      // Checking if we have more bytes to read, and if so, invoke self.
-      if (content_length > 0) {
+void put_file_handler::splice_content_to_file (connection_ptr connection,
+                                               shared_ptr<async_file> file_ptr,
+                                               shared_ptr<splice_pipe> pipe_ptr,
+                                               size_t content_length,
+                                               exceptional_executor x,
+                                               functor on_written)
+{
+  // Waiting for socket to become readable.
+  auto & socket = static_cast<rosetta_socket_plain &> (connection->socket ()).socket ();
+  socket.async_wait (socket_base::wait_read, [this, connection, file_ptr, pipe_ptr, content_length, x, on_written] (const error_code & error) {
 
-        // Reading next chunk.
-        save_request_content_to_file (connection, file_ptr, ss_ptr, content_length, x, on_success);
+    // Checking for socket errors.
+    if (error) {
 
-      } else {
+      // Something went wrong.
+      connection->close();
+      return;
+    }
 
-        // Releasing "delete file exceptional_executor".
-        x.release();
+    // Moving as much as the pipe can hold from socket into pipe.
+    error_code ec;
+    auto & socket = static_cast<rosetta_socket_plain &> (connection->socket ()).socket ();
+    size_t moved = pipe_ptr->fill (socket.native_handle (), std::min (content_length, pipe_ptr->capacity ()), ec);
+    if (ec == error::would_block) {
 
-        // Closing output file.
-        file_ptr->close ();
+      // Spurious wake up, waiting for socket again.
+      splice_content_to_file (connection, file_ptr, pipe_ptr, content_length, x, on_written);
+      return;
+    } else if (ec || moved == 0) {
 
-        // Invoking functor callback supplied by caller.
-        on_success ();
+      // Something went wrong, or client closed socket before sending all content.
+      connection->close();
+      return;
+    }
+
+    // Moving content from pipe into file on disc I/O thread, since this might block on disc.
+    auto result = std::make_shared<error_code> ();
+    connection->server()->disk_io().post ([file_ptr, pipe_ptr, moved, result] () {
+
+      pipe_ptr->drain (file_ptr->native_handle (), moved, *result);
+
+    }, [this, connection, file_ptr, pipe_ptr, content_length, moved, result, x, on_written] () {
+
+      // Checking for file errors.
+      if (*result) {
+
+        // Something went wrong, making sure we close connection, which will also delete file, since "x" is not released.
+        connection->close();
+      } else if (content_length > moved) {
+
+        // More content to read.
+        splice_content_to_file (connection, file_ptr, pipe_ptr, content_length - moved, x, on_written);
+      } else {
+
+        // Done.
+        on_written (x);
       }
+    });
+  });
+}
+
+
+void put_file_handler::content_saved (connection_ptr connection,
+                                      shared_ptr<async_file> file_ptr,
+                                      exceptional_executor x,
+                                      std::function<void()> on_success)
+{
+  // Writing whatever is still pending in write-behind buffer of file.
+  file_ptr->async_flush ([this, connection, file_ptr, x, on_success] (auto error, auto bytes_written) {
+
+    // Checking for file errors.
+    if (error) {
+
+      // Something went wrong, making sure we close connection, which will also clean up file, since "x" is not released.
+      connection->close();
+      return;
+    }
+
+    // Making sure content is durable, before caller renames file, and returns success to client.
+    make_durable (connection, file_ptr, x, [connection, file_ptr, on_success] (exceptional_executor x) {
+
+      // Making sure we close connection, in case an exception occurs.
+      exceptional_executor x2 ([connection] () { connection->close(); });
+
+      // Releasing "clean up file exceptional_executor".
+      x.release();
+
+      // Closing output file.
+      file_ptr->close ();
+
+      // Invoking functor callback supplied by caller.
+      on_success ();
 
       // Releasing exception helper.
       x2.release();
+    });
+  });
+}
+
+
+void put_file_handler::link_from_store (connection_ptr connection,
+                                        array<unsigned char, 20> digest,
+                                        const string & partial_filename,
+                                        path filename,
+                                        std::function<void()> on_success)
+{
+  // Figuring out where blob lives in store, using the first two characters of its hash as folder, to keep folders small.
+  const char * HEX = "0123456789abcdef";
+  string hash;
+  for (auto idx : digest) {
+    hash.push_back (HEX [idx >> 4]);
+    hash.push_back (HEX [idx & 15]);
+  }
+  const path blob = connection->server()->blob_store () / hash.substr (0, 2) / hash;
+
+  // Making sure connection is closed, if linking file throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Checking if we should verify that content is identical to blob, which reads both of them, or trust their hash and size.
+  const bool verify = connection->server()->configuration().get<bool> ("put-deduplicate-verify", true);
+
+  // Linking file on disc I/O thread.
+  connection->server()->disk_io().post ([partial_filename, filename, blob, verify] () {
+
+    // Adding content to store as a new blob if we don't have it, by linking the uploaded file into store.
+    // If that fails, for instance because another upload added the same blob in the meantime, file simply isn't shared.
+    boost::filesystem::create_directories (blob.parent_path ());
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists (blob)) {
+      boost::filesystem::create_hard_link (partial_filename, blob, ec);
+      boost::filesystem::rename (partial_filename, filename);
+      return;
     }
+
+    // Sharing existing blob only if it has the exact same content, and only if this doesn't make file older than it was,
+    // since file inherits the modification date of blob, and clients might otherwise keep a cached copy of its previous content.
+    // Content is only read back and compared if sizes match, and not at all if server is configured to trust hash and size.
+    const bool newer = !boost::filesystem::exists (filename) ||
+      boost::filesystem::last_write_time (filename) < boost::filesystem::last_write_time (blob);
+    if (newer && (verify ? same_content (partial_filename, blob) :
+                  boost::filesystem::file_size (partial_filename) == boost::filesystem::file_size (blob))) {
+
+      // Linking blob into place through a temporary link, such that an existing file is atomically replaced.
+      const path link = temporary_filename (filename, "link");
+      boost::filesystem::create_hard_link (blob, link, ec);
+      if (!ec) {
+        boost::filesystem::rename (link, filename);
+        boost::filesystem::remove (partial_filename);
+        return;
+      }
+    }
+
+    // Storing uploaded file as it is, since blob can't be shared, can't have more links, or was removed by the stale blob sweep.
+    boost::filesystem::rename (partial_filename, filename);
+
+  }, [this, connection, filename, x, on_success] () {
+
+    // Returning success to client once the link is durable, making sure we forget whatever we knew about file.
+    x.release ();
+    connection->server()->open_files().invalidate (filename);
+    make_rename_durable (connection, filename, [this, connection, on_success] () {
+      write_success_envelope (connection, on_success);
+    });
+  });
+}
+
+
+void put_file_handler::rename_into_place (connection_ptr connection,
+                                          const string & partial_filename,
+                                          path filename,
+                                          std::function<void()> on_success)
+{
+  // Making sure connection is closed, if renaming file throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
+
+  // Renaming file on disc I/O thread, since a rename might block on the file system journal.
+  connection->server()->disk_io().post ([partial_filename, filename] () {
+
+    boost::filesystem::rename (partial_filename, filename);
+
+  }, [this, connection, filename, x, on_success] () {
+
+    // Making sure we forget whatever we knew about file, and invoking callback once its new name is durable.
+    x.release ();
+    connection->server()->open_files().invalidate (filename);
+    make_rename_durable (connection, filename, on_success);
+  });
+}
+
+
+void put_file_handler::make_durable (connection_ptr connection, shared_ptr<async_file> file_ptr, exceptional_executor x, functor on_durable)
+{
+  // Checking how durable server is configured to make content, before it returns success to client.
+  const string durability = connection->server()->configuration().get<string> ("put-durability", "none");
+  if (durability == "group") {
+
+    // Letting file join the current batch of files being made durable, which keeps file open until batch is synced.
+    connection->server()->group_commit().async_commit (file_ptr->native_handle (), [connection, file_ptr, x, on_durable] (const error_code & error) {
+
+      // Checking for file errors.
+      if (error)
+        connection->close();
+      else
+        on_durable (x);
+    });
+    return;
+  } else if (durability != "fdatasync") {
+
+    // Leaving it to the operating system to decide when content reaches the disc.
+    on_durable (x);
+    return;
+  }
+
+  // Flushing content of file to disc on disc I/O thread, since this blocks until disc has acknowledged the write.
+  auto result = std::make_shared<error_code> ();
+  connection->server()->disk_io().post ([file_ptr, result] () {
+
+    if (::fdatasync (file_ptr->native_handle ()) == -1)
+      *result = error_code (errno, boost::system::system_category ());
+
+  }, [connection, result, x, on_durable] () {
+
+    // Checking for file errors.
+    if (*result)
+      connection->close();
+    else
+      on_durable (x);
   });
 }
 
 
+void put_file_handler::make_rename_durable (connection_ptr connection, path filename, std::function<void()> on_durable)
+{
+  // A file renamed into place only keeps its new name after a crash once its folder is synced, hence we sync folder as well, according
+  // to the same "put-durability" setting as its content.
+  const string durability = connection->server()->configuration().get<string> ("put-durability", "none");
+  const string folder = filename.parent_path ().string ();
+  if (durability == "group") {
+
+    // Letting folder join the current batch, where it is synced only once, no matter how many files were renamed into it.
+    connection->server()->group_commit().async_commit_folder (folder, [connection, on_durable] (const error_code & error) {
+
+      // Checking for file errors.
+      if (error)
+        connection->close();
+      else
+        on_durable ();
+    });
+    return;
+  } else if (durability != "fdatasync") {
+
+    // Leaving it to the operating system to decide when folder reaches the disc.
+    on_durable ();
+    return;
+  }
+
+  // Syncing folder on disc I/O thread.
+  auto result = std::make_shared<error_code> ();
+  connection->server()->disk_io().post ([folder, result] () {
+
+    const int fd = ::open (folder.c_str (), O_RDONLY | O_DIRECTORY);
+    if (fd == -1 || ::fsync (fd) == -1)
+      *result = error_code (errno, boost::system::system_category ());
+    if (fd != -1)
+      ::close (fd);
+
+  }, [connection, result, on_durable] () {
+
+    // Checking for file errors.
+    if (*result)
+      connection->close();
+    else
+      on_durable ();
+  });
+}
+
+
+shared_ptr<async_file> put_file_handler::open_content_file (connection_ptr connection, const string & filename, async_file::open_mode mode)
+{
+  // Opening file.
+  auto file_ptr = std::make_shared<async_file> (connection->server()->service(), connection->server()->disk_io());
+  if (!file_ptr->open (filename, mode))
+    return nullptr;
+
+  // Gathering small writes, such as the content of small chunks, into larger blocks before writing them.
+  file_ptr->set_write_behind (connection->server()->configuration().get<size_t> ("put-write-behind-size", 262144));
+  return file_ptr;
+}
+
+
 } // namespace http_server
 } // namespace rosetta
@@ -16,6 +16,8 @@
  */
 
 #include <boost/filesystem.hpp>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/server.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
 #include "http_server/include/connection/handlers/put_folder_handler.hpp"
@@ -38,19 +40,33 @@ void put_folder_handler::handle (connection_ptr connection, std::function<void()
   // Retrieving URI from request.
   auto path = request()->envelope().path();
 
-  // Checking that folder does not exist.
-  if (exists (path)) {
+  // Making sure connection is closed, if creating folder throws an exception.
+  exceptional_executor x ([connection] () { connection->close (); });
 
-    // Oops, folder already exists.
-    request()->write_error_response (connection, 500);
-  } else {
+  // Creating folder on disc I/O thread, unless it already exists.
+  auto existed_ptr = std::make_shared<bool> (false);
+  connection->server()->disk_io().post ([path, existed_ptr] () {
 
-    // Creating folder.
-    create_directories (path);
+    // Checking that folder does not exist, before we create it.
+    *existed_ptr = exists (path);
+    if (!*existed_ptr)
+      create_directories (path);
 
-    // Returning success.
-    write_success_envelope (connection, on_success);
-  }
+  }, [this, connection, path, existed_ptr, x, on_success] () {
+
+    // Releasing exception helper.
+    x.release ();
+    if (*existed_ptr) {
+
+      // Oops, folder already exists.
+      request()->write_error_response (connection, 500);
+    } else {
+
+      // Returning success, making sure we forget that folder, and everything inside of it, did not exist.
+      connection->server()->open_files().invalidate (path);
+      write_success_envelope (connection, on_success);
+    }
+  });
 }
 
 
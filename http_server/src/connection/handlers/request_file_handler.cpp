@@ -15,7 +15,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <tuple>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/sendfile.h>
 #include <boost/asio.hpp>
+#include "http_server/include/server.hpp"
 #include "http_server/include/helpers/date.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
@@ -31,8 +38,19 @@ namespace rosetta {
 namespace http_server {
 
 
+const size_t request_file_handler::MIN_CHUNK_SIZE;
+
+// Largest number of bytes we ask sendfile to send at once, to give other connections a chance to run in between.
+const static size_t SENDFILE_CHUNK_SIZE = 1048576;
+
+
 request_file_handler::request_file_handler (class request * request)
-  : request_handler_base (request)
+  : request_handler_base (request),
+    _chunk_size (MIN_CHUNK_SIZE),
+    _max_chunk_size (MIN_CHUNK_SIZE),
+    _content_fd (-1),
+    _content_offset (0),
+    _content_end (0)
 { }
 
 
@@ -68,6 +86,23 @@ void request_file_handler::write_file_headers (connection_ptr connection, path f
 }
 
 
+void request_file_handler::write_file_headers (connection_ptr connection,
+                                               const string & mime_type,
+                                               uint64_t size,
+                                               std::time_t modified,
+                                               std::function<void()> on_success)
+{
+  // Building our standard response headers for a file transfer.
+  collection headers {
+    {"Content-Type", mime_type},
+    {"Content-Length", boost::lexical_cast<string> (size)},
+    {"Last-Modified", date::from_time (modified).to_string ()}};
+
+  // Writing special handler headers to connection.
+  write_headers (connection, headers, on_success);
+}
+
+
 void request_file_handler::write_file (connection_ptr connection,
                                        path filepath,
                                        unsigned int status_code,
@@ -96,18 +131,8 @@ void request_file_handler::write_file (connection_ptr connection,
           // Make sure we close envelope.
           ensure_envelope_finished (connection, [this, connection, filepath, on_success] () {
 
-            // Opening up file, as a shared_ptr, passing it into write_file(),
-            // such that file stays around, until all bytes have been written.
-            shared_ptr<std::ifstream> fs_ptr = make_shared<std::ifstream> (filepath.string (), ios::in | ios::binary);
-            if (!fs_ptr->good()) {
-
-              // Oops, couldn't open file!
-              connection->close();
-            } else {
-
-              // Writing actual file.
-              write_file (connection, fs_ptr, on_success);
-            }
+            // Opening up file, and writing it back to client.
+            open_and_write_file (connection, filepath, on_success);
           });
         });
       });
@@ -148,18 +173,8 @@ void request_file_handler::write_file (connection_ptr connection,
             // Make sure we close envelope.
             ensure_envelope_finished (connection, [this, connection, filepath, on_success] () {
 
-              // Opening up file, as a shared_ptr, passing it into write_file(),
-              // such that file stays around, until all bytes have been written.
-              shared_ptr<std::ifstream> fs_ptr = make_shared<std::ifstream> (filepath.string (), ios::in | ios::binary);
-              if (!fs_ptr->good()) {
-
-                // Oops, file couldn't open.
-                connection->close();
-              } else {
-
-                // Writing actual file.
-                write_file (connection, fs_ptr, on_success);
-              }
+              // Opening up file, and writing it back to client.
+              open_and_write_file (connection, filepath, on_success);
             });
           });
         });
@@ -169,43 +184,267 @@ void request_file_handler::write_file (connection_ptr connection,
 }
 
 
-void request_file_handler::write_file (connection_ptr connection, shared_ptr<std::ifstream> fs_ptr, std::function<void()> on_success)
+void request_file_handler::open_and_write_file (connection_ptr connection, path filepath, std::function<void()> on_success)
 {
-  // Checking if we're done.
-  if (fs_ptr->eof()) {
+  // Opening up file, as a shared_ptr, passing it into write_file(),
+  // such that file stays around, until all bytes have been written.
+  auto file_ptr = std::make_shared<async_file> (connection->server()->service(), connection->server()->disk_io());
+  if (!file_ptr->open (filepath, async_file::open_mode::read)) {
 
-    // Yup, we're done!
-    on_success ();
+    // Oops, couldn't open file!
+    connection->close();
   } else {
 
-    // Reading from file into array.
-    fs_ptr->read (_response_buffer.data(), _response_buffer.size());
+    // Writing actual file.
+    write_file (connection, file_ptr, on_success);
+  }
+}
+
 
-    // Creating a buffer from the _response_buffer std::array.
-    auto bf = buffer (_response_buffer.data(), fs_ptr->gcount());
+void request_file_handler::write_file (connection_ptr connection, shared_ptr<async_file> file_ptr, std::function<void()> on_success)
+{
+  // Reading chunks from file, making sure we pass in shared_ptr to file, such that it stays around.
+  write_chunks (connection, [file_ptr] (mutable_buffers_1 buffer, file_callback callback) {
+    file_ptr->async_read_some (buffer, callback);
+  }, on_success);
+}
 
-    // Writing buffer to socket, making sure we pass in shared_ptr to file stream, such that it stays around until we're entirely finished.
-    // Notice, this method will not read entire file into memory, but rather read 8192 bytes from the file, and flush these bytes to the
-    // socket, for then to invoke "self" multiple times, until entire file has been served over socket, back to client.
-    // This conserves memory and resources on the server, but also makes sure the file is open for a longer period.
-    // However, to make it possible to retrieve very large files, without completely exhausting the server's resources, this is our choice.
-    connection->socket().async_write (bf, [this, connection, on_success, fs_ptr] (auto error, auto bytes_written) {
 
-      // Sanity check.
-      if (error) {
+void request_file_handler::write_chunks (connection_ptr connection, chunk_reader read_chunk, std::function<void()> on_success)
+{
+  // Figuring out how large chunks we are allowed to use, and starting out with the smallest chunk size.
+  _max_chunk_size = connection->server()->configuration().get<size_t> ("response-chunk-max-size", 262144);
+  _chunk_size = MIN_CHUNK_SIZE;
 
-        // Something went wrong.
-        connection->close();
-      } else {
+  // Reading first chunk, and starting pipeline once it is ready.
+  _response_buffers [0].resize (_chunk_size);
+  read_chunk (buffer (_response_buffers [0]), [this, connection, read_chunk, on_success] (auto error, auto bytes_read) {
 
-        // So far, so good.
-        write_file (connection, fs_ptr, on_success);
-      }
+    // Checking if we're done, which might happen if file is empty.
+    if (error == error::eof) {
+
+      // Yup, we're done!
+      on_success ();
+    } else if (error) {
+
+      // Something went wrong while reading file.
+      connection->close();
+    } else {
+
+      // Starting pipeline.
+      write_chunk (connection, read_chunk, 0, bytes_read, on_success);
+    }
+  });
+}
+
+
+void request_file_handler::write_chunk (connection_ptr connection,
+                                        chunk_reader read_chunk,
+                                        size_t index,
+                                        size_t bytes,
+                                        std::function<void()> on_success)
+{
+  // Notice, this method will not read entire file into memory, but rather write the chunk we have already read to the socket,
+  // while simultaneously reading the next chunk from the file into our other buffer. This keeps both the disc and the socket busy,
+  // while still making it possible to serve very large files, without exhausting the server's resources.
+  // When both operations are done, we swap buffers, and invoke "self", until entire file has been served over socket, back to client.
+  struct pipeline_state
+  {
+    int pending = 2;
+    bool write_first = false;
+    error_code write_error;
+    error_code read_error;
+    size_t bytes_read = 0;
+  };
+  auto state = std::make_shared<pipeline_state> ();
+
+  // Invoked when both the socket write and the file read are done.
+  auto on_both_done = [this, connection, read_chunk, index, state, on_success] () {
+
+    // Checking result of operations.
+    if (state->write_error || (state->read_error && state->read_error != error::eof)) {
+
+      // Something went wrong.
+      connection->close();
+    } else if (state->read_error == error::eof) {
+
+      // Yup, we're done!
+      on_success ();
+    } else {
+
+      // Growing chunk size if client consumed chunk before disc could produce the next, up to the socket's send buffer size.
+      if (state->write_first)
+        grow_chunk_size (connection);
+
+      // So far, so good, swapping buffers.
+      write_chunk (connection, read_chunk, 1 - index, state->bytes_read, on_success);
+    }
+  };
+
+  // Writing current chunk to socket.
+  connection->socket().async_write (buffer (_response_buffers [index].data (), bytes), [state, on_both_done] (auto error, auto bytes_written) {
+
+    state->write_error = error;
+    state->write_first = state->pending == 2;
+    if (--state->pending == 0)
+      on_both_done ();
+  });
+
+  // Reading next chunk into the other buffer.
+  auto & next = _response_buffers [1 - index];
+  next.resize (_chunk_size);
+  read_chunk (buffer (next), [state, on_both_done] (auto error, auto bytes_read) {
+
+    state->read_error = error;
+    state->bytes_read = bytes_read;
+    if (--state->pending == 0)
+      on_both_done ();
+  });
+}
+
+
+void request_file_handler::write_content (connection_ptr connection, int fd, uint64_t offset, uint64_t size, std::function<void()> on_success)
+{
+  _content_fd = fd;
+  _content_offset = offset;
+  _content_end = offset + size;
+
+  // Sending content directly from file to socket, unless socket is an SSL socket, which needs to encrypt content in user space.
+  if (!connection->is_secure ()) {
+
+    // Making sure socket never blocks when we send content to it.
+    error_code ec;
+    static_cast<rosetta_socket_plain &> (connection->socket ()).socket ().native_non_blocking (true, ec);
+    if (!ec) {
+      send_content (connection, on_success);
+      return;
+    }
+  }
+
+  // Reading content at explicit offsets on the disc I/O threads, through the same pipeline we use for files we open ourselves.
+  write_chunks (connection, [this, connection] (mutable_buffers_1 buffer, file_callback callback) {
+    read_content (connection, buffer, callback);
+  }, on_success);
+}
+
+
+void request_file_handler::send_content (connection_ptr connection, std::function<void()> on_success)
+{
+  // Sending as much of content as socket accepts without blocking, at an explicit offset, since file descriptor might be shared.
+  auto & socket = static_cast<rosetta_socket_plain &> (connection->socket ()).socket ();
+  while (_content_offset < _content_end) {
+
+    off_t offset = _content_offset;
+    ssize_t sent = ::sendfile (socket.native_handle (), _content_fd, &offset, std::min<uint64_t> (_content_end - _content_offset, SENDFILE_CHUNK_SIZE));
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+
+      // Waiting for socket to become writable, before we continue sending content.
+      socket.async_wait (socket_base::wait_write, [this, connection, on_success] (const error_code & error) {
+
+        // Checking for socket errors.
+        if (error)
+          connection->close();
+        else
+          send_content (connection, on_success);
+      });
+      return;
+    } else if (sent <= 0) {
+
+      // Something went wrong, or file was truncated after we wrote its size.
+      connection->close();
+      return;
+    }
+    _content_offset += sent;
+  }
+
+  // Done with content.
+  on_success ();
+}
+
+
+void request_file_handler::read_content (connection_ptr connection, mutable_buffers_1 buffer, file_callback callback)
+{
+  // Checking if we're done, returning eof the same way async_file does.
+  if (_content_offset == _content_end) {
+    connection->server()->service().post ([callback] () {
+      callback (error::eof, 0);
     });
+    return;
+  }
+
+  // Reading next chunk on disc I/O thread, since this might block, at an explicit offset, since file descriptor might be shared.
+  const int fd = _content_fd;
+  const uint64_t offset = _content_offset;
+  const size_t size = std::min<uint64_t> (buffer_size (buffer), _content_end - _content_offset);
+  auto result = std::make_shared<std::tuple<error_code, size_t>> ();
+  connection->server()->disk_io().post ([fd, offset, buffer, size, result] () {
+
+    // Reading from file, retrying if we're interrupted by a signal.
+    ssize_t bytes_read;
+    do {
+      bytes_read = ::pread (fd, buffer_cast<char*> (buffer), size, offset);
+    } while (bytes_read == -1 && errno == EINTR);
+
+    // Notice, running out of file before the end of content means file was truncated after we wrote its size, which is an error.
+    if (bytes_read == -1)
+      std::get<0> (*result) = error_code (errno, boost::system::system_category ());
+    else if (bytes_read == 0)
+      std::get<0> (*result) = boost::system::errc::make_error_code (boost::system::errc::io_error);
+    else
+      std::get<1> (*result) = bytes_read;
+
+  }, [this, result, callback] () {
+
+    // Moving past chunk, and invoking callback on network thread.
+    _content_offset += std::get<1> (*result);
+    callback (std::get<0> (*result), std::get<1> (*result));
+  });
+}
+
+
+void request_file_handler::grow_chunk_size (connection_ptr connection)
+{
+  // Never growing beyond the socket's send buffer, since the client can't consume more than that in one go anyway.
+  size_t limit = std::min (_max_chunk_size, std::max (connection->socket().send_buffer_size (), MIN_CHUNK_SIZE));
+  _chunk_size = std::min (_chunk_size * 2, limit);
+}
+
+
+bool request_file_handler::should_write_file (std::time_t modified)
+{
+  // Checking if client passed in an "If-Modified-Since" header.
+  string if_modified_since = request()->envelope().header ("If-Modified-Since").c_str();
+  if (if_modified_since != "") {
+
+    // We have an "If-Modified-Since" HTTP header, file should only be written if it was tampered with since that date.
+    return date::from_time (modified) > date::parse (if_modified_since);
+  } else {
+
+    // Client sent no "If-Modified-Since" header, hence we should write file back to client.
+    return true;
   }
 }
 
 
+void request_file_handler::write_304_response (connection_ptr connection, std::function<void()> on_success)
+{
+  // Writing status code 304 (Not-Modified) back to client.
+  write_status (connection, 304, [this, connection, on_success] () {
+
+    // Writing standard HTTP headers to connection.
+    write_standard_headers (connection, [this, connection, on_success] () {
+
+      // Making sure we close envelope.
+      ensure_envelope_finished (connection, [on_success] () {
+
+        // invoking callback, since we're done writing the response.
+        on_success ();
+      });
+    });
+  });
+}
+
+
 string request_file_handler::get_mime (connection_ptr connection, path filename)
 {
   // Then we do a lookup into the configuration for our server, to see if it has defined a MIME type for the given file's extension.
@@ -34,64 +34,97 @@ namespace http_server {
 
 
 request_handler_base::request_handler_base (class request * request)
-  : _request (request)
+  : _request (request),
+    _close_connection (false)
 { }
 
 
-void request_handler_base::write_status (connection_ptr connection, unsigned int status_code, std::function<void()> on_success)
+string request_handler_base::status_line (unsigned int status_code)
 {
-  // Creating status line, and serializing to socket, making sure status_line stays around until after write operation is finished.
-  shared_ptr<string> status_line = make_shared<string> ("HTTP/1.1 " + boost::lexical_cast<string> (status_code) + " ");
+  // Creating status line, according to status code.
+  string status_line = "HTTP/1.1 " + boost::lexical_cast<string> (status_code) + " ";
   switch (status_code) {
   case 200:
-    *status_line += "OK";
+    status_line += "OK";
+    break;
+  case 202:
+    status_line += "Accepted";
+    break;
+  case 204:
+    status_line += "No Content";
     break;
   case 304:
-    *status_line += "Not Modified";
+    status_line += "Not Modified";
     break;
   case 307:
-    *status_line += "Moved Temporarily";
+    status_line += "Moved Temporarily";
+    break;
+  case 400:
+    status_line += "Bad Request";
     break;
   case 401:
-    *status_line += "Unauthorized";
+    status_line += "Unauthorized";
     break;
   case 403:
-    *status_line += "Forbidden";
+    status_line += "Forbidden";
     break;
   case 404:
-    *status_line += "Not Found";
+    status_line += "Not Found";
     break;
   case 405:
-    *status_line += "Method Not Allowed";
+    status_line += "Method Not Allowed";
+    break;
+  case 409:
+    status_line += "Conflict";
+    break;
+  case 411:
+    status_line += "Length Required";
+    break;
+  case 412:
+    status_line += "Precondition Failed";
     break;
   case 413:
-    *status_line += "Request Header Too Long";
+    status_line += "Request Header Too Long";
     break;
   case 414:
-    *status_line += "Request-URI Too Long";
+    status_line += "Request-URI Too Long";
+    break;
+  case 415:
+    status_line += "Unsupported Media Type";
+    break;
+  case 416:
+    status_line += "Range Not Satisfiable";
     break;
   case 500:
-    *status_line += "Internal Server Error";
+    status_line += "Internal Server Error";
     break;
   case 501:
-    *status_line += "Not Implemented";
+    status_line += "Not Implemented";
     break;
   default:
     if (status_code > 200 && status_code < 300) {
 
       // Some sort of unknown success status.
-      *status_line += "Unknown Success Type";
+      status_line += "Unknown Success Type";
     } else if (status_code >= 300 && status_code < 400) {
 
       // Some sort of unknown redirection status.
-      *status_line += "Unknown Redirection Type";
+      status_line += "Unknown Redirection Type";
     } else {
 
       // Some sort of unknown error type.
-      *status_line += "Unknown Error Type";
+      status_line += "Unknown Error Type";
     } break;
   }
-  *status_line += "\r\n";
+  status_line += "\r\n";
+  return status_line;
+}
+
+
+void request_handler_base::write_status (connection_ptr connection, unsigned int status_code, std::function<void()> on_success)
+{
+  // Creating status line, and serializing to socket, making sure status_line stays around until after write operation is finished.
+  shared_ptr<string> status_line = make_shared<string> (request_handler_base::status_line (status_code));
 
   // Writing status line to socket.
   connection->socket().async_write (buffer (*status_line), [this, connection, on_success, status_line] (auto error, auto bytes_written) {
@@ -159,25 +192,48 @@ void request_handler_base::write_header (connection_ptr connection, const string
 
 
 void request_handler_base::write_standard_headers (connection_ptr connection, std::function<void()> on_success)
+{
+  // Creating header, making sure the string stays around until after socket write operation is finished.
+  // First we add up the "Date" header, which should be returned with every single request, regardless of its type.
+  shared_ptr<string> header_content = make_shared<string> ("Date: " + date::now_string () + "\r\n");
+  *header_content += standard_headers (connection->server()->configuration());
+  if (_close_connection)
+    *header_content += "Connection: close\r\n";
+
+  // Writing header content to socket.
+  connection->socket().async_write (buffer (*header_content), [this, connection, on_success, header_content] (auto error, auto bytes_written) {
+
+    // Sanity check.
+    if (error) {
+
+      // Something went wrong.
+      connection->close();
+    } else {
+
+      // So far, so good.
+      on_success ();
+    }
+  });
+}
+
+
+string request_handler_base::standard_headers (const configuration & configuration)
 {
   // Making things more tidy in here.
   using namespace std;
   using namespace boost::algorithm;
-
-  // Creating header, making sure the string stays around until after socket write operation is finished.
-  // First we add up the "Date" header, which should be returned with every single request, regardless of its type.
-  shared_ptr<string> header_content = make_shared<string> ("Date: " + date::now ().to_string () + "\r\n");
+  string result;
 
   // Making sure we submit the server name back to client, if server is configured to do this.
   // Notice, even if server configuration says that server should identify itself, we do not provide any version information!
   // This is to make it harder to create a "targeted attack" trying to hack the server.
-  if (connection->server()->configuration().get<bool> ("provide-server-info", false))
-    *header_content += "Server: Rosetta\r\n";
+  if (configuration.get<bool> ("provide-server-info", false))
+    result += "Server: Rosetta\r\n";
 
   // Checking if server is configured to render "static headers".
   // Notice that static headers are defined as a pipe separated (|) list of strings, with both name and value of header, for instance
   // "Foo: bar|Howdy-World: circus". The given example would render two static headers, "Foo" and "Howdy-World", with their respective values.
-  const string static_headers = connection->server()->configuration().get <string> ("static-response-headers", "");
+  const string static_headers = configuration.get <string> ("static-response-headers", "");
   if (static_headers.size() > 0) {
 
     // Server is configured to render "static headers".
@@ -185,24 +241,10 @@ void request_handler_base::write_standard_headers (connection_ptr connection, st
     vector<string> headers;
     split (headers, static_headers, boost::is_any_of ("|"));
     for (auto & idx : headers) {
-      *header_content += idx + "\r\n";
+      result += idx + "\r\n";
     }
   }
-
-  // Writing header content to socket.
-  connection->socket().async_write (buffer (*header_content), [this, connection, on_success, header_content] (auto error, auto bytes_written) {
-
-    // Sanity check.
-    if (error) {
-
-      // Something went wrong.
-      connection->close();
-    } else {
-
-      // So far, so good.
-      on_success ();
-    }
-  });
+  return result;
 }
 
 
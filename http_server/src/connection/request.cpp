@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/algorithm/string.hpp>
 #include "common/include/exceptional_executor.hpp"
 #include "http_server/include/connection/request.hpp"
 #include "http_server/include/connection/connection.hpp"
@@ -34,6 +35,15 @@ request::request ()
 { }
 
 
+void request::reset ()
+{
+  // Notice, envelope must release its references to our arena, before we can rewind arena.
+  _request_handler.reset ();
+  _envelope.reset ();
+  _memory.reset ();
+}
+
+
 void request::handle (connection_ptr connection)
 {
   // Reading envelope.
@@ -45,19 +55,32 @@ void request::handle (connection_ptr connection)
     // Killing deadline timer while we handle request.
     connection->set_deadline_timer (-1);
     _request_handler = create_request_handler (connection, this);
-    _request_handler->handle (connection, [this, connection] () {
 
-      // Request is now finished handled, and we need to determine if we should keep connection alive or not.
-      if (_envelope.header ("Connection") == "close") {
+    // A handler that does not read the content client declared, leaves it on the socket, where it would be taken for the next request,
+    // hence connection is closed once its response is written, which client is told about.
+    if (!_request_handler->reads_content () && has_content ())
+      _request_handler->close_connection ();
 
-        // Closing connection
-        connection->close();
-      } else {
+    // Checking if client wants our approval before it sends its content, and if handler is going to read the content.
+    // If handler is not going to read content, such as when request is refused, its final response is written immediately instead,
+    // and the client never sends its content.
+    if (_request_handler->reads_content () && boost::algorithm::iequals (_envelope.header ("Expect").c_str(), "100-continue")) {
 
-        // Keep-Alive Connection.
-        connection->handle();
-      }
-    });
+      // Telling client to send its content.
+      static const string CONTINUE_RESPONSE = "HTTP/1.1 100 Continue\r\n\r\n";
+      connection->socket().async_write (buffer (CONTINUE_RESPONSE), [this, connection] (auto error, auto bytes_written) {
+
+        // Sanity check.
+        if (error)
+          connection->close ();
+        else
+          handle_request (connection);
+      });
+    } else {
+
+      // Handling request immediately.
+      handle_request (connection);
+    }
 
     // Releasing exception helper.
     x.release();
@@ -65,6 +88,30 @@ void request::handle (connection_ptr connection)
 }
 
 
+void request::handle_request (connection_ptr connection)
+{
+  // Making sure connection is closed, in case an exception occurs.
+  exceptional_executor x ([connection] () {connection->close ();});
+
+  _request_handler->handle (connection, [this, connection] () {
+
+    // Request is now finished handled, and we need to determine if we should keep connection alive or not.
+    if (_envelope.header ("Connection") == "close" || _request_handler->closes_connection ()) {
+
+      // Closing connection
+      connection->close();
+    } else {
+
+      // Keep-Alive Connection.
+      connection->handle();
+    }
+  });
+
+  // Releasing exception helper.
+  x.release();
+}
+
+
 void request::write_error_response (connection_ptr connection, int status_code)
 {
   // Making sure connection is closed, in case an exception occurs.
@@ -72,6 +119,7 @@ void request::write_error_response (connection_ptr connection, int status_code)
 
   // Creating an error handler.
   _request_handler = create_request_handler (connection, this, status_code);
+  _request_handler->close_connection ();
   _request_handler->handle (connection, [this, connection] () {
 
     // Closing connection on everything that are error requests.
@@ -83,5 +131,12 @@ void request::write_error_response (connection_ptr connection, int status_code)
 }
 
 
+bool request::has_content () const
+{
+  const arena_string & content_length = _envelope.header ("Content-Length");
+  return (content_length.size () > 0 && content_length != "0") || _envelope.header ("Transfer-Encoding").size () > 0;
+}
+
+
 } // namespace http_server
 } // namespace rosetta
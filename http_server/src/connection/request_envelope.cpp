@@ -17,7 +17,6 @@
 
 #include <cctype>
 #include <algorithm>
-#include <boost/algorithm/string.hpp>
 #include "common/include/base64.hpp"
 #include "common/include/exceptional_executor.hpp"
 #include "http_server/include/server.hpp"
@@ -36,11 +35,14 @@ using std::string;
 using namespace boost::asio;
 using namespace rosetta::common;
 
-/// Returns the next line from the given stream buffer.
-string get_line (streambuf & buffer);
+/// Auto-Capitalize HTTP header names, in place.
+void capitalize_header_name (arena_string & name);
 
-/// Auto-Capitalize HTTP header names.
-string capitalize_header_name (const string & name);
+/// Trims away spaces and tabs from both ends of the given range.
+void trim_range (const char *& begin, const char *& end);
+
+/// Returns true if the given range only contains non-control US ASCII characters.
+bool is_printable (const char * begin, const char * end);
 
 /// Makes sure URI is "sane", and does not contain "/../", etc.
 bool sanity_check_path (path uri);
@@ -48,7 +50,11 @@ bool sanity_check_path (path uri);
 
 request_envelope::request_envelope (request * request)
   : _request (request),
-    _folder_request (false)
+    _method (request->memory()),
+    _folder_request (false),
+    _http_version (request->memory()),
+    _headers (request->memory()),
+    _parameters (request->memory())
 { }
 
 
@@ -76,7 +82,7 @@ void request_envelope::read (connection_ptr connection, std::function<void()> on
       exceptional_executor x ([connection] () {connection->close ();});
 
       // Parsing request line, and verifying it's OK.
-      parse_request_line (connection, get_line (connection->buffer()));
+      parse_request_line (connection, get_line (connection));
 
       // Reading headers.
       read_headers (connection, on_success);
@@ -88,9 +94,25 @@ void request_envelope::read (connection_ptr connection, std::function<void()> on
 }
 
 
-bool request_envelope::has_parameter (const string & name) const
+void request_envelope::reset ()
+{
+  // Swapping all arena allocated members with empty instances, such that nothing refers to the arena's memory after it is reset.
+  create_string().swap (_method);
+  create_string().swap (_http_version);
+  envelope_collection (_request->memory()).swap (_headers);
+  envelope_collection (_request->memory()).swap (_parameters);
+
+  // Resetting the rest of our members.
+  _path.clear();
+  _uri.clear();
+  _folder_request = false;
+  _ticket = authentication::ticket();
+}
+
+
+bool request_envelope::has_parameter (const char * name) const
 {
-  for (auto idx : _parameters) {
+  for (auto & idx : _parameters) {
     if (std::get<0> (idx) == name)
       return true;
   }
@@ -98,78 +120,106 @@ bool request_envelope::has_parameter (const string & name) const
 }
 
 
-void request_envelope::parse_request_line (connection_ptr connection, const string & request_line)
+const arena_string & request_envelope::parameter (const char * name) const
 {
-  // Making things slightly more tidy and comfortable in here ...
-  using namespace std;
-  using namespace boost;
-  using namespace boost::algorithm;
+  // Empty return value, used when there are no such parameter, allocated from an arena that never hands out any memory.
+  static arena EMPTY_PARAMETER_ARENA;
+  const static arena_string EMPTY_PARAMETER_VALUE (EMPTY_PARAMETER_ARENA);
 
-  // Splitting initial HTTP line into its three parts.
-  vector<string> parts;
-  split (parts, request_line, ::isspace);
+  // Looking for the parameter with the specified name.
+  for (auto & idx : _parameters) {
+    if (std::get<0> (idx) == name)
+      return std::get<1> (idx);
+  }
+  return EMPTY_PARAMETER_VALUE;
+}
 
-  // Removing all empty parts, which translates into consecutive spaces, to make logic more fault tolerant. Ref; HTTP/1.1 - 19.3.
-  parts.erase (remove (parts.begin(), parts.end(), ""), parts.end ());
 
-  // Now we can start deducting which type of request, and path, etc, this is.
-  size_t no_parts = parts.size ();
+void request_envelope::parse_request_line (connection_ptr connection, const arena_string & request_line)
+{
+  // Making things slightly more tidy and comfortable in here ...
+  using namespace std;
 
-  // At least the method and the URI needs to be supplied. The version is defaulted to HTTP/1.1, so it is actually optional.
-  // This is in accordance to the HTTP/1.1 standard; 19.3.
-  if (parts.size() < 2 || parts.size() > 3)
+  // Splitting initial HTTP line into its three parts, without creating any temporary strings.
+  // Consecutive spaces are simply skipped, to make logic more fault tolerant. Ref; HTTP/1.1 - 19.3.
+  const char * parts [3][2];
+  size_t no_parts = 0;
+  const char * idx = request_line.data();
+  const char * end = idx + request_line.size();
+  while (idx < end) {
+
+    // Skipping whitespace in front of next part.
+    while (idx < end && isspace (*idx))
+      ++idx;
+    if (idx == end)
+      break;
+
+    // At least the method and the URI needs to be supplied. The version is defaulted to HTTP/1.1, so it is actually optional.
+    // This is in accordance to the HTTP/1.1 standard; 19.3.
+    if (no_parts == 3)
+      throw request_exception ("Malformed HTTP-Request line.");
+
+    // Finding end of currently iterated part.
+    parts [no_parts][0] = idx;
+    while (idx < end && !isspace (*idx))
+      ++idx;
+    parts [no_parts++][1] = idx;
+  }
+  if (no_parts < 2)
     throw request_exception ("Malformed HTTP-Request line.");
 
   // To be more fault tolerant, according to the HTTP/1.1 standard, point 19.3, we make sure the method is in UPPERCASE.
   // We also default the version to HTTP/1.1, unless it is explicitly given, and if given, we make sure it is UPPERCASE.
-  _method           = to_upper_copy (parts [0]);
-  _http_version     = no_parts > 2 ? to_upper_copy (parts [2]) : "HTTP/1.1";
+  _method.assign (parts [0][0], parts [0][1]);
+  transform (_method.begin(), _method.end(), _method.begin(), ::toupper);
+  if (no_parts > 2) {
+    _http_version.assign (parts [2][0], parts [2][1]);
+    transform (_http_version.begin(), _http_version.end(), _http_version.begin(), ::toupper);
+  } else {
+    _http_version = "HTTP/1.1";
+  }
 
   // Then, at last, we parse the URI.
-  parse_uri (connection, parts [1]);
+  parse_uri (connection, parts [1][0], parts [1][1]);
 }
 
 
-void request_envelope::parse_uri (connection_ptr connection, string uri)
+void request_envelope::parse_uri (connection_ptr connection, const char * begin, const char * end)
 {
-  if (uri [0] != '/') {
-
-    // To make sure we're more fault tolerant, we prepend the URI with "/", if it is not given. Ref; 19.3.
-    uri = "/" + uri;
-  }
-
   // Checking if URI contains HTTP GET parameters.
-  auto index_of_pars = uri.find ("?");
-  if (index_of_pars != string::npos) {
+  const char * index_of_pars = std::find (begin, end, '?');
+  if (index_of_pars != end) {
 
     // URI contains GET parameters.
-    parse_parameters (uri.substr (index_of_pars + 1));
+    parse_parameters (index_of_pars + 1, end);
+  }
 
-    // Decoding URI.
-    uri = uri_encode::decode (uri.substr (0, index_of_pars));
-  } else {
+  // To make sure we're more fault tolerant, we prepend the URI with "/", if it is not given. Ref; 19.3.
+  arena_string uri = create_string();
+  if (*begin != '/')
+    uri.push_back ('/');
 
-    // No parameters, decoding URI.
-    uri = uri_encode::decode (uri);
-  }
+  // Decoding URI, without its parameters.
+  uri_encode::decode (begin, index_of_pars, uri);
 
   // Verify URI does not contain any characters besides the non-control US ASCII characters.
-  for (auto & idx : uri) {
-    if (idx < 32 || idx > 126)
-      throw request_exception ("Illegal characters found in path.");
-  }
+  if (!is_printable (uri.data(), uri.data() + uri.size()))
+    throw request_exception ("Illegal characters found in path.");
 
   // Then setting path, URI and folder/file-type of request.
-  _uri = uri;
+  _uri = uri.c_str();
 
   // Checking if this is a folder request, or a GET request for a folder's default document.
-  if (has_parameter ("list") && uri.back() == '/')
+  // Notice, a DELETE request for a folder, a PUT of an archive into a folder, or a GET of a folder as an archive, or of many of its files
+  // at once, might end with a "/" too.
+  if ((has_parameter ("list") || has_parameter ("extract") || has_parameter ("archive") || has_parameter ("multi") || _method == "DELETE") &&
+      uri.back() == '/')
     _folder_request = true;
   else if (uri.back() == '/' && _method == "GET")
-    uri += connection->server()->configuration().get<string> ("default-document", "index.html");
+    uri += connection->server()->configuration().get<string> ("default-document", "index.html").c_str();
 
   _path = connection->server()->configuration().get<string> ("www-root", "www-root");
-  _path += uri;
+  _path += uri.c_str();
   if (_folder_request) {
 
     // Removing last "/" to have a "normalized" and uniform way of accessing folders inside of the file system.
@@ -206,7 +256,7 @@ void request_envelope::read_headers (connection_ptr connection, std::function<vo
       exceptional_executor x ([connection] () {connection->close ();});
 
       // Now we can start parsing HTTP headers.
-      string line = get_line (connection->buffer());
+      arena_string line = get_line (connection);
 
       // Checking if there are any more headers being sent from client.
       // When we are done reading headers, and there are no more headers, then there should be an additional empty string sent from client.
@@ -233,76 +283,80 @@ void request_envelope::read_headers (connection_ptr connection, std::function<vo
 }
 
 
-void request_envelope::parse_http_header_line (connection_ptr connection, const string & line)
+void request_envelope::parse_http_header_line (connection_ptr connection, const arena_string & line)
 {
   // Making things slightly more tidy and comfortable in here ...
   using namespace std;
-  using namespace boost;
-  using namespace boost::algorithm;
 
   // Checking if this is continuation header value of the previous line read from socket.
+  const char * begin = line.data();
+  const char * end = begin + line.size();
   if ((line [0] == ' ' || line [0] == '\t') && _headers.size() > 0) {
 
     // This is a continuation of the header value that was read in the previous line from client.
     // Appending content according to ruling of HTTP/1.1 standard.
-    get<1> (_headers.back()) += " " + trim_copy_if (line, is_any_of (" \t"));
+    trim_range (begin, end);
+    get<1> (_headers.back()).push_back (' ');
+    get<1> (_headers.back()).append (begin, end);
   } else {
 
     // Splitting header into name and value.
-    const auto equals_idx = line.find (':');
+    const char * equals_idx = find (begin, end, ':');
 
     // Retrieving header name, simply ignoring headers without a value to be more fault tolerant. (ref; 19.3 of HTTP/1.1 std)
-    if (equals_idx != string::npos) {
+    if (equals_idx != end) {
 
-      // Retrieving actual header name and value, Auto-Capitalizing header name, and trimming name/value, to be more fault tolerant. (ref; 19.3)
-      string name = capitalize_header_name (trim_copy (line.substr (0, equals_idx)));
-      string value = trim_copy (line.substr (equals_idx + 1));
+      // Retrieving actual header name and value, trimming name/value, to be more fault tolerant. (ref; 19.3)
+      const char * name_end = equals_idx;
+      const char * value_begin = equals_idx + 1;
+      trim_range (begin, name_end);
+      trim_range (value_begin, end);
+
+      // Now adding actual header into headers collection, Auto-Capitalizing its name.
+      _headers.push_back (envelope_collection_type (arena_string (begin, name_end, _request->memory()),
+                                                    arena_string (value_begin, end, _request->memory())));
+      capitalize_header_name (get<0> (_headers.back()));
 
       // Checking if this is an "Authorization" header, at which point we try to create an authentication::ticket for request.
-      if (name == "Authorization") {
+      if (get<0> (_headers.back()) == "Authorization") {
 
         // Authenticate user.
-        _headers.push_back (collection_type (name, value));
-        authenticate_client (connection, value);
-      } else {
-
-        // Now adding actual header into headers collection, before invoking callback.
-        _headers.push_back (collection_type (name, value));
+        authenticate_client (connection, get<1> (_headers.back()));
       }
     } // else; Simply ignoring HTTP headers without any value.
   }
 }
 
 
-void request_envelope::authenticate_client (connection_ptr connection, const string & header_value)
+void request_envelope::authenticate_client (connection_ptr connection, const arena_string & header_value)
 {
   // Splitting value up into its two parts.
-  std::vector<string> entities;
-  split (entities, header_value, boost::is_any_of (" "));
-  if (entities.size() != 2 || entities[0] != "Basic")
+  const char * begin = header_value.data();
+  const char * end = begin + header_value.size();
+  const char * space = std::find (begin, end, ' ');
+  if (space - begin != 5 || !std::equal (begin, space, "Basic") || std::find (space + 1, end, ' ') != end)
     throw security_exception ("Unknown authorization type found in 'Authorization' HTTP header.");
 
   // BASE64 decoding the username and password.
   std::vector<unsigned char> result;
-  base64::decode (entities[1], result);
+  base64::decode (string (space + 1, end), result);
 
   // Splitting Authorization value into username and password, and verifying syntax.
-  string username_password_string (result.begin(), result.end());
-  std::vector<string> username_password;
-  split (username_password, username_password_string, boost::is_any_of (":"));
-  if (username_password.size() != 2)
+  auto colon = std::find (result.begin(), result.end(), ':');
+  if (colon == result.end() || std::find (colon + 1, result.end(), ':') != result.end())
     throw security_exception ("Syntax error in 'Authorization' HTTP header.");
 
   // Authorizing request, passing in server's salt to hash function.
   auto server_salt = connection->server()->configuration().get<string> ("server-salt");
-  _ticket = connection->server()->authentication().authenticate (username_password [0], username_password [1], server_salt);
+  _ticket = connection->server()->authentication().authenticate (string (result.begin(), colon), string (colon + 1, result.end()), server_salt);
 }
 
 
-const string & request_envelope::header (const string & name) const
+const arena_string & request_envelope::header (const char * name) const
 {
-  // Empty return value, used when there are no such header.
-  const static string EMPTY_HEADER_VALUE = "";
+  // Empty return value, used when there are no such header, allocated from an arena that never hands out any memory.
+  static arena EMPTY_HEADER_ARENA;
+  const static arena_string EMPTY_HEADER_VALUE (EMPTY_HEADER_ARENA);
 
   // Looking for the header with the specified name.
   for (auto & idx : _headers) {
@@ -315,46 +369,44 @@ const string & request_envelope::header (const string & name) const
 }
 
 
-void request_envelope::parse_parameters (const string & params)
+void request_envelope::parse_parameters (const char * begin, const char * end)
 {
-  // Splitting up into separate parameters, and looping through each parameter,
-  // removing empty parameters (two consecutive "&" immediately following each other).
-  std::vector<string> pars;
-  split (pars, params, boost::is_any_of ("&"));
-  pars.erase (std::remove (pars.begin(), pars.end(), ""), pars.end ());
-
-  // Looping through each parameter.
-  for (string & idx : pars) {
-    
-    // Splitting up name/value of parameter, making sure we allow for parameters without value.
-    size_t index_of_equal = idx.find ("=");
-    string name  = uri_encode::decode (index_of_equal == string::npos ? idx : idx.substr (0, index_of_equal));
-    string value = uri_encode::decode (index_of_equal == string::npos ? "" : idx.substr (index_of_equal + 1));
-
-    // Making sure neither name nor value contains any control characters.
-    for (auto & idx : name) {
-      if (idx < 32 || idx > 126)
-        throw request_exception ("Illegal characters found in parameter.");
-    }
-    for (auto & idx : value) {
-      if (idx < 32 || idx > 126)
+  // Looping through each parameter, ignoring empty parameters (two consecutive "&" immediately following each other).
+  while (begin < end) {
+
+    // Finding end of currently iterated parameter.
+    const char * next = std::find (begin, end, '&');
+    if (next != begin) {
+
+      // Splitting up name/value of parameter, making sure we allow for parameters without value.
+      const char * index_of_equal = std::find (begin, next, '=');
+      arena_string name = create_string();
+      arena_string value = create_string();
+      uri_encode::decode (begin, index_of_equal, name);
+      if (index_of_equal != next)
+        uri_encode::decode (index_of_equal + 1, next, value);
+
+      // Making sure neither name nor value contains any control characters.
+      if (!is_printable (name.data(), name.data() + name.size()) || !is_printable (value.data(), value.data() + value.size()))
         throw request_exception ("Illegal characters found in parameter.");
+
+      _parameters.push_back (envelope_collection_type (name, value));
     }
 
-    _parameters.push_back (collection_type (name, value));
+    // Moving on to next parameter.
+    begin = next == end ? end : next + 1;
   }
 }
 
 
-/// Helper method for parsing an envelope line.
-string get_line (streambuf & buffer)
+arena_string request_envelope::get_line (connection_ptr connection)
 {
   // Making things more tidy in here.
   using namespace std;
 
-  // Reading next line from stream, and putting into vector buffer, for efficiency.
-  vector<unsigned char> vec;
-  istream stream (&buffer);
+  // Reading next line from stream, and putting into a string allocated from our arena, for efficiency.
+  arena_string return_value = create_string();
+  istream stream (&connection->buffer());
 
   // Iterating stream until CR/LF has been seen, and returning the line to caller.
   while (stream.good ()) {
@@ -367,43 +419,62 @@ string get_line (streambuf & buffer)
       continue; // Ignoring
     if (idx < 32 || idx == 127)
       throw request_exception ("Garbage data found in HTTP envelope, control character found in envelope.");
-    vec.push_back (idx);
+    return_value.push_back (idx);
   }
 
-  // Returning result to caller, by transforming vector to string, now without any CR or LF anywhere.
-  return string (vec.begin (), vec.end ());
+  // Returning result to caller, now without any CR or LF anywhere.
+  return return_value;
 }
 
 
-string capitalize_header_name (const string & name)
+arena_string request_envelope::create_string () const
 {
-  // Will hold the return value temporarily.
-  std::vector<char> return_value;
+  return arena_string (_request->memory());
+}
+
 
+void capitalize_header_name (arena_string & name)
+{
   // State machine value, used to determine if next character should be capitalized or not.
   // Starts out with being true, since the first character of an HTTP header always should be capitalized.
   bool next_is_upper = true;
 
   // Iterating through all characters in string.
-  for (auto idx : name) {
+  for (auto & idx : name) {
 
     // Checking if we should make currently character UPPERCASE or not.
     if (next_is_upper) {
 
       // Making sure the currently character is UPPERCASE.
-      return_value.push_back (toupper (idx));
+      idx = toupper (idx);
     } else {
 
       // Making sure the currently iterated character is lowercase.
-      return_value.push_back (tolower (idx));
+      idx = tolower (idx);
     }
 
     // After every "-" character in an HTTP header, the next character should be UPPERCASE.
     next_is_upper = idx == '-';
   }
+}
+
+
+void trim_range (const char *& begin, const char *& end)
+{
+  while (begin < end && (*begin == ' ' || *begin == '\t'))
+    ++begin;
+  while (end > begin && (end [-1] == ' ' || end [-1] == '\t'))
+    --end;
+}
+
 
-  // Returning to caller as string.
-  return string (return_value.begin(), return_value.end());
+bool is_printable (const char * begin, const char * end)
+{
+  for (; begin < end; ++begin) {
+    if (*begin < 32 || *begin > 126)
+      return false;
+  }
+  return true;
 }
 
 
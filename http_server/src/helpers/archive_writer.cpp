@@ -0,0 +1,341 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include "http_server/include/helpers/archive_writer.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using std::vector;
+
+// Size of blocks in a tar archive.
+const static size_t BLOCK_SIZE = 512;
+
+// Largest value that fits into the 32 bit fields of a zip archive, which signals that the actual value is in a zip64 record.
+const static uint64_t ZIP_MAX_32 = 0xffffffff;
+
+// Largest number of files that fits into the 16 bit fields of a zip archive.
+const static uint64_t ZIP_MAX_16 = 0xffff;
+
+
+// Builds the lookup table for CRC-32, as used by zip archives.
+static std::array<uint32_t, 256> create_crc_table ()
+{
+  std::array<uint32_t, 256> table;
+  for (uint32_t idx = 0; idx < 256; ++idx) {
+    uint32_t value = idx;
+    for (int bit = 0; bit < 8; ++bit)
+      value = value & 1 ? 0xedb88320 ^ (value >> 1) : value >> 1;
+    table [idx] = value;
+  }
+  return table;
+}
+
+
+// Appends little endian integers to buffer, which is how zip archives store them.
+static void put16 (vector<char> & buffer, uint16_t value)
+{
+  buffer.push_back (value & 0xff);
+  buffer.push_back (value >> 8);
+}
+
+static void put32 (vector<char> & buffer, uint32_t value)
+{
+  put16 (buffer, value & 0xffff);
+  put16 (buffer, value >> 16);
+}
+
+static void put64 (vector<char> & buffer, uint64_t value)
+{
+  put32 (buffer, value & 0xffffffff);
+  put32 (buffer, value >> 32);
+}
+
+
+// Writes value as a zero padded octal number, followed by a NUL, into a field of a tar header, using base-256 if it does not fit.
+static void put_octal (char * field, size_t size, uint64_t value)
+{
+  if (size < 12 && value >> (3 * (size - 1)) == 0) {
+    std::snprintf (field, size, "%0*llo", static_cast<int> (size - 1), static_cast<unsigned long long> (value));
+  } else if (size == 12 && value < 077777777777ULL) {
+    std::snprintf (field, size, "%011llo", static_cast<unsigned long long> (value));
+  } else {
+    for (size_t idx = size - 1; idx > 0; --idx, value >>= 8)
+      field [idx] = value & 0xff;
+    field [0] = static_cast<char> (0x80);
+  }
+}
+
+
+// Converts a time to the MS-DOS date and time used by zip archives, which cannot represent anything before 1980.
+static void dos_date_time (std::time_t time, uint16_t & dos_date, uint16_t & dos_time)
+{
+  std::tm parts;
+  localtime_r (&time, &parts);
+  if (parts.tm_year < 80) {
+    dos_date = (1 << 5) | 1;
+    dos_time = 0;
+  } else {
+    dos_date = ((parts.tm_year - 80) << 9) | ((parts.tm_mon + 1) << 5) | parts.tm_mday;
+    dos_time = (parts.tm_hour << 11) | (parts.tm_min << 5) | (parts.tm_sec / 2);
+  }
+}
+
+
+archive_writer::archive_writer (format type)
+  : _type (type),
+    _size (0),
+    _modified (0),
+    _crc (0),
+    _header_offset (0),
+    _offset (0),
+    _files (0),
+    _directory (nullptr),
+    _directory_size (0),
+    _finishing (false)
+{
+  // Zip archives keeps their central directory in an anonymous temporary file, until it is appended to the end of archive.
+  if (_type == format::zip) {
+    _directory = std::tmpfile ();
+    if (!_directory)
+      throw std::runtime_error ("Couldn't create temporary file for central directory of zip archive.");
+  }
+}
+
+
+archive_writer::~archive_writer ()
+{
+  if (_directory)
+    std::fclose (_directory);
+}
+
+
+bool archive_writer::can_store (uint64_t size) const
+{
+  return _type == format::tar || size < ZIP_MAX_32;
+}
+
+
+void archive_writer::begin_file (const string & name, uint64_t size, std::time_t modified, vector<char> & buffer)
+{
+  _name = name;
+  _size = size;
+  _modified = modified;
+  _crc = 0xffffffff;
+  if (_type == format::tar)
+    begin_tar_file (name, size, modified, buffer);
+  else
+    begin_zip_file (name, size, modified, buffer);
+}
+
+
+void archive_writer::update (const char * data, size_t size)
+{
+  static const std::array<uint32_t, 256> table = create_crc_table ();
+  for (size_t idx = 0; idx < size; ++idx)
+    _crc = table [(_crc ^ static_cast<unsigned char> (data [idx])) & 0xff] ^ (_crc >> 8);
+}
+
+
+size_t archive_writer::end_size () const
+{
+  return _type == format::tar ? (BLOCK_SIZE - _size % BLOCK_SIZE) % BLOCK_SIZE : 16;
+}
+
+
+void archive_writer::end_file (vector<char> & buffer)
+{
+  // Tar archives pads content of files to a whole number of blocks.
+  if (_type == format::tar) {
+    buffer.resize (buffer.size () + end_size (), 0);
+    return;
+  }
+
+  // Zip archives follows content with a data descriptor, containing the checksum we did not know when we wrote the local header.
+  const uint32_t crc = _crc ^ 0xffffffff;
+  put32 (buffer, 0x08074b50);
+  put32 (buffer, crc);
+  put32 (buffer, _size);
+  put32 (buffer, _size);
+  _offset += _size + 16;
+
+  // Adding file to central directory, with a zip64 extra field containing the offset of its local header, if it doesn't fit in 32 bits.
+  vector<char> record;
+  const bool zip64 = _header_offset >= ZIP_MAX_32;
+  uint16_t dos_date, dos_time;
+  dos_date_time (_modified, dos_date, dos_time);
+  put32 (record, 0x02014b50);
+  put16 (record, 0x031e); // Made by UNIX, version 3.0
+  put16 (record, zip64 ? 45 : 20);
+  put16 (record, 0x0008); // Data descriptor follows content
+  put16 (record, 0); // Stored
+  put16 (record, dos_time);
+  put16 (record, dos_date);
+  put32 (record, crc);
+  put32 (record, _size);
+  put32 (record, _size);
+  put16 (record, _name.size ());
+  put16 (record, zip64 ? 12 : 0);
+  put16 (record, 0); // Comment
+  put16 (record, 0); // Disk
+  put16 (record, 0); // Internal attributes
+  put32 (record, 0100644u << 16); // UNIX permissions
+  put32 (record, zip64 ? ZIP_MAX_32 : _header_offset);
+  record.insert (record.end (), _name.begin (), _name.end ());
+  if (zip64) {
+    put16 (record, 0x0001);
+    put16 (record, 8);
+    put64 (record, _header_offset);
+  }
+  if (std::fwrite (record.data (), 1, record.size (), _directory) != record.size ())
+    throw std::runtime_error ("Couldn't write central directory of zip archive.");
+  _directory_size += record.size ();
+  ++_files;
+}
+
+
+bool archive_writer::finish (vector<char> & buffer, size_t max)
+{
+  // Tar archives ends with two blocks of zeros.
+  if (_type == format::tar) {
+    buffer.resize (buffer.size () + BLOCK_SIZE * 2, 0);
+    return true;
+  }
+
+  // Zip archives ends with their central directory, which we read back from our temporary file, one part at the time.
+  if (!_finishing) {
+    _finishing = true;
+    if (std::fflush (_directory) != 0 || std::fseek (_directory, 0, SEEK_SET) != 0)
+      throw std::runtime_error ("Couldn't read central directory of zip archive.");
+  }
+  const size_t offset = buffer.size ();
+  buffer.resize (offset + max);
+  const size_t bytes_read = std::fread (buffer.data () + offset, 1, max, _directory);
+  buffer.resize (offset + bytes_read);
+  if (bytes_read == max)
+    return false;
+  if (std::ferror (_directory))
+    throw std::runtime_error ("Couldn't read central directory of zip archive.");
+
+  // Done with central directory, appending its end.
+  end_zip_archive (buffer);
+  return true;
+}
+
+
+void archive_writer::begin_tar_file (const string & name, uint64_t size, std::time_t modified, vector<char> & buffer)
+{
+  // Helper to append a header block to buffer, calculating its checksum.
+  auto append_header = [&buffer, modified] (const string & header_name, uint64_t header_size, char type) {
+    std::array<char, BLOCK_SIZE> header;
+    header.fill (0);
+    std::memcpy (header.data (), header_name.data (), std::min (header_name.size (), size_t (100)));
+    put_octal (header.data () + 100, 8, 0644);
+    put_octal (header.data () + 108, 8, 0);
+    put_octal (header.data () + 116, 8, 0);
+    put_octal (header.data () + 124, 12, header_size);
+    put_octal (header.data () + 136, 12, modified < 0 ? 0 : modified);
+    header [156] = type;
+    std::memcpy (header.data () + 257, "ustar", 6);
+    std::memcpy (header.data () + 263, "00", 2);
+
+    // Checksum is calculated as if the checksum field itself was filled with spaces.
+    std::memset (header.data () + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (auto c : header)
+      checksum += static_cast<unsigned char> (c);
+    std::snprintf (header.data () + 148, 8, "%06o", checksum);
+    header [155] = ' ';
+    buffer.insert (buffer.end (), header.begin (), header.end ());
+  };
+
+  // Names longer than what fits into the header are given by a preceding GNU long name.
+  if (name.size () > 100) {
+    append_header ("././@LongLink", name.size () + 1, 'L');
+    buffer.insert (buffer.end (), name.begin (), name.end ());
+    buffer.resize (buffer.size () + BLOCK_SIZE - name.size () % BLOCK_SIZE, 0);
+  }
+  append_header (name, size, '0');
+}
+
+
+void archive_writer::begin_zip_file (const string & name, uint64_t size, std::time_t modified, vector<char> & buffer)
+{
+  // Local header, where checksum is given by the data descriptor following the content, since we do not know it yet.
+  _header_offset = _offset;
+  uint16_t dos_date, dos_time;
+  dos_date_time (modified, dos_date, dos_time);
+  const size_t start = buffer.size ();
+  put32 (buffer, 0x04034b50);
+  put16 (buffer, 20);
+  put16 (buffer, 0x0008); // Data descriptor follows content
+  put16 (buffer, 0); // Stored
+  put16 (buffer, dos_time);
+  put16 (buffer, dos_date);
+  put32 (buffer, 0);
+  put32 (buffer, size);
+  put32 (buffer, size);
+  put16 (buffer, name.size ());
+  put16 (buffer, 0);
+  buffer.insert (buffer.end (), name.begin (), name.end ());
+  _offset += buffer.size () - start;
+}
+
+
+void archive_writer::end_zip_archive (vector<char> & buffer)
+{
+  // If archive is too large, or contains too many files, for the fields of the end of central directory, we add zip64 records too.
+  const uint64_t directory_offset = _offset;
+  if (_files >= ZIP_MAX_16 || directory_offset >= ZIP_MAX_32 || _directory_size >= ZIP_MAX_32) {
+
+    // Zip64 end of central directory record.
+    put32 (buffer, 0x06064b50);
+    put64 (buffer, 44);
+    put16 (buffer, 0x031e);
+    put16 (buffer, 45);
+    put32 (buffer, 0);
+    put32 (buffer, 0);
+    put64 (buffer, _files);
+    put64 (buffer, _files);
+    put64 (buffer, _directory_size);
+    put64 (buffer, directory_offset);
+
+    // Zip64 end of central directory locator.
+    put32 (buffer, 0x07064b50);
+    put32 (buffer, 0);
+    put64 (buffer, directory_offset + _directory_size);
+    put32 (buffer, 1);
+  }
+
+  // End of central directory.
+  put32 (buffer, 0x06054b50);
+  put16 (buffer, 0);
+  put16 (buffer, 0);
+  put16 (buffer, std::min (_files, ZIP_MAX_16));
+  put16 (buffer, std::min (_files, ZIP_MAX_16));
+  put32 (buffer, std::min (_directory_size, ZIP_MAX_32));
+  put32 (buffer, std::min (directory_offset, ZIP_MAX_32));
+  put16 (buffer, 0);
+}
+
+
+} // namespace http_server
+} // namespace rosetta
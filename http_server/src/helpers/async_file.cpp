@@ -0,0 +1,358 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <tuple>
+#include <memory>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "http_server/include/helpers/async_file.hpp"
+
+#if defined(BOOST_ASIO_HAS_FILE)
+#include <liburing.h>
+#endif // defined(BOOST_ASIO_HAS_FILE)
+
+namespace rosetta {
+namespace http_server {
+
+
+// Alignment of writes when write-behind is enabled, which is the block size of most file systems.
+const static size_t WRITE_BEHIND_ALIGNMENT = 4096;
+
+
+void async_file::async_write (const_buffers_1 buffer, file_callback callback)
+{
+  // Hashing content before it is written, since buffers are written in the order they are given to us.
+  if (_hasher)
+    _hasher->update (buffer_cast<const void*> (buffer), buffer_size (buffer));
+
+  // Writing directly to file if write-behind is disabled.
+  const size_t size = buffer_size (buffer);
+  if (_write_behind == 0) {
+    write_to_file (buffer, const_buffer (), callback);
+    return;
+  }
+
+  // Checking if buffer is large enough to be written without copying it.
+  const char * data = buffer_cast<const char*> (buffer);
+  if (size >= _write_behind) {
+
+    // Gathering whatever is pending with buffer in a single write, keeping only the unaligned tail of buffer pending afterwards.
+    // Notice, the tail is always smaller than buffer, since the write-behind buffer is a whole number of blocks.
+    const size_t tail = (_pending.size () + size) % WRITE_BEHIND_ALIGNMENT;
+    auto data_ptr = std::make_shared<std::vector<char>> ();
+    data_ptr->swap (_pending);
+    _pending.reserve (_write_behind + WRITE_BEHIND_ALIGNMENT);
+    _pending.assign (data + size - tail, data + size);
+    write_to_file (boost::asio::buffer (*data_ptr), const_buffer (data, size - tail), [data_ptr, callback, size] (auto error, auto bytes_written) {
+      callback (error, size);
+    });
+    return;
+  }
+
+  // Gathering buffer with whatever is already pending.
+  _pending.insert (_pending.end (), data, data + size);
+  if (_pending.size () < _write_behind) {
+
+    // Not enough content to bother writing it yet, and since buffer was copied, caller can reuse it immediately.
+    _service.post ([callback, size] () {
+      callback (error_code (), size);
+    });
+    return;
+  }
+
+  // Writing as many whole blocks as we have, keeping the rest pending, such that our writes stays aligned.
+  write_pending (_pending.size () - _pending.size () % WRITE_BEHIND_ALIGNMENT, [callback, size] (auto error, auto bytes_written) {
+    callback (error, size);
+  });
+}
+
+
+void async_file::set_write_behind (size_t size)
+{
+  // Making sure size is a whole number of blocks.
+  _write_behind = size - size % WRITE_BEHIND_ALIGNMENT;
+  _pending.reserve (_write_behind + WRITE_BEHIND_ALIGNMENT);
+}
+
+
+void async_file::enable_hashing ()
+{
+  _hasher.reset (new rosetta::common::sha1::hasher ());
+}
+
+
+void async_file::async_flush (file_callback callback)
+{
+  // Checking if there is anything to write at all.
+  if (_pending.empty ()) {
+    _service.post ([callback] () {
+      callback (error_code (), 0);
+    });
+  } else {
+    write_pending (_pending.size (), callback);
+  }
+}
+
+
+void async_file::preallocate (size_t offset, size_t length)
+{
+#if defined(__linux__)
+
+  // Keeping size of file, such that it still reflects what has actually been written, in case upload is aborted.
+  ::fallocate (native_handle (), FALLOC_FL_KEEP_SIZE, offset, length);
+#endif // defined(__linux__)
+}
+
+
+void async_file::write_pending (size_t bytes, file_callback callback)
+{
+  // Moving pending content into a shared buffer, which stays valid until write is done, keeping the tail pending.
+  auto data_ptr = std::make_shared<std::vector<char>> ();
+  data_ptr->swap (_pending);
+  _pending.reserve (_write_behind + WRITE_BEHIND_ALIGNMENT);
+  _pending.assign (data_ptr->begin () + bytes, data_ptr->end ());
+
+  // Writing blocks to file.
+  write_to_file (const_buffer (data_ptr->data (), bytes), const_buffer (), [data_ptr, callback] (auto error, auto bytes_written) {
+    callback (error, bytes_written);
+  });
+}
+
+
+async_file::async_file (io_service & service, io_worker_pool & pool)
+  : _service (service),
+    _append_only (false),
+    _write_behind (0),
+    _pool (pool),
+    _fd (-1)
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+
+  // Only creating the io_uring backed file if we can, since asio throws if it cannot create its ring.
+  if (uses_io_uring ())
+    _file.reset (new stream_file (service));
+#endif // defined(BOOST_ASIO_HAS_FILE)
+}
+
+
+async_file::~async_file ()
+{
+  close ();
+}
+
+
+bool async_file::uses_io_uring ()
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+
+  // Probing io_uring once, since it might be compiled in, yet disabled or missing in the kernel we're running on.
+  const static bool available = [] () {
+    io_uring ring;
+    if (::io_uring_queue_init (1, &ring, 0) != 0)
+      return false;
+    ::io_uring_queue_exit (&ring);
+    return true;
+  } ();
+  return available;
+#else
+  return false;
+#endif // defined(BOOST_ASIO_HAS_FILE)
+}
+
+
+bool async_file::open (const boost::filesystem::path & filepath, open_mode mode)
+{
+  _append_only = mode == open_mode::append_only;
+#if defined(BOOST_ASIO_HAS_FILE)
+  if (_file) {
+
+    // Opening file with the io_uring backed file object.
+    error_code error;
+    if (mode == open_mode::read)
+      _file->open (filepath.string (), stream_file::read_only, error);
+    else if (mode == open_mode::append)
+      _file->open (filepath.string (), stream_file::write_only | stream_file::create, error);
+    else if (mode == open_mode::append_only)
+      _file->open (filepath.string (), stream_file::write_only | stream_file::create | stream_file::append, error);
+    else
+      _file->open (filepath.string (), stream_file::write_only | stream_file::create | stream_file::truncate, error);
+
+    // Positioning file at its end if we're appending. Notice, we don't open it in append mode, since splice refuses such files.
+    if (!error && mode == open_mode::append)
+      _file->seek (0, stream_file::seek_end, error);
+    return !error;
+  }
+#endif // defined(BOOST_ASIO_HAS_FILE)
+
+  // Opening file with a normal file descriptor, since io_uring is not available.
+  if (mode == open_mode::read)
+    _fd = ::open (filepath.c_str (), O_RDONLY | O_CLOEXEC);
+  else if (mode == open_mode::append)
+    _fd = ::open (filepath.c_str (), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  else if (mode == open_mode::append_only)
+    _fd = ::open (filepath.c_str (), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  else
+    _fd = ::open (filepath.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+  // Positioning file at its end if we're appending. Notice, we don't open it with O_APPEND, since splice refuses such files.
+  if (_fd != -1 && mode == open_mode::append && ::lseek (_fd, 0, SEEK_END) == -1)
+    close ();
+  return _fd != -1;
+}
+
+
+void async_file::async_read_some (mutable_buffers_1 buffer, file_callback callback)
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+  if (_file) {
+
+    // Submitting read to ring, which returns error::eof when there is nothing more to read.
+    _file->async_read_some (buffer, callback);
+    return;
+  }
+#endif // defined(BOOST_ASIO_HAS_FILE)
+
+  // Result of operation, shared between worker thread and completion handler.
+  auto result = std::make_shared<std::tuple<error_code, size_t>> ();
+
+  // Reading from file on worker thread.
+  _pool.post ([this, buffer, result] () {
+
+    // Reading from file, retrying if we're interrupted by a signal.
+    ssize_t bytes_read;
+    do {
+      bytes_read = ::read (_fd, buffer_cast<char*> (buffer), buffer_size (buffer));
+    } while (bytes_read == -1 && errno == EINTR);
+
+    // Making sure we return eof the same way io_uring would.
+    if (bytes_read == -1)
+      std::get<0> (*result) = error_code (errno, boost::system::system_category ());
+    else if (bytes_read == 0)
+      std::get<0> (*result) = error::eof;
+    else
+      std::get<1> (*result) = bytes_read;
+
+  }, [callback, result] () {
+
+    // Invoking callback on network thread.
+    callback (std::get<0> (*result), std::get<1> (*result));
+  });
+}
+
+
+void async_file::write_to_file (const_buffer head, const_buffer tail, file_callback callback)
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+  if (_file) {
+
+    // Submitting write to ring, making sure both buffers are written entirely.
+    boost::asio::async_write (*_file, std::array<const_buffer, 2> {{head, tail}}, callback);
+    return;
+  }
+#endif // defined(BOOST_ASIO_HAS_FILE)
+
+  // Result of operation, shared between worker thread and completion handler.
+  auto result = std::make_shared<std::tuple<error_code, size_t>> ();
+
+  // Writing to file on worker thread.
+  _pool.post ([this, head, tail, result] () {
+
+    // Writing both buffers to file with a single system call, which might require multiple writes, if some of it is left.
+    iovec vectors [2] = {
+      {const_cast<void*> (buffer_cast<const void*> (head)), buffer_size (head)},
+      {const_cast<void*> (buffer_cast<const void*> (tail)), buffer_size (tail)}};
+    iovec * current = vectors;
+    int count = 2;
+    while (count > 0) {
+
+      // Skipping buffers that are entirely written.
+      if (current->iov_len == 0) {
+        ++current;
+        --count;
+        continue;
+      }
+      ssize_t bytes_written = ::writev (_fd, current, count);
+      if (bytes_written == -1) {
+        if (errno == EINTR)
+          continue;
+        std::get<0> (*result) = error_code (errno, boost::system::system_category ());
+        return;
+      }
+
+      // Advancing past whatever was written.
+      while (bytes_written > 0) {
+        const size_t step = std::min (static_cast<size_t> (bytes_written), current->iov_len);
+        current->iov_base = static_cast<char*> (current->iov_base) + step;
+        current->iov_len -= step;
+        bytes_written -= step;
+        if (current->iov_len == 0) {
+          ++current;
+          --count;
+        }
+      }
+    }
+    std::get<1> (*result) = buffer_size (head) + buffer_size (tail);
+
+  }, [callback, result] () {
+
+    // Invoking callback on network thread.
+    callback (std::get<0> (*result), std::get<1> (*result));
+  });
+}
+
+
+bool async_file::is_open () const
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+  if (_file)
+    return _file->is_open ();
+#endif // defined(BOOST_ASIO_HAS_FILE)
+  return _fd != -1;
+}
+
+
+void async_file::close ()
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+  if (_file) {
+    error_code ignored;
+    _file->close (ignored);
+  }
+#endif // defined(BOOST_ASIO_HAS_FILE)
+  if (_fd != -1) {
+    ::close (_fd);
+    _fd = -1;
+  }
+}
+
+
+int async_file::native_handle ()
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+  if (_file)
+    return _file->native_handle ();
+#endif // defined(BOOST_ASIO_HAS_FILE)
+  return _fd;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,238 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include "http_server/include/helpers/batch_extractor.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using boost::system::error_code;
+using namespace boost::filesystem;
+
+
+// Throws a filesystem_error for the given path, built from errno.
+static void throw_error (const char * what, const path & filepath)
+{
+  throw filesystem_error (what, filepath, error_code (errno, boost::system::system_category ()));
+}
+
+
+batch_extractor::batch_extractor (const path & folder, entry_filter filter, size_t max_size, bool durable)
+  : _max_size (max_size),
+    _total (0),
+    _finished (false),
+    _error (0),
+    _folder (folder),
+    _filter (filter),
+    _durable (durable),
+    _fd (-1)
+{ }
+
+
+batch_extractor::~batch_extractor ()
+{
+  if (_fd != -1)
+    ::close (_fd);
+}
+
+
+void batch_extractor::write ()
+{
+  // Doing what parse decided to do.
+  for (auto & idx : _operations) {
+    switch (idx.kind) {
+
+    case operation::type::create_folder:
+      if (create_directory (idx.path))
+        _created_folders.push_back (idx.path);
+      break;
+
+    case operation::type::open_file:
+      _fd = ::open (idx.path.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (_fd == -1)
+        throw_error ("open", idx.path);
+      break;
+
+    case operation::type::write_file: {
+      const char * data = _data.data () + idx.offset;
+      size_t left = idx.size;
+      while (left > 0) {
+        const ssize_t written = ::write (_fd, data, left);
+        if (written == -1) {
+          if (errno == EINTR)
+            continue;
+          throw_error ("write", _folder);
+        }
+        data += written;
+        left -= written;
+      }
+    } break;
+
+    case operation::type::close_file:
+      if (_durable && ::fdatasync (_fd) == -1)
+        throw_error ("fdatasync", _folder);
+      ::close (_fd);
+      _fd = -1;
+      break;
+    }
+  }
+  _operations.clear ();
+  _data.clear ();
+}
+
+
+void batch_extractor::commit (rename_journal & journal)
+{
+  // Renaming files into place, in the order they were found, such that the last one wins if a file occurs twice.
+  rename_journal::rename_list renames;
+  for (auto & idx : _entries) {
+    if (idx.status == 200 && !idx.folder)
+      renames.push_back ({idx.partial, idx.target});
+  }
+  journal.commit (renames);
+}
+
+
+void batch_extractor::rollback ()
+{
+  // Closing file we're writing to, if any.
+  if (_fd != -1) {
+    ::close (_fd);
+    _fd = -1;
+  }
+
+  // Removing partial files, followed by the folders we created, innermost first, which only succeeds if they are empty.
+  error_code ignored;
+  for (auto & idx : _entries) {
+    if (idx.status == 200 && !idx.folder)
+      remove (idx.partial, ignored);
+  }
+  for (auto idx = _created_folders.rbegin (); idx != _created_folders.rend (); ++idx)
+    remove (*idx, ignored);
+}
+
+
+bool batch_extractor::succeeded () const
+{
+  return std::all_of (_entries.begin (), _entries.end (), [] (const entry & idx) { return idx.status == 200 || idx.status == 501; });
+}
+
+
+void batch_extractor::begin_file (const string & name)
+{
+  // Figuring out where file goes, and if it can be extracted.
+  entry file {name, 0, false, path (), path ()};
+  file.status = check_entry (name, false, file.target);
+  if (file.status == 200) {
+
+    // Extracting into a hidden partial file, which is unique for each entry, in case the same file occurs twice.
+    file.partial = file.target.parent_path () / ("." + file.target.filename ().string () + "." + std::to_string (_entries.size ()) + ".extract.partial");
+    plan_folders (file.target.parent_path ());
+    _operations.push_back (operation {operation::type::open_file, file.partial, 0, 0});
+  }
+  _entries.push_back (file);
+}
+
+
+void batch_extractor::write_content (const char * data, size_t size)
+{
+  if (_entries.back ().status == 200 && size > 0) {
+    _operations.push_back (operation {operation::type::write_file, path (), _data.size (), size});
+    _data.insert (_data.end (), data, data + size);
+  }
+}
+
+
+void batch_extractor::end_file ()
+{
+  if (_entries.back ().status == 200)
+    _operations.push_back (operation {operation::type::close_file, path (), 0, 0});
+}
+
+
+void batch_extractor::begin_folder (const string & name)
+{
+  // Figuring out where folder goes, and if it can be created.
+  entry folder {name, 0, true, path (), path ()};
+  folder.status = check_entry (name, true, folder.target);
+  if (folder.status == 200)
+    plan_folders (folder.target);
+  _entries.push_back (folder);
+}
+
+
+void batch_extractor::skip_entry (const string & name, int status)
+{
+  _entries.push_back (entry {name, status, false, path (), path ()});
+}
+
+
+int batch_extractor::check_entry (const string & name, bool folder, path & target)
+{
+  // Building path of entry relative to folder, ignoring "." and empty components, and refusing anything that might escape folder,
+  // in addition to hidden files and folders, such as ".auth" files, and characters we do not accept in URIs.
+  std::vector<string> components;
+  boost::algorithm::split (components, name, boost::is_any_of ("/"));
+  path relative;
+  for (auto & idx : components) {
+    if (idx.empty () || idx == ".")
+      continue;
+    if (idx [0] == '.' || std::any_of (idx.begin (), idx.end (), [] (char c) { return c < 32 || c > 126 || c == '\\'; }))
+      return 403;
+    relative /= idx;
+  }
+  if (relative.empty ())
+    return folder ? 200 : 403; // The folder we extract into, which obviously exists.
+  target = _folder / relative;
+
+  // Files cannot replace folders, and folders cannot replace files, and existing folders need no permission to be "created".
+  error_code ec;
+  const file_status status = boost::filesystem::status (target, ec);
+  if (folder ? (exists (status) && !is_directory (status)) : is_directory (status))
+    return 403;
+  if (folder && is_directory (status))
+    return 200;
+  return _filter (target, folder);
+}
+
+
+void batch_extractor::plan_folders (const path & folder)
+{
+  // Finding all folders between folder we extract into and the given folder, that neither exists, nor will be created.
+  std::vector<path> missing;
+  for (path idx = folder; idx != _folder && idx.string ().size () > _folder.string ().size (); idx = idx.parent_path ()) {
+    if (_planned_folders.count (idx) || exists (idx))
+      break;
+    missing.push_back (idx);
+  }
+
+  // Creating them, outermost first.
+  for (auto idx = missing.rbegin (); idx != missing.rend (); ++idx) {
+    _planned_folders.insert (*idx);
+    _operations.push_back (operation {operation::type::create_folder, *idx, 0, 0});
+  }
+}
+
+
+} // namespace http_server
+} // namespace rosetta
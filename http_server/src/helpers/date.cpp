@@ -41,9 +41,29 @@ date date::now()
 }
 
 
+string date::now_string ()
+{
+  // Formatting dates is expensive, and the "Date" header of every response only changes once every second.
+  thread_local std::time_t formatted = 0;
+  thread_local string result;
+  const std::time_t current = std::time (nullptr);
+  if (current != formatted) {
+    result = from_time (current).to_string ();
+    formatted = current;
+  }
+  return result;
+}
+
+
 date date::from_path_change(path filepath)
 {
-  boost::posix_time::ptime pt = boost::posix_time::from_time_t (boost::filesystem::last_write_time (filepath));
+  return from_time (boost::filesystem::last_write_time (filepath));
+}
+
+
+date date::from_time (std::time_t time)
+{
+  boost::posix_time::ptime pt = boost::posix_time::from_time_t (time);
   return date (boost::local_time::local_date_time (pt, boost::local_time::time_zone_ptr ()));
 }
 
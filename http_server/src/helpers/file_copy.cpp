@@ -0,0 +1,211 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif // defined(__linux__)
+#include <boost/noncopyable.hpp>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/helpers/file_copy.hpp"
+
+// copy_file_range was added to glibc in version 2.27.
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define ROSETTA_HAS_COPY_FILE_RANGE
+#endif
+
+using std::string;
+using namespace boost::filesystem;
+using boost::system::error_code;
+using namespace rosetta::common;
+
+namespace rosetta {
+namespace http_server {
+namespace file_copy {
+
+// Size of buffer used when we have to copy content through user space.
+const static size_t COPY_BUFFER_SIZE = 262144;
+
+
+/// Closes file descriptor when it goes out of scope.
+class scoped_fd final : public boost::noncopyable
+{
+public:
+
+  scoped_fd (int fd) : fd (fd) { }
+  ~scoped_fd () { if (fd != -1) ::close (fd); }
+
+  const int fd;
+};
+
+
+/// Throws a filesystem_error for the given path, from the current errno.
+static void throw_error (const char * message, const path & filepath)
+{
+  throw filesystem_error (message, filepath, error_code (errno, boost::system::system_category ()));
+}
+
+
+void copy (const path & source, const path & destination)
+{
+  // Opening both files.
+  scoped_fd in (::open (source.c_str (), O_RDONLY | O_CLOEXEC));
+  if (in.fd == -1)
+    throw_error ("Couldn't open file", source);
+  scoped_fd out (::open (destination.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (out.fd == -1)
+    throw_error ("Couldn't create file", destination);
+
+  // Making sure destination is removed, unless we successfully copy the entire file.
+  exceptional_executor x ([destination] () {
+    error_code ignored;
+    remove (destination, ignored);
+  });
+
+#if defined(FICLONE)
+
+  // Cloning file, if file system supports it, which copies nothing, since blocks are shared until one of the files is changed.
+  if (::ioctl (out.fd, FICLONE, in.fd) == 0) {
+    x.release ();
+    return;
+  }
+#endif // defined(FICLONE)
+
+  // Figuring out how much we have to copy.
+  struct stat info;
+  if (::fstat (in.fd, &info) == -1)
+    throw_error ("Couldn't stat file", source);
+  size_t left = info.st_size;
+
+#if defined(ROSETTA_HAS_COPY_FILE_RANGE)
+
+  // Letting kernel copy content, which might even be offloaded to the storage device.
+  while (left > 0) {
+    ssize_t copied = ::copy_file_range (in.fd, nullptr, out.fd, nullptr, left, 0);
+    if (copied == -1) {
+
+      // Retrying if we were interrupted, and falling back to copying through user space, if file systems does not support it.
+      if (errno == EINTR)
+        continue;
+      if (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)
+        break;
+      throw_error ("Couldn't copy file", source);
+    } else if (copied == 0) {
+
+      // File was truncated while we copied it.
+      left = 0;
+    } else {
+      left -= copied;
+    }
+  }
+#endif // defined(ROSETTA_HAS_COPY_FILE_RANGE)
+
+  // Copying whatever is left through user space.
+  std::vector<char> buffer (std::min (left, COPY_BUFFER_SIZE));
+  while (left > 0) {
+
+    // Reading next chunk.
+    ssize_t bytes_read = ::read (in.fd, buffer.data (), buffer.size ());
+    if (bytes_read == -1) {
+      if (errno == EINTR)
+        continue;
+      throw_error ("Couldn't read file", source);
+    } else if (bytes_read == 0) {
+      break; // File was truncated while we copied it.
+    }
+    left -= std::min (left, static_cast<size_t> (bytes_read));
+
+    // Writing chunk.
+    const char * data = buffer.data ();
+    while (bytes_read > 0) {
+      ssize_t bytes_written = ::write (out.fd, data, bytes_read);
+      if (bytes_written == -1) {
+        if (errno == EINTR)
+          continue;
+        throw_error ("Couldn't write file", destination);
+      }
+      data += bytes_written;
+      bytes_read -= bytes_written;
+    }
+  }
+
+  // Success.
+  x.release ();
+}
+
+
+void copy_folder (const path & source, const path & destination)
+{
+  // Creating destination folder, which fails if it exists.
+  if (!create_directory (destination))
+    throw filesystem_error ("Destination folder already exists", destination, error_code (EEXIST, boost::system::system_category ()));
+
+  // Iterating folder, copying files, and recursively copying sub folders.
+  for (directory_iterator idx (source), end; idx != end; ++idx) {
+
+    // Making sure we do not copy hidden files and folders, such as access rights and partial uploads.
+    const string name = idx->path().filename().string();
+    if (name.find_first_of ('.') == 0 || idx->path().extension() == ".partial")
+      continue;
+
+    // Copying object, ignoring symbolic links, since they might point outside of folder, or even create cycles.
+    if (is_directory (idx->symlink_status ()))
+      copy_folder (idx->path(), destination / name);
+    else if (is_regular_file (idx->symlink_status ()))
+      file_copy::copy (idx->path(), destination / name);
+  }
+}
+
+
+bool contains_authorization_files (const path & folder)
+{
+  // Checking folder itself, and then recursively all of its sub folders.
+  if (exists (folder / ".auth"))
+    return true;
+  for (directory_iterator idx (folder), end; idx != end; ++idx) {
+    if (is_directory (idx->symlink_status ()) && contains_authorization_files (idx->path()))
+      return true;
+  }
+  return false;
+}
+
+
+unsigned int check_destination (const path & source, const path & destination, bool overwrite)
+{
+  // Anything can be copied or moved to a destination that does not exist.
+  const file_status status = symlink_status (destination);
+  if (!exists (status))
+    return 0;
+  if (!overwrite)
+    return 412;
+
+  // A file can only replace a file, and a folder can only replace an empty folder.
+  if (is_directory (source))
+    return is_directory (status) && is_empty (destination) ? 0 : 409;
+  return is_regular_file (status) ? 0 : 409;
+}
+
+
+} // namespace file_copy
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,88 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "http_server/include/helpers/folder_walker.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using boost::system::error_code;
+using namespace boost::filesystem;
+
+
+folder_walker::folder_walker (const path & folder)
+  : _folder (folder),
+    _started (false)
+{ }
+
+
+bool folder_walker::next (path & file, string & name)
+{
+  // Starting out with the folder itself.
+  error_code ec;
+  if (!_started) {
+    _started = true;
+    _iterators.push_back (directory_iterator (_folder, ec));
+    if (ec)
+      _iterators.clear ();
+  }
+
+  // Walking depth first, until we find a file, or run out of folders.
+  while (!_iterators.empty ()) {
+
+    // Checking if we're done with the current folder.
+    auto & current = _iterators.back ();
+    if (current == directory_iterator ()) {
+      _iterators.pop_back ();
+      continue;
+    }
+    const path object = current->path ();
+    current.increment (ec);
+    if (ec)
+      current = directory_iterator ();
+
+    // Skipping hidden objects, such as ".auth" files, and partial uploads, the same way a folder's content is listed.
+    const string filename = object.filename ().string ();
+    if (filename.find_first_of ('.') == 0 || object.extension () == ".partial")
+      continue;
+
+    // Entering folders, and returning files, while never following symbolic links, since they might point outside of folder.
+    const file_status status = symlink_status (object, ec);
+    if (ec)
+      continue;
+    if (is_directory (status)) {
+      directory_iterator child (object, ec);
+      if (!ec)
+        _iterators.push_back (child);
+    } else if (is_regular_file (status)) {
+
+      // Name of file is its path relative to folder, which we only return if it is something a client could have requested.
+      name = object.string ().substr (_folder.string ().size () + 1);
+      if (std::any_of (name.begin (), name.end (), [] (char c) { return c < 32 || c > 126; }))
+        continue;
+      file = object;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,157 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "http_server/include/helpers/group_commit.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+group_commit::group_commit (io_service & service, io_worker_pool & pool, size_t window, size_t max_files, bool use_syncfs)
+  : _pool (pool),
+    _timer (service),
+    _window (window),
+    _max_files (max_files),
+    _use_syncfs (use_syncfs),
+    _waiting (false),
+    _flushing (false)
+{ }
+
+
+void group_commit::async_commit (int fd, commit_callback callback)
+{
+  add ({fd, "", callback});
+}
+
+
+void group_commit::async_commit_folder (const std::string & folder, commit_callback callback)
+{
+  add ({-1, folder, callback});
+}
+
+
+void group_commit::add (entry value)
+{
+  // Adding entry to current batch, and checking if a batch is already being synced, at which point entry is picked up when it is done.
+  _batch.push_back (value);
+  if (_flushing)
+    return;
+
+  // Syncing batch immediately if it is full.
+  if (_batch.size () >= _max_files) {
+    flush ();
+    return;
+  }
+
+  // Opening window, unless it is already open.
+  if (!_waiting) {
+
+    _waiting = true;
+    _timer.expires_from_now (boost::posix_time::microseconds (_window));
+    _timer.async_wait ([this] (const error_code & error) {
+
+      // Window has closed, syncing batch, unless timer was aborted.
+      _waiting = false;
+      if (error != error::operation_aborted)
+        flush ();
+    });
+  }
+}
+
+
+void group_commit::flush ()
+{
+  // Checking if we're already syncing, or if there is nothing to sync.
+  if (_flushing || _batch.empty ())
+    return;
+
+  // Taking ownership of current batch, such that files committed while we sync, goes into the next batch.
+  _flushing = true;
+  auto batch = std::make_shared<std::vector<entry>> ();
+  batch->swap (_batch);
+  auto errors = std::make_shared<std::vector<error_code>> (batch->size ());
+
+  // Syncing batch on disc I/O thread.
+  const bool use_syncfs = _use_syncfs;
+  _pool.post ([batch, errors, use_syncfs] () {
+
+    // Opening every folder in batch once, remembering why if it could not be opened.
+    std::map<std::string, std::pair<int, error_code>> folders;
+    for (auto & idx : *batch) {
+      if (idx.fd != -1 || folders.find (idx.folder) != folders.end ())
+        continue;
+      const int fd = ::open (idx.folder.c_str (), O_RDONLY | O_DIRECTORY);
+      folders [idx.folder] = {fd, fd == -1 ? error_code (errno, boost::system::system_category ()) : error_code ()};
+    }
+
+    bool synced = false;
+#if defined(__linux__)
+
+    // Syncing the file system all files and folders in batch lives on once, which is cheaper than syncing each of them.
+    if (use_syncfs) {
+      const entry & first = batch->front ();
+      const int fd = first.fd != -1 ? first.fd : folders [first.folder].first;
+      error_code error = first.fd != -1 ? error_code () : folders [first.folder].second;
+      if (fd != -1 && ::syncfs (fd) == -1)
+        error = error_code (errno, boost::system::system_category ());
+      std::fill (errors->begin (), errors->end (), error);
+      synced = true;
+    }
+#endif // defined(__linux__)
+
+    // Syncing each folder in batch once, and each file in it, unless we already synced the entire file system.
+    if (!synced) {
+      for (auto & idx : folders) {
+        if (idx.second.first != -1 && ::fsync (idx.second.first) == -1)
+          idx.second.second = error_code (errno, boost::system::system_category ());
+      }
+      for (size_t idx = 0; idx < batch->size (); ++idx) {
+        const entry & current = (*batch) [idx];
+        if (current.fd == -1)
+          (*errors) [idx] = folders [current.folder].second;
+        else if (::fdatasync (current.fd) == -1)
+          (*errors) [idx] = error_code (errno, boost::system::system_category ());
+      }
+    }
+
+    // Closing folders.
+    for (auto & idx : folders) {
+      if (idx.second.first != -1)
+        ::close (idx.second.first);
+    }
+
+  }, [this, batch, errors] () {
+
+    // Batch is durable, letting every file in it know.
+    _flushing = false;
+    for (size_t idx = 0; idx < batch->size (); ++idx) {
+      (*batch) [idx].callback ((*errors) [idx]);
+    }
+
+    // Syncing files committed while we were busy, since they have already waited at least as long as the window.
+    flush ();
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
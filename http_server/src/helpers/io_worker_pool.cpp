@@ -0,0 +1,201 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "http_server/include/helpers/io_worker_pool.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+io_worker_pool::io_worker_pool (io_service & service, size_t threads, size_t max_queued)
+  : _service (service),
+    _max_queued (max_queued),
+    _stopped (false),
+    _next (0),
+    _pending (0),
+    _completed (0),
+    _total_wait (0),
+    _max_wait (0)
+{
+  // Making sure we have at least one thread, since work must never be executed on the network thread.
+  threads = std::max<size_t> (threads, 1);
+
+  // Creating queues before we start any threads, since workers steal from each others' queues.
+  for (size_t idx = 0; idx < threads; ++idx) {
+    _queues.push_back (std::unique_ptr<worker_queue> (new worker_queue ()));
+  }
+
+  // Starting workers.
+  for (size_t idx = 0; idx < threads; ++idx) {
+    _threads.push_back (std::thread ([this, idx] () { run (idx); }));
+  }
+}
+
+
+io_worker_pool::~io_worker_pool ()
+{
+  stop ();
+}
+
+
+void io_worker_pool::post (std::function<void()> work, std::function<void()> on_done)
+{
+  job item {work, on_done, std::chrono::steady_clock::now ()};
+
+  // Dropping job if pool is stopped, which only happens as server is shutting down, and io_service runs out of work.
+  if (_stopped)
+    return;
+
+  // Distributing job to the next queue, round robin.
+  auto & queue = *_queues [_next++ % _queues.size ()];
+  {
+    std::lock_guard<std::mutex> lock (queue.lock);
+    queue.jobs.push_back (std::move (item));
+    ++_pending;
+  }
+
+  // Waking up a worker, making sure we hold lock, such that the wake up is not lost, if worker is about to sleep.
+  std::lock_guard<std::mutex> lock (_lock);
+  _wakeup.notify_one ();
+}
+
+
+void io_worker_pool::when_ready (std::function<void()> resume)
+{
+  // Resuming immediately if we have room for more jobs, and nobody is waiting ahead of caller.
+  if (!saturated () && _waiting.empty ()) {
+    resume ();
+    return;
+  }
+
+  // Waiting until enough queued jobs are done.
+  _waiting.push_back (std::move (resume));
+}
+
+
+void io_worker_pool::stop ()
+{
+  // Signaling workers to stop once all queues are empty.
+  {
+    std::lock_guard<std::mutex> lock (_lock);
+    if (_stopped)
+      return;
+    _stopped = true;
+  }
+  _wakeup.notify_all ();
+
+  // Waiting for workers to finish.
+  for (auto & idx : _threads) {
+    idx.join ();
+  }
+}
+
+
+void io_worker_pool::run (size_t index)
+{
+  while (true) {
+
+    // Executing the next job, if there is one.
+    job item;
+    if (pop (index, item)) {
+      execute (item);
+      continue;
+    }
+
+    // No work, sleeping until we have more work, or pool is stopped.
+    std::unique_lock<std::mutex> lock (_lock);
+    _wakeup.wait (lock, [this] () { return _stopped || _pending > 0; });
+    if (_stopped && _pending == 0)
+      return;
+  }
+}
+
+
+bool io_worker_pool::pop (size_t index, job & result)
+{
+  // Trying our own queue first, taking the oldest job, then stealing the newest job from the other workers' queues.
+  for (size_t idx = 0; idx < _queues.size (); ++idx) {
+
+    auto & queue = *_queues [(index + idx) % _queues.size ()];
+    std::lock_guard<std::mutex> lock (queue.lock);
+    if (queue.jobs.empty ())
+      continue;
+
+    if (idx == 0) {
+      result = std::move (queue.jobs.front ());
+      queue.jobs.pop_front ();
+    } else {
+      result = std::move (queue.jobs.back ());
+      queue.jobs.pop_back ();
+    }
+    --_pending;
+    return true;
+  }
+  return false;
+}
+
+
+void io_worker_pool::execute (job & item)
+{
+  // Updating metrics.
+  size_t wait = std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now () - item.queued).count ();
+  _total_wait += wait;
+  size_t previous = _max_wait;
+  while (wait > previous && !_max_wait.compare_exchange_weak (previous, wait)) { }
+  ++_completed;
+
+  // Executing work, making sure we catch any exceptions, such that we can rethrow them on the network thread.
+  std::exception_ptr error;
+  try {
+    item.work ();
+  } catch (...) {
+    error = std::current_exception ();
+  }
+
+  // Destroying work here on the worker, before resuming on the network thread, hence work must not capture connection-owned state,
+  // since whatever it captured is released on this thread. Such state belongs in on_done, which is destroyed on the network thread.
+  item.work = nullptr;
+
+  // Resuming on the network thread.
+  auto on_done = std::move (item.on_done);
+  _service.post ([this, on_done, error] () {
+
+    // Resuming callers waiting for the queue to drain, before invoking completion handler, which might throw.
+    resume_waiting ();
+
+    // Rethrowing exception, if work failed, which leaves it to the completion handler's owner to clean up.
+    if (error)
+      std::rethrow_exception (error);
+    on_done ();
+  });
+}
+
+
+void io_worker_pool::resume_waiting ()
+{
+  // Resuming waiting callers in the order they started waiting, for as long as we have room for more jobs.
+  while (!_waiting.empty () && !saturated ()) {
+    auto resume = std::move (_waiting.front ());
+    _waiting.pop_front ();
+    resume ();
+  }
+}
+
+
+} // namespace http_server
+} // namespace rosetta
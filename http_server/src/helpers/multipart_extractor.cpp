@@ -0,0 +1,178 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include "http_server/include/helpers/uri_encode.hpp"
+#include "http_server/include/helpers/multipart_extractor.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+// Max size of the headers of a single part.
+const static size_t MAX_HEADERS_SIZE = 8192;
+
+
+multipart_extractor::multipart_extractor (const path & folder, const string & boundary, entry_filter filter, size_t max_size, bool durable)
+  : batch_extractor (folder, filter, max_size, durable),
+    _delimiter ("\r\n--" + boundary),
+    _state (state::preamble),
+    _buffer ("\r\n") // Making sure a delimiter at the very beginning of content is found, since it is not preceded by CR/LF.
+{ }
+
+
+string multipart_extractor::boundary (const string & content_type)
+{
+  // Content-Type looks like 'multipart/mixed; boundary="something"', where the quotes are optional.
+  std::vector<string> entities;
+  boost::split (entities, content_type, boost::is_any_of (";"));
+  if (!boost::iequals (boost::trim_copy (entities [0]), "multipart/mixed"))
+    return "";
+  for (auto & idx : entities) {
+    string entity = boost::trim_copy (idx);
+    if (boost::istarts_with (entity, "boundary=")) {
+      string value = entity.substr (9);
+      if (value.size () >= 2 && value.front () == '"' && value.back () == '"')
+        value = value.substr (1, value.size () - 2);
+      return value.size () <= 70 ? value : ""; // Max size of a boundary according to RFC 2046.
+    }
+  }
+  return "";
+}
+
+
+void multipart_extractor::parse (const char * data, size_t size)
+{
+  // Ignoring everything after the last part, and everything after an error.
+  if (_finished || _error != 0)
+    return;
+  _buffer.append (data, size);
+  while (!_finished && _error == 0 && parse_buffer ())
+    ;
+}
+
+
+bool multipart_extractor::parse_buffer ()
+{
+  switch (_state) {
+
+  case state::preamble:
+  case state::content: {
+
+    // Looking for the next delimiter, writing everything before it to the current file, unless we are still in the preamble.
+    const size_t pos = _buffer.find (_delimiter);
+    if (pos == string::npos) {
+
+      // Keeping whatever might be the beginning of a delimiter, and writing the rest.
+      const size_t keep = std::min (_buffer.size (), _delimiter.size () - 1);
+      const size_t bytes = _buffer.size () - keep;
+      if (_state == state::content) {
+        _total += bytes;
+        if (_total > _max_size) {
+          _error = 413;
+          return false;
+        }
+        write_content (_buffer.data (), bytes);
+      }
+      _buffer.erase (0, bytes);
+      return false;
+    }
+    if (_state == state::content) {
+      _total += pos;
+      if (_total > _max_size) {
+        _error = 413;
+        return false;
+      }
+      write_content (_buffer.data (), pos);
+      end_file ();
+    }
+    _buffer.erase (0, pos + _delimiter.size ());
+    _state = state::delimiter;
+    return true;
+  }
+
+  case state::delimiter:
+
+    // A delimiter is followed by CR/LF, or by "--" if it ends the last part.
+    if (_buffer.size () < 2)
+      return false;
+    if (_buffer.compare (0, 2, "--") == 0) {
+      _finished = true;
+      return false;
+    }
+    if (_buffer.compare (0, 2, "\r\n") != 0) {
+
+      // Malformed content.
+      _error = 400;
+      return false;
+    }
+    _buffer.erase (0, 2);
+    _state = state::headers;
+    return true;
+
+  case state::headers: {
+
+    // Headers ends with an empty line, which is the very first line, if part has no headers.
+    // Headers of part are too long if they exceed max size, whether or not we have seen their end.
+    const size_t end = _buffer.compare (0, 2, "\r\n") == 0 ? 0 : _buffer.find ("\r\n\r\n");
+    if ((end == string::npos && _buffer.size () > MAX_HEADERS_SIZE) || (end != string::npos && end > MAX_HEADERS_SIZE)) {
+      _error = 413;
+      return false;
+    }
+    if (end == string::npos)
+      return false;
+    parse_headers (_buffer.substr (0, end));
+    _buffer.erase (0, end == 0 ? 2 : end + 4);
+    _state = state::content;
+    return true;
+  }
+  }
+  return false;
+}
+
+
+void multipart_extractor::parse_headers (const string & headers)
+{
+  // Finding the name of file, which is the only header we care about.
+  std::vector<string> lines;
+  boost::split (lines, headers, boost::is_any_of ("\n"));
+  string name;
+  for (auto & idx : lines) {
+    const size_t colon = idx.find (':');
+    if (colon != string::npos && boost::iequals (boost::trim_copy (idx.substr (0, colon)), "Content-Location"))
+      name = boost::trim_copy (idx.substr (colon + 1));
+  }
+
+  // Content-Location is a URI, hence it is decoded, exactly like the path of a request, before we check it.
+  string decoded;
+  try {
+    uri_encode::decode (name.data (), name.data () + name.size (), decoded);
+  } catch (const request_exception &) {
+    _error = 400;
+    return;
+  }
+
+  // A part without a name cannot be extracted, which is exactly what begin_file() decides, since its path would be the folder itself.
+  begin_file (decoded);
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,321 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "http_server/include/helpers/open_file_cache.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+// Changes to a folder that means one of the files inside of it might have changed.
+const static uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_DELETE |
+                                   IN_DELETE_SELF | IN_MOVE_SELF;
+
+
+open_file_cache::file::file (int fd, const struct stat & info)
+  : fd (fd),
+    size (info.st_size),
+    modified (info.st_mtime),
+    _device (info.st_dev),
+    _inode (info.st_ino),
+    _modified_ns (info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec)
+{ }
+
+
+open_file_cache::file::~file ()
+{
+  ::close (fd);
+}
+
+
+open_file_cache::open_file_cache (size_t max_files, size_t max_missing, size_t validity)
+  : _max_files (max_files),
+    _max_missing (max_missing),
+    _validity (validity),
+    _inotify (max_files > 0 ? ::inotify_init1 (IN_NONBLOCK | IN_CLOEXEC) : -1),
+    _generation (0)
+{ }
+
+
+open_file_cache::~open_file_cache ()
+{
+  if (_inotify != -1)
+    ::close (_inotify);
+}
+
+
+bool open_file_cache::find (const path & filepath, file_ptr & file, bool & missing)
+{
+  // Without inotify, we cannot know when files change, hence we know nothing about them.
+  file = nullptr;
+  missing = false;
+  if (_inotify == -1)
+    return false;
+
+  // Picking up changes, before we look for file in cache, for then to check if it is still valid, stat'ing it if it has expired.
+  read_changes ();
+  const string key = filepath.string ();
+  const auto now = std::chrono::steady_clock::now ();
+  auto iter = _paths.find (key);
+  if (iter != _paths.end ()) {
+
+    auto current = iter->second;
+    struct stat info;
+    if (now >= current->expires) {
+      const class file & cached = *current->file;
+      if (::stat (key.c_str (), &info) == 0 &&
+          static_cast<uint64_t> (info.st_dev) == cached._device &&
+          static_cast<uint64_t> (info.st_ino) == cached._inode &&
+          static_cast<uint64_t> (info.st_size) == cached.size &&
+          info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec == cached._modified_ns)
+        current->expires = now + _validity;
+    }
+    if (now < current->expires) {
+
+      // Moving file to front of cache, since it was just used.
+      _entries.splice (_entries.begin (), _entries, current);
+      file = current->file;
+      return true;
+    }
+    erase (current);
+  }
+
+  // Checking if we already know that file does not exist.
+  auto missing_iter = _missing_paths.find (key);
+  if (missing_iter != _missing_paths.end ()) {
+    auto current = missing_iter->second;
+    if (now < current->expires) {
+      _missing.splice (_missing.begin (), _missing, current);
+      missing = true;
+      return true;
+    }
+    erase (current);
+  }
+  return false;
+}
+
+
+void open_file_cache::load (const path & filepath, loaded & result) const
+{
+  // Without inotify, we cannot know when files change, hence we only open them.
+  if (_inotify == -1) {
+    result.file = open_file (filepath, result.missing);
+    return;
+  }
+
+  // Watching the deepest folder of path that exists before we open file, such that whatever changes after we opened it, is seen by
+  // insert, remembering the name inside of it that would have to be created for file to exist, if it does not exist.
+  path folder = filepath.parent_path ();
+  result.name = filepath.filename ().string ();
+  while (!folder.empty ()) {
+    result.watch = ::inotify_add_watch (_inotify, folder.string ().c_str (), WATCH_MASK);
+    if (result.watch != -1 || (errno != ENOENT && errno != ENOTDIR))
+      break;
+    result.name = folder.filename ().string ();
+    folder = folder.parent_path ();
+  }
+  result.file = open_file (filepath, result.missing);
+}
+
+
+open_file_cache::file_ptr open_file_cache::insert (const path & filepath, const loaded & result)
+{
+  // Without inotify, nothing is cached.
+  if (_inotify == -1)
+    return result.file;
+
+  // Picking up changes, which might be about the file we loaded, since its folder was watched before it was opened.
+  // An open file is only cached if its own folder is watched, which it might not be, if it was created while we loaded it.
+  read_changes ();
+  const string key = filepath.string ();
+  const auto now = std::chrono::steady_clock::now ();
+  const bool cache = result.watch != -1 && result.generation == _generation &&
+    _paths.find (key) == _paths.end () && _missing_paths.find (key) == _missing_paths.end () &&
+    (result.file ? result.name == filepath.filename ().string () : result.missing && _max_missing > 0);
+  if (!cache) {
+
+    // Stopping watching folder, unless some other file in cache is inside of it.
+    if (result.watch != -1 && _watches.find (result.watch) == _watches.end ()) {
+      ::inotify_rm_watch (_inotify, result.watch);
+      ++_generation;
+    }
+    return result.file;
+  }
+
+  // Caching file, or remembering it does not exist, making sure cache never grows beyond its maximum size.
+  if (result.file) {
+    _entries.push_front ({key, result.name, result.watch, result.file, now + _validity});
+    _paths [key] = _entries.begin ();
+    _watches [result.watch].files.insert (key);
+    if (_entries.size () > _max_files)
+      erase (std::prev (_entries.end ()));
+  } else {
+    _missing.push_front ({key, result.name, result.watch, now + _validity});
+    _missing_paths [key] = _missing.begin ();
+    _watches [result.watch].missing.insert (key);
+    if (_missing.size () > _max_missing)
+      erase (std::prev (_missing.end ()));
+  }
+  return result.file;
+}
+
+
+void open_file_cache::invalidate (const path & filepath)
+{
+  // Making sure a file being loaded while we invalidate it is not cached.
+  ++_generation;
+
+  // Removing file itself, and everything inside of it, if it is a folder.
+  const string key = filepath.string ();
+  auto inside = [&key] (const string & path) {
+    return path == key || (path.size () > key.size () && path.compare (0, key.size (), key) == 0 && path [key.size ()] == '/');
+  };
+  for (auto iter = _entries.begin (); iter != _entries.end ();) {
+    auto current = iter++;
+    if (inside (current->path))
+      erase (current);
+  }
+  for (auto iter = _missing.begin (); iter != _missing.end ();) {
+    auto current = iter++;
+    if (inside (current->path))
+      erase (current);
+  }
+}
+
+
+open_file_cache::file_ptr open_file_cache::open_file (const path & filepath, bool & missing)
+{
+  // Opening without blocking, in case path is a named pipe, and verifying it is a regular file.
+  const int fd = ::open (filepath.string ().c_str (), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    missing = errno == ENOENT || errno == ENOTDIR;
+    return nullptr;
+  }
+  struct stat info;
+  if (::fstat (fd, &info) == -1 || !S_ISREG (info.st_mode)) {
+    ::close (fd);
+    return nullptr;
+  }
+  return std::make_shared<const file> (fd, info);
+}
+
+
+void open_file_cache::erase (entry_list::iterator iter)
+{
+  // Stopping watching folder, if this was the last file we cached in it.
+  auto watch = _watches.find (iter->watch);
+  if (watch != _watches.end ()) {
+    watch->second.files.erase (iter->path);
+    release_watch (watch);
+  }
+  _paths.erase (iter->path);
+  _entries.erase (iter);
+}
+
+
+void open_file_cache::erase (missing_list::iterator iter)
+{
+  // Stopping watching folder, if this was the last file we knew about in it.
+  auto watch = _watches.find (iter->watch);
+  if (watch != _watches.end ()) {
+    watch->second.missing.erase (iter->path);
+    release_watch (watch);
+  }
+  _missing_paths.erase (iter->path);
+  _missing.erase (iter);
+}
+
+
+void open_file_cache::release_watch (std::unordered_map<int, watched_folder>::iterator watch)
+{
+  if (watch->second.files.empty () && watch->second.missing.empty ()) {
+    ::inotify_rm_watch (_inotify, watch->first);
+    _watches.erase (watch);
+    ++_generation;
+  }
+}
+
+
+void open_file_cache::read_changes ()
+{
+  // Reading until inotify has nothing more to say, which for the common case of no changes, is a single system call.
+  alignas (struct inotify_event) char buffer [4096];
+  while (true) {
+
+    const ssize_t bytes = ::read (_inotify, buffer, sizeof (buffer));
+    if (bytes <= 0)
+      return;
+    ++_generation;
+
+    for (ssize_t offset = 0; offset < bytes;) {
+
+      const struct inotify_event * event = reinterpret_cast<const struct inotify_event *> (buffer + offset);
+      offset += sizeof (struct inotify_event) + event->len;
+
+      // If inotify lost track of changes, we cannot trust anything in cache.
+      if (event->mask & IN_Q_OVERFLOW) {
+        while (!_entries.empty ())
+          erase (_entries.begin ());
+        while (!_missing.empty ())
+          erase (_missing.begin ());
+        continue;
+      }
+
+      // Finding files in folder that changed, which is all of them if folder itself was moved or deleted.
+      auto watch = _watches.find (event->wd);
+      if (watch == _watches.end ())
+        continue;
+      const bool all = (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) || event->len == 0;
+      const string name = all ? "" : string (event->name);
+      std::vector<entry_list::iterator> changed;
+      for (auto & idx : watch->second.files) {
+        auto iter = _paths [idx];
+        if (all || iter->name == name)
+          changed.push_back (iter);
+      }
+
+      // Missing files only care about something being created, or moved into folder, with the name they are waiting for.
+      std::vector<missing_list::iterator> created;
+      if (all || (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+        for (auto & idx : watch->second.missing) {
+          auto iter = _missing_paths [idx];
+          if (all || iter->name == name)
+            created.push_back (iter);
+        }
+      }
+
+      // Erasing files last, since this might stop watching folder.
+      for (auto & idx : changed) {
+        erase (idx);
+      }
+      for (auto & idx : created) {
+        erase (idx);
+      }
+    }
+  }
+}
+
+
+} // namespace http_server
+} // namespace rosetta
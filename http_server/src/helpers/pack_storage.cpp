@@ -0,0 +1,142 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "http_server/include/helpers/pack_storage.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+
+pack_file::pack_file (const path & filename)
+  : _fd (::open (filename.string ().c_str (), O_RDONLY | O_CLOEXEC)),
+    _index (MAP_FAILED)
+{
+  // Making sure we close pack if it turns out to not be a valid pack.
+  if (_fd == -1)
+    throw std::runtime_error ("Couldn't open pack '" + filename.string () + "'.");
+  struct stat info;
+  if (::fstat (_fd, &info) == -1 ||
+      ::pread (_fd, &_header, sizeof (_header), 0) != sizeof (_header) ||
+      memcmp (_header.magic, pack_format::MAGIC, sizeof (_header.magic)) != 0) {
+    ::close (_fd);
+    throw std::runtime_error ("'" + filename.string () + "' is not a pack.");
+  }
+  _size = info.st_size;
+
+  // Verifying that index is inside of pack, starts at a page boundary, and has room for its records and hash table, and that hash
+  // table has at least one empty bucket, and a size that is a power of two, such that lookups always terminate.
+  // Notice, we verify that records and buckets each fit inside of index before multiplying, such that the sizes cannot overflow.
+  if (_header.index_offset % ::sysconf (_SC_PAGESIZE) != 0 ||
+      _header.index_offset > _size ||
+      _header.index_size > _size - _header.index_offset ||
+      _header.index_size == 0 ||
+      _header.buckets <= _header.records ||
+      (_header.buckets & (_header.buckets - 1)) != 0 ||
+      _header.records > _header.index_size / sizeof (pack_format::record) ||
+      _header.buckets > _header.index_size / sizeof (uint32_t) ||
+      _header.records * sizeof (pack_format::record) > _header.index_size - _header.buckets * sizeof (uint32_t)) {
+    ::close (_fd);
+    throw std::runtime_error ("Index of pack '" + filename.string () + "' is corrupt.");
+  }
+
+  // Mapping index into memory, leaving content to be read from, or sent directly from, file descriptor.
+  _index = ::mmap (nullptr, _header.index_size, PROT_READ, MAP_SHARED, _fd, _header.index_offset);
+  if (_index == MAP_FAILED) {
+    ::close (_fd);
+    throw std::runtime_error ("Couldn't map index of pack '" + filename.string () + "' into memory.");
+  }
+  _records = static_cast<const pack_format::record *> (_index);
+  _buckets = reinterpret_cast<const uint32_t *> (_records + _header.records);
+  _strings = reinterpret_cast<const char *> (_buckets + _header.buckets);
+  _strings_size = _header.index_size - _header.records * sizeof (pack_format::record) - _header.buckets * sizeof (uint32_t);
+}
+
+
+pack_file::~pack_file ()
+{
+  ::munmap (_index, _header.index_size);
+  ::close (_fd);
+}
+
+
+bool pack_file::find (const string & name, entry & result) const
+{
+  // Probing hash table linearly, starting at the bucket name hashes to, until we find name, or an empty bucket, never probing
+  // more buckets than there are.
+  const uint64_t mask = _header.buckets - 1;
+  uint64_t bucket = pack_format::hash (name.c_str (), name.size ()) & mask;
+  for (uint64_t probes = 0; probes < _header.buckets; ++probes, bucket = (bucket + 1) & mask) {
+
+    const uint32_t index = _buckets [bucket];
+    if (index == pack_format::EMPTY_BUCKET || index >= _header.records)
+      return false;
+
+    // Comparing name, after verifying it's inside of index, since we do not trust the pack any more than necessary.
+    const pack_format::record & record = _records [index];
+    if (record.name_size != name.size () ||
+        record.name_offset > _strings_size ||
+        record.name_size > _strings_size - record.name_offset ||
+        memcmp (_strings + record.name_offset, name.c_str (), name.size ()) != 0)
+      continue;
+
+    // Found it, making sure its content and MIME type is inside of pack too.
+    if (record.offset > _size ||
+        record.size > _size - record.offset ||
+        record.mime_offset > _strings_size ||
+        record.mime_size > _strings_size - record.mime_offset)
+      return false;
+    result.fd = _fd;
+    result.offset = record.offset;
+    result.size = record.size;
+    result.modified = record.modified;
+    result.mime.assign (_strings + record.mime_offset, record.mime_size);
+    return true;
+  }
+  return false;
+}
+
+
+pack_storage::pack_storage (const std::vector<path> & packs)
+{
+  for (auto & idx : packs) {
+    _packs.emplace_back (new pack_file (idx));
+  }
+}
+
+
+bool pack_storage::find (const string & name, pack_file::entry & result) const
+{
+  for (auto & idx : _packs) {
+    if (idx->find (name, result))
+      return true;
+  }
+  return false;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
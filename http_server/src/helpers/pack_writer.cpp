@@ -0,0 +1,131 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include "http_server/include/helpers/pack_writer.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+// Alignment of index, which must start at a page boundary to be memory mapped, for the largest page size in common use.
+const static uint64_t INDEX_ALIGNMENT = 65536;
+
+
+pack_writer::pack_writer (const path & filename)
+  : _filename (filename),
+    _partial (filename.string () + ".partial"),
+    _stream (_partial.string (), std::ios::binary | std::ios::trunc),
+    _finished (false)
+{
+  // Leaving room for header, which we write once we know where index is.
+  if (!_stream.good ())
+    throw std::runtime_error ("Couldn't create pack '" + _partial.string () + "'.");
+  pack_format::header header {};
+  _stream.write (reinterpret_cast<const char *> (&header), sizeof (header));
+}
+
+
+pack_writer::~pack_writer ()
+{
+  if (!_finished) {
+    _stream.close ();
+    boost::system::error_code ec;
+    remove (_partial, ec);
+  }
+}
+
+
+void pack_writer::add (const string & name, const path & file, const string & mime)
+{
+  // Making sure name is not already in pack.
+  if (!_names.insert (name).second)
+    throw std::runtime_error ("'" + name + "' was added to pack twice.");
+
+  // Creating record, storing name, and MIME type, unless we already have stored the same MIME type.
+  pack_format::record record {};
+  record.name_offset = _strings.size ();
+  record.name_size = name.size ();
+  _strings += name;
+  if (!mime.empty ()) {
+    auto iter = _mimes.find (mime);
+    if (iter == _mimes.end ()) {
+      iter = _mimes.insert ({mime, _strings.size ()}).first;
+      _strings += mime;
+    }
+    record.mime_offset = iter->second;
+    record.mime_size = mime.size ();
+  }
+  record.offset = _stream.tellp ();
+  record.modified = last_write_time (file);
+
+  // Copying content of file into pack, unless it is empty, since streaming nothing is treated as an error.
+  std::ifstream content (file.string (), std::ios::binary);
+  if (!content.good ())
+    throw std::runtime_error ("Couldn't read '" + file.string () + "'.");
+  if (content.peek () != std::ifstream::traits_type::eof ())
+    _stream << content.rdbuf ();
+  if (!_stream.good ())
+    throw std::runtime_error ("Couldn't write to pack '" + _partial.string () + "'.");
+  record.size = static_cast<uint64_t> (_stream.tellp ()) - record.offset;
+  _records.push_back (record);
+}
+
+
+void pack_writer::finish ()
+{
+  // Creating hash table, with at least twice as many buckets as there are records, to keep probe sequences short.
+  uint64_t bucket_count = 1;
+  while (bucket_count < _records.size () * 2 + 1)
+    bucket_count *= 2;
+  std::vector<uint32_t> buckets (bucket_count, pack_format::EMPTY_BUCKET);
+  for (uint32_t idx = 0; idx < _records.size (); ++idx) {
+    uint64_t bucket = pack_format::hash (_strings.c_str () + _records [idx].name_offset, _records [idx].name_size) & (bucket_count - 1);
+    while (buckets [bucket] != pack_format::EMPTY_BUCKET)
+      bucket = (bucket + 1) & (bucket_count - 1);
+    buckets [bucket] = idx;
+  }
+
+  // Padding content up to a page boundary, for then to write index.
+  pack_format::header header {};
+  memcpy (header.magic, pack_format::MAGIC, sizeof (header.magic));
+  header.records = _records.size ();
+  header.buckets = bucket_count;
+  header.index_offset = (static_cast<uint64_t> (_stream.tellp ()) + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+  header.index_size = _records.size () * sizeof (pack_format::record) + bucket_count * sizeof (uint32_t) + _strings.size ();
+  _stream.seekp (header.index_offset);
+  _stream.write (reinterpret_cast<const char *> (_records.data ()), _records.size () * sizeof (pack_format::record));
+  _stream.write (reinterpret_cast<const char *> (buckets.data ()), buckets.size () * sizeof (uint32_t));
+  _stream.write (_strings.data (), _strings.size ());
+
+  // Writing header, now that we know where index is, and renaming pack into place.
+  _stream.seekp (0);
+  _stream.write (reinterpret_cast<const char *> (&header), sizeof (header));
+  _stream.close ();
+  if (_stream.fail ())
+    throw std::runtime_error ("Couldn't write to pack '" + _partial.string () + "'.");
+  rename (_partial, _filename);
+  _finished = true;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,73 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "http_server/include/helpers/path_lock.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+path_lock::path_lock (io_service & service)
+  : _service (service)
+{ }
+
+
+void path_lock::async_lock (const std::string & path, std::function<void(holder)> on_locked)
+{
+  // Checking if somebody else holds the lock, at which point we wait in line for it.
+  auto idx = _locked.find (path);
+  if (idx != _locked.end ()) {
+    idx->second.push_back (on_locked);
+    return;
+  }
+
+  // Nobody holds the lock, hence we can take it immediately.
+  _locked [path];
+  on_locked (create_holder (path));
+}
+
+
+void path_lock::unlock (const std::string & path)
+{
+  // Checking if anybody is waiting for lock, and if not, path is no longer locked.
+  auto idx = _locked.find (path);
+  if (idx->second.empty ()) {
+    _locked.erase (idx);
+    return;
+  }
+
+  // Handing lock over to the next in line, on the io_service, since we're invoked from the destructor of the previous holder.
+  auto on_locked = idx->second.front ();
+  idx->second.pop_front ();
+  auto next = create_holder (path);
+  _service.post ([on_locked, next] () {
+    on_locked (next);
+  });
+}
+
+
+path_lock::holder path_lock::create_holder (const std::string & path)
+{
+  // The holder owns nothing but its deleter, which unlocks path when the last copy of holder is gone.
+  return holder (nullptr, [this, path] (void*) {
+    unlock (path);
+  });
+}
+
+
+} // namespace http_server
+} // namespace rosetta
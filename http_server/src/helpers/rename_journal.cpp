@@ -0,0 +1,220 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <set>
+#include <string>
+#include <chrono>
+#include <cerrno>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common/include/exceptional_executor.hpp"
+#include "http_server/include/helpers/rename_journal.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using boost::system::error_code;
+using namespace boost::filesystem;
+using namespace rosetta::common;
+
+
+// Throws a filesystem_error for the given path, built from errno.
+static void throw_error (const char * what, const path & filepath)
+{
+  throw filesystem_error (what, filepath, error_code (errno, boost::system::system_category ()));
+}
+
+
+// Flushes the given file or folder to disc.
+static void sync_path (const path & filepath, int flags)
+{
+  const int fd = ::open (filepath.c_str (), flags | O_CLOEXEC);
+  if (fd == -1)
+    throw_error ("open", filepath);
+  const int result = ::fsync (fd);
+  ::close (fd);
+  if (result == -1)
+    throw_error ("fsync", filepath);
+}
+
+
+rename_journal::rename_journal (const path & folder, bool durable)
+  : _folder (folder),
+    _durable (durable),
+    _counter (0)
+{ }
+
+
+void rename_journal::commit (const rename_list & renames)
+{
+  if (renames.empty ())
+    return;
+  std::lock_guard<std::mutex> lock (_lock);
+
+  // Writing journal, which from now on means that set will be renamed, even if server dies.
+  const path journal = write_journal (renames);
+
+  // Remembering what we have done, such that we can undo it, if renaming fails.
+  // Targets that already exists are hard linked into journal folder first, such that we can put them back.
+  std::vector<path> backups (renames.size ());
+  size_t renamed = 0;
+  exceptional_executor x ([this, &renames, &backups, &renamed, journal] () {
+
+    // Putting back what we replaced, and removing what we created, in reverse order, in case set renamed the same file twice.
+    error_code ignored;
+    while (renamed > 0) {
+      --renamed;
+      if (backups [renamed].empty ())
+        remove (renames [renamed].second, ignored);
+      else
+        rename (backups [renamed], renames [renamed].second, ignored);
+    }
+    for (auto & idx : backups) {
+      if (!idx.empty ())
+        remove (idx, ignored);
+    }
+    remove (journal, ignored);
+  });
+
+  for (auto & idx : renames) {
+    if (exists (idx.second)) {
+      backups [renamed] = journal.string () + "." + std::to_string (renamed);
+      create_hard_link (idx.second, backups [renamed]);
+    }
+    rename (idx.first, idx.second);
+    ++renamed;
+  }
+  x.release ();
+
+  // Making sure renames are durable before journal is removed, since a crash could otherwise persist the removal of journal, without
+  // some of the renames, leaving a half renamed set, and no journal to finish it from.
+  if (_durable)
+    sync_targets (renames);
+
+  // Done, removing hard links, and journal.
+  error_code ignored;
+  for (auto & idx : backups) {
+    if (!idx.empty ())
+      remove (idx, ignored);
+  }
+  remove (journal, ignored);
+  if (_durable)
+    sync_path (_folder, O_RDONLY | O_DIRECTORY);
+}
+
+
+void rename_journal::recover ()
+{
+  error_code ec;
+  if (!is_directory (_folder, ec))
+    return;
+
+  // Finishing every set that has a journal, by renaming whatever partial files are left into place.
+  std::vector<path> leftovers;
+  for (directory_iterator idx (_folder, ec), end; !ec && idx != end; idx.increment (ec)) {
+    if (idx->path ().extension () != ".journal") {
+      leftovers.push_back (idx->path ());
+      continue;
+    }
+    std::ifstream journal (idx->path ().string ());
+    string line;
+    rename_list renames;
+    while (std::getline (journal, line)) {
+      const size_t tab = line.find ('\t');
+      if (tab == string::npos)
+        continue;
+      const path partial = line.substr (0, tab);
+      renames.push_back ({partial, line.substr (tab + 1)});
+      if (exists (partial))
+        rename (partial, renames.back ().second, ec);
+    }
+    if (_durable) {
+      try {
+        sync_targets (renames);
+      } catch (filesystem_error &) {
+        continue; // Keeping journal, such that we try again the next time server starts.
+      }
+    }
+    leftovers.push_back (idx->path ());
+  }
+
+  // Removing journals, hard links to files sets replaced, and journals that were never completely written.
+  for (auto & idx : leftovers)
+    remove (idx, ec);
+  if (_durable && !leftovers.empty ())
+    sync_path (_folder, O_RDONLY | O_DIRECTORY);
+}
+
+
+void rename_journal::sync_targets (const rename_list & renames)
+{
+  // Syncing every folder files were renamed into once.
+  std::set<path> folders;
+  for (auto & idx : renames)
+    folders.insert (idx.second.parent_path ());
+  for (auto & idx : folders)
+    sync_path (idx, O_RDONLY | O_DIRECTORY);
+}
+
+
+path rename_journal::write_journal (const rename_list & renames)
+{
+  // Creating a name that is unique, also across restarts of the server.
+  const auto now = std::chrono::system_clock::now ().time_since_epoch ();
+  const string name = std::to_string (std::chrono::duration_cast<std::chrono::microseconds> (now).count ()) + "-" + std::to_string (_counter++);
+  const path temporary = _folder / (name + ".tmp");
+  const path journal = _folder / (name + ".journal");
+  create_directories (_folder);
+
+  // Writing one line for every file, with its partial name, and its target, separated by a tab, which cannot occur in paths we accept.
+  string content;
+  for (auto & idx : renames)
+    content += idx.first.string () + "\t" + idx.second.string () + "\n";
+  const int fd = ::open (temporary.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+    throw_error ("open", temporary);
+  exceptional_executor x ([fd, temporary] () {
+    ::close (fd);
+    error_code ignored;
+    remove (temporary, ignored);
+  });
+  size_t written = 0;
+  while (written < content.size ()) {
+    const ssize_t result = ::write (fd, content.data () + written, content.size () - written);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      throw_error ("write", temporary);
+    written += result;
+  }
+  if (_durable && ::fdatasync (fd) == -1)
+    throw_error ("fdatasync", temporary);
+  x.release ();
+  ::close (fd);
+
+  // Renaming journal into place, which is what makes it count, such that a journal that was only partially written is ignored.
+  rename (temporary, journal);
+  if (_durable)
+    sync_path (_folder, O_RDONLY | O_DIRECTORY);
+  return journal;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,74 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "http_server/include/helpers/route_cache.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+
+
+route_cache::route_cache (size_t max_routes)
+  : _max_routes (max_routes),
+    _generation (0)
+{ }
+
+
+bool route_cache::find (const string & key, size_t generation, route & result)
+{
+  check_generation (generation);
+  auto iter = _keys.find (key);
+  if (iter == _keys.end ())
+    return false;
+
+  // Moving route to front of cache, since it was just used.
+  _routes.splice (_routes.begin (), _routes, iter->second);
+  result = iter->second->second;
+  return true;
+}
+
+
+void route_cache::insert (const string & key, size_t generation, const route & value)
+{
+  check_generation (generation);
+  if (_max_routes == 0 || _keys.find (key) != _keys.end ())
+    return;
+  _routes.emplace_front (key, value);
+  _keys [key] = _routes.begin ();
+
+  // Making sure cache never grows beyond its maximum size, by evicting least recently used route.
+  if (_routes.size () > _max_routes) {
+    _keys.erase (_routes.back ().first);
+    _routes.pop_back ();
+  }
+}
+
+
+void route_cache::check_generation (size_t generation)
+{
+  if (generation != _generation) {
+    _routes.clear ();
+    _keys.clear ();
+    _generation = generation;
+  }
+}
+
+
+} // namespace http_server
+} // namespace rosetta
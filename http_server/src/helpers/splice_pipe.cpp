@@ -0,0 +1,118 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/asio/error.hpp>
+#include "http_server/include/helpers/splice_pipe.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+
+#if defined(__linux__)
+
+splice_pipe::splice_pipe (size_t capacity)
+  : _capacity (0)
+{
+  // Creating pipe.
+  if (::pipe2 (_fds, O_CLOEXEC) == -1) {
+    _fds [0] = _fds [1] = -1;
+    return;
+  }
+
+  // Trying to grow pipe, which might fail if capacity is larger than what the system allows, for then to check its actual capacity.
+  ::fcntl (_fds [1], F_SETPIPE_SZ, static_cast<int> (capacity));
+  int actual = ::fcntl (_fds [1], F_GETPIPE_SZ);
+  _capacity = actual > 0 ? actual : 65536;
+}
+
+
+splice_pipe::~splice_pipe ()
+{
+  if (_fds [0] != -1) {
+    ::close (_fds [0]);
+    ::close (_fds [1]);
+  }
+}
+
+
+size_t splice_pipe::fill (int socket_fd, size_t max, error_code & error)
+{
+  // Moving bytes from socket into pipe, never blocking, neither on socket, nor on pipe.
+  ssize_t result;
+  do {
+    result = ::splice (socket_fd, nullptr, _fds [1], nullptr, max, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while (result == -1 && errno == EINTR);
+
+  if (result == -1) {
+    error = (errno == EAGAIN || errno == EWOULDBLOCK) ? error_code (boost::asio::error::would_block) : error_code (errno, boost::system::system_category ());
+    return 0;
+  }
+  error = error_code ();
+  return result;
+}
+
+
+void splice_pipe::drain (int file_fd, size_t bytes, error_code & error)
+{
+  // Moving bytes from pipe into file, which might require multiple splices.
+  error = error_code ();
+  while (bytes > 0) {
+    ssize_t result = ::splice (_fds [0], nullptr, file_fd, nullptr, bytes, SPLICE_F_MOVE);
+    if (result == -1) {
+      if (errno == EINTR)
+        continue;
+      error = error_code (errno, boost::system::system_category ());
+      return;
+    }
+    bytes -= result;
+  }
+}
+
+#else
+
+splice_pipe::splice_pipe (size_t capacity)
+  : _capacity (0)
+{
+  // splice is Linux specific, making sure callers fall back to read and write.
+  _fds [0] = _fds [1] = -1;
+}
+
+
+splice_pipe::~splice_pipe ()
+{ }
+
+
+size_t splice_pipe::fill (int socket_fd, size_t max, error_code & error)
+{
+  error = boost::asio::error::operation_not_supported;
+  return 0;
+}
+
+
+void splice_pipe::drain (int file_fd, size_t bytes, error_code & error)
+{
+  error = boost::asio::error::operation_not_supported;
+}
+
+#endif // defined(__linux__)
+
+
+} // namespace http_server
+} // namespace rosetta
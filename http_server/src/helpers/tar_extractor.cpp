@@ -0,0 +1,361 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include "http_server/include/helpers/tar_extractor.hpp"
+
+#if defined(ROSETTA_HAS_ZLIB)
+#include <zlib.h>
+#endif // defined(ROSETTA_HAS_ZLIB)
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using namespace boost::filesystem;
+
+// Size of blocks in a tar archive.
+const static size_t BLOCK_SIZE = 512;
+
+// Max size of GNU long names, and pax extended headers.
+const static size_t MAX_META_SIZE = 65536;
+
+// Size of the buffer we decompress into.
+const static size_t INFLATE_BUFFER_SIZE = 65536;
+
+
+// Parses a numeric field of a tar header, which is either octal, or base-256 for large numbers, returning false if it is malformed.
+static bool parse_number (const char * field, size_t size, size_t & result)
+{
+  result = 0;
+  if (static_cast<unsigned char> (field [0]) & 0x80) {
+
+    // Base-256, where the rest of the first byte is the most significant bits of the number.
+    result = field [0] & 0x7f;
+    for (size_t idx = 1; idx < size; ++idx) {
+      if (result >> (sizeof (size_t) * 8 - 8))
+        return false; // Too large.
+      result = (result << 8) | static_cast<unsigned char> (field [idx]);
+    }
+    return true;
+  }
+
+  // Octal, possibly padded with spaces, and terminated by a space or a NUL.
+  size_t idx = 0;
+  while (idx < size && field [idx] == ' ')
+    ++idx;
+  for (; idx < size && field [idx] >= '0' && field [idx] <= '7'; ++idx)
+    result = (result << 3) | (field [idx] - '0');
+  return idx == size || field [idx] == ' ' || field [idx] == '\0';
+}
+
+
+// Returns the string in a NUL padded field of a tar header.
+static string parse_string (const char * field, size_t size)
+{
+  return string (field, strnlen (field, size));
+}
+
+
+#if defined(ROSETTA_HAS_ZLIB)
+
+struct tar_extractor::inflater
+{
+  z_stream stream;
+  bool done;
+  std::vector<char> buffer;
+};
+
+#else
+
+struct tar_extractor::inflater
+{ };
+
+#endif // defined(ROSETTA_HAS_ZLIB)
+
+
+tar_extractor::tar_extractor (const path & folder, entry_filter filter, size_t max_size, bool durable)
+  : batch_extractor (folder, filter, max_size, durable),
+    _state (state::header),
+    _block_size (0),
+    _entry_size (0),
+    _left (0),
+    _meta_type (0),
+    _zero_blocks (0)
+{ }
+
+
+tar_extractor::~tar_extractor ()
+{
+#if defined(ROSETTA_HAS_ZLIB)
+  if (_inflater)
+    ::inflateEnd (&_inflater->stream);
+#endif // defined(ROSETTA_HAS_ZLIB)
+}
+
+
+bool tar_extractor::supports_gzip ()
+{
+#if defined(ROSETTA_HAS_ZLIB)
+  return true;
+#else
+  return false;
+#endif // defined(ROSETTA_HAS_ZLIB)
+}
+
+
+void tar_extractor::parse (const char * data, size_t size)
+{
+  // Figuring out if archive is gzip compressed from its first two bytes, unless we already know.
+  if (_magic.size () < 2) {
+    const size_t needed = std::min (size, 2 - _magic.size ());
+    _magic.append (data, needed);
+    data += needed;
+    size -= needed;
+    if (_magic.size () < 2)
+      return;
+
+    // Starting decompression if archive is compressed.
+    if (static_cast<unsigned char> (_magic [0]) == 0x1f && static_cast<unsigned char> (_magic [1]) == 0x8b) {
+#if defined(ROSETTA_HAS_ZLIB)
+      _inflater.reset (new inflater ());
+      std::memset (&_inflater->stream, 0, sizeof (z_stream));
+      _inflater->done = false;
+      _inflater->buffer.resize (INFLATE_BUFFER_SIZE);
+      if (::inflateInit2 (&_inflater->stream, 16 + MAX_WBITS) != Z_OK) {
+        _inflater.reset ();
+        _error = 500;
+        return;
+      }
+#else
+      _error = 415;
+      return;
+#endif // defined(ROSETTA_HAS_ZLIB)
+    }
+    decompress (_magic.data (), _magic.size ());
+  }
+  decompress (data, size);
+}
+
+
+void tar_extractor::decompress (const char * data, size_t size)
+{
+  // Nothing to do if archive cannot be extracted.
+  if (_error != 0 || size == 0)
+    return;
+
+  // Checking if archive is compressed at all.
+  if (!_inflater) {
+    parse_tar (data, size);
+    return;
+  }
+
+#if defined(ROSETTA_HAS_ZLIB)
+
+  // Ignoring whatever follows the compressed stream.
+  if (_inflater->done)
+    return;
+
+  // Decompressing content, one buffer at the time, until decompressor needs more input.
+  z_stream & stream = _inflater->stream;
+  stream.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (data));
+  stream.avail_in = size;
+  do {
+    stream.next_out = reinterpret_cast<Bytef*> (_inflater->buffer.data ());
+    stream.avail_out = _inflater->buffer.size ();
+    const int result = ::inflate (&stream, Z_NO_FLUSH);
+    // Corrupt compressed stream.
+    if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+      _error = 400;
+      return;
+    }
+    parse_tar (_inflater->buffer.data (), _inflater->buffer.size () - stream.avail_out);
+    if (result == Z_STREAM_END)
+      _inflater->done = true;
+    if (result != Z_OK || _error != 0)
+      return;
+  } while (stream.avail_in > 0 || stream.avail_out == 0);
+#endif // defined(ROSETTA_HAS_ZLIB)
+}
+
+
+void tar_extractor::parse_tar (const char * data, size_t size)
+{
+  // Parsing content until we run out of it, or see the end of archive.
+  while (size > 0 && !_finished && _error == 0) {
+
+    if (_state == state::header) {
+
+      // Collecting header block, which might be split across multiple parts of archive.
+      const size_t bytes = std::min (size, BLOCK_SIZE - _block_size);
+      std::memcpy (_block.data () + _block_size, data, bytes);
+      _block_size += bytes;
+      data += bytes;
+      size -= bytes;
+      if (_block_size == BLOCK_SIZE) {
+        _block_size = 0;
+        parse_header ();
+      }
+    } else {
+
+      // Content of entry, or its padding.
+      const size_t bytes = std::min (size, _left);
+      if (_state == state::file_content) {
+
+        // Writing content to file, provided entry can be extracted.
+        write_content (data, bytes);
+      } else if (_state == state::meta_content) {
+
+        // Collecting long name or extended header.
+        _meta.append (data, bytes);
+      }
+      _left -= bytes;
+      data += bytes;
+      size -= bytes;
+      if (_left == 0)
+        end_content ();
+    }
+  }
+}
+
+
+void tar_extractor::parse_header ()
+{
+  // Two blocks of zeros ends the archive.
+  if (std::all_of (_block.begin (), _block.end (), [] (char c) { return c == 0; })) {
+    if (++_zero_blocks == 2)
+      _finished = true;
+    return;
+  }
+  _zero_blocks = 0;
+
+  // Verifying checksum of header, which is calculated as if the checksum field itself was filled with spaces.
+  size_t checksum, sum = 0;
+  for (size_t idx = 0; idx < BLOCK_SIZE; ++idx)
+    sum += idx >= 148 && idx < 156 ? ' ' : static_cast<unsigned char> (_block [idx]);
+  // A bad checksum or size is a corrupt archive, which client must fix.
+  if (!parse_number (_block.data () + 148, 8, checksum) || checksum != sum || !parse_number (_block.data () + 124, 12, _entry_size)) {
+    _error = 400;
+    return;
+  }
+
+  // Making sure archive does not contain more content than we accept, which also protects us from decompression bombs.
+  _total += _entry_size;
+  if (_entry_size > _max_size || _total > _max_size) {
+    _error = 413;
+    return;
+  }
+
+  // Retrieving name of entry, which is either given by a preceding long name or extended header, or by header itself.
+  // Notice, ustar archives might split long names into a prefix and a name.
+  string name = _long_name;
+  _long_name.clear ();
+  if (name.empty ()) {
+    name = parse_string (_block.data (), 100);
+    if (std::memcmp (_block.data () + 257, "ustar", 5) == 0 && _block [345] != 0)
+      name = parse_string (_block.data () + 345, 155) + "/" + name;
+  }
+
+  // Figuring out what to do with entry according to its type.
+  const char type = _block [156];
+  if (type == 'L' || type == 'x') {
+
+    // GNU long name, or pax extended header, giving the name of the next entry, which we refuse if it is unreasonably large.
+    if (_entry_size > MAX_META_SIZE) {
+      _error = 400;
+      return;
+    }
+    _meta_type = type;
+    _meta.clear ();
+    start_content (state::meta_content);
+  } else if (type == '0' || type == '\0' || type == '7') {
+
+    // Normal file.
+    begin_file (name);
+    start_content (state::file_content);
+  } else if (type == '5') {
+
+    // Folder.
+    begin_folder (name);
+    start_content (state::skip_content);
+  } else if (type == 'g') {
+
+    // Global pax header, which contains nothing we care about.
+    start_content (state::skip_content);
+  } else {
+
+    // Symbolic links, hard links, devices, etc, which we do not extract.
+    skip_entry (name, 501);
+    start_content (state::skip_content);
+  }
+}
+
+
+void tar_extractor::start_content (state next)
+{
+  _state = next;
+  _left = _entry_size;
+  if (_left == 0)
+    end_content ();
+}
+
+
+void tar_extractor::end_content ()
+{
+  if (_state == state::file_content) {
+
+    // Closing file, provided entry can be extracted.
+    end_file ();
+  } else if (_state == state::meta_content) {
+
+    // Retrieving name of next entry from long name, or from the "path" record of extended header.
+    if (_meta_type == 'L') {
+      _long_name = _meta.substr (0, _meta.find ('\0'));
+    } else {
+
+      // Extended headers consists of records such as "30 path=some/very/long/name\n", where 30 is the length of the entire record.
+      size_t pos = 0;
+      while (pos < _meta.size ()) {
+        const size_t space = _meta.find (' ', pos);
+        if (space == string::npos || space == pos || space - pos > 6 || _meta.find_first_not_of ("0123456789", pos) != space)
+          break;
+        const size_t length = std::stoull (_meta.substr (pos, space - pos));
+        if (length <= space - pos + 1 || pos + length > _meta.size ())
+          break;
+        const string record = _meta.substr (space + 1, pos + length - space - 2);
+        if (boost::algorithm::starts_with (record, "path="))
+          _long_name = record.substr (5);
+        pos += length;
+      }
+    }
+  } else if (_state == state::padding) {
+
+    // Done with entry, and its padding, expecting the next header.
+    _state = state::header;
+    return;
+  }
+
+  // Skipping padding, which makes sure the next header starts at a block boundary.
+  _left = (BLOCK_SIZE - _entry_size % BLOCK_SIZE) % BLOCK_SIZE;
+  _state = _left == 0 ? state::header : state::padding;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
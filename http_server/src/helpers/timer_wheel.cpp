@@ -0,0 +1,155 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "http_server/include/helpers/timer_wheel.hpp"
+
+using boost::system::error_code;
+
+namespace rosetta {
+namespace http_server {
+
+
+void timer_wheel::timeout::unlink ()
+{
+  _previous->_next = _next;
+  _next->_previous = _previous;
+  _previous = _next = this;
+}
+
+
+void timer_wheel::timeout::link_before (timeout & node)
+{
+  _previous = node._previous;
+  _next = &node;
+  node._previous->_next = this;
+  node._previous = this;
+}
+
+
+timer_wheel::timer_wheel (io_service & service, size_t slots)
+  : _timer (service),
+    _slots (slots),
+    _current (0),
+    _running (false)
+{ }
+
+
+timer_wheel::~timer_wheel ()
+{
+  // Unlinking all armed timeouts, since they might outlive us, and would otherwise try to unlink themselves from our slots.
+  for (auto & idx : _slots) {
+    while (idx.armed ())
+      idx._next->unlink ();
+  }
+}
+
+
+void timer_wheel::start ()
+{
+  // Making sure wheel is not started twice.
+  if (_running)
+    return;
+
+  // Starting the wheel, one second from now.
+  _running = true;
+  _timer.expires_from_now (boost::posix_time::seconds (1));
+  _timer.async_wait ([this] (const error_code & error) {
+
+    // Checking that operation was not aborted.
+    if (error != error::operation_aborted)
+      tick ();
+  });
+}
+
+
+void timer_wheel::stop ()
+{
+  _running = false;
+  _timer.cancel ();
+}
+
+
+void timer_wheel::arm (timeout & entry, size_t seconds, std::function<void()> callback)
+{
+  // Removing timeout from its existing slot, if it is already armed.
+  entry.unlink ();
+
+  // A timeout of zero seconds expires at the next tick.
+  if (seconds == 0)
+    seconds = 1;
+
+  // Hashing timeout into its slot, and figuring out how many times wheel must wrap around before it expires.
+  entry._rounds = (seconds - 1) / _slots.size ();
+  entry._callback = callback;
+  entry.link_before (_slots [(_current + seconds) % _slots.size ()]);
+}
+
+
+void timer_wheel::cancel (timeout & entry)
+{
+  // Unlinking timeout, and releasing its callback, since it might hold references to objects owning the timeout.
+  entry.unlink ();
+  entry._callback = nullptr;
+}
+
+
+void timer_wheel::tick ()
+{
+  // Moving wheel one slot forward.
+  _current = (_current + 1) % _slots.size ();
+  timeout & slot = _slots [_current];
+
+  // Moving all expired timeouts from slot into a list of its own, decrementing rounds of timeouts that have not yet expired.
+  // This is necessary, since callbacks might arm and cancel other timeouts, including timeouts in the current slot.
+  timeout expired;
+  timeout * idx = slot._next;
+  while (idx != &slot) {
+    timeout * next = idx->_next;
+    if (idx->_rounds == 0) {
+      idx->unlink ();
+      idx->link_before (expired);
+    } else {
+      --idx->_rounds;
+    }
+    idx = next;
+  }
+
+  // Invoking callbacks of expired timeouts.
+  // Notice, callback is moved out of timeout, since invoking it might destroy the object owning the timeout.
+  while (expired.armed ()) {
+    timeout * current = expired._next;
+    current->unlink ();
+    auto callback = std::move (current->_callback);
+    current->_callback = nullptr;
+    callback ();
+  }
+
+  // Scheduling next tick, relative to the previous, to avoid drifting.
+  if (_running) {
+    _timer.expires_at (_timer.expires_at () + boost::posix_time::seconds (1));
+    _timer.async_wait ([this] (const error_code & error) {
+
+      // Checking that operation was not aborted.
+      if (error != error::operation_aborted)
+        tick ();
+    });
+  }
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -0,0 +1,139 @@
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include "http_server/include/helpers/trash_bin.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::string;
+using boost::system::error_code;
+using namespace boost::filesystem;
+
+
+trash_bin::trash_bin (io_worker_pool & pool, const path & folder, size_t batch_size)
+  : _pool (pool),
+    _folder (folder),
+    _batch_size (batch_size),
+    _counter (0),
+    _emptying (false),
+    _again (false),
+    _stopped (false)
+{ }
+
+
+void trash_bin::discard (const path & object)
+{
+  // Creating a name that is unique, also across restarts of the server, since trash might not be empty when server starts.
+  const auto now = std::chrono::system_clock::now ().time_since_epoch ();
+  const string name = std::to_string (std::chrono::duration_cast<std::chrono::microseconds> (now).count ()) + "-" + std::to_string (_counter++);
+
+  // Moving object into trash, which is atomic, since server makes sure trash is on the same file system as www-root when it starts.
+  create_directories (_folder);
+  rename (object, _folder / name);
+}
+
+
+void trash_bin::empty ()
+{
+  // Checking if we're already emptying trash, at which point we make sure we check for more trash when we're done.
+  if (_stopped)
+    return;
+  if (_emptying) {
+    _again = true;
+    return;
+  }
+  _emptying = true;
+  _again = false;
+  queue_batch ();
+}
+
+
+void trash_bin::stop ()
+{
+  _stopped = true;
+}
+
+
+void trash_bin::queue_batch ()
+{
+  // Removing batch on pool, and queuing the next batch when it is done, unless trash is empty.
+  auto more = std::make_shared<bool> (false);
+  _pool.post ([this, more] () {
+
+    *more = remove_batch ();
+
+  }, [this, more] () {
+
+    // Checking if we should continue.
+    if (*more && !_stopped) {
+      queue_batch ();
+    } else {
+
+      // Done, unless somebody discarded something while we were emptying trash.
+      _emptying = false;
+      if (_again)
+        empty ();
+    }
+  });
+}
+
+
+bool trash_bin::remove_batch ()
+{
+  // Picking the next object in trash, unless we're already in the middle of removing one.
+  error_code ec;
+  if (_current.empty ()) {
+    directory_iterator idx (_folder, ec);
+    if (ec || idx == directory_iterator ())
+      return false; // Trash is empty.
+    _current = idx->path ();
+    if (is_directory (symlink_status (_current, ec)))
+      _iterator = recursive_directory_iterator (_current, ec);
+  }
+
+  // Finding the next batch of files, for then to remove them, which is safe, since iterator has already moved past them.
+  // Symbolic links are removed, and never followed.
+  std::vector<path> batch;
+  while (!ec && _iterator != recursive_directory_iterator () && batch.size () < _batch_size) {
+    if (!is_directory (_iterator->symlink_status (ec)))
+      batch.push_back (_iterator->path ());
+    _iterator.increment (ec);
+  }
+  for (auto & idx : batch) {
+    error_code ignored;
+    remove (idx, ignored);
+  }
+
+  // Once all files are gone, object contains only empty folders, which we remove in one go.
+  if (ec || _iterator == recursive_directory_iterator ()) {
+    _iterator = recursive_directory_iterator ();
+    remove_all (_current, ec);
+    _current.clear ();
+    if (ec)
+      return false; // Giving up, to avoid trying to remove the same object forever.
+  }
+  return true;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
@@ -42,36 +42,10 @@ unsigned char from_hex (unsigned char ch)
 
 string decode (const string & uri)
 {
-  // Will hold the decoded return URI value temporarily.
-  vector<unsigned char> return_value;
-  
-  // Iterating through entire string, looking for either '+' or '%', which is specially handled.
-  for (size_t idx = 0; idx < uri.length (); ++idx) {
-    
-    // Checking if this character should have special handling.
-    if (uri [idx] == '+') {
-
-      // '+' equals space " ".
-      return_value.push_back (' ');
-    } else if (uri [idx] == '%') {
-
-      // '%' notation of character, followed by two characters. Sanity checking input first.
-      if (idx + 2 >= uri.size ())
-        throw request_exception ("Syntax error in URI encoded string, no values after '%' notation.");
-
-      // The first character is bit shifted 4 places, and OR'ed with the value of the second character.
-      // Then we make sure we skip the next 2 characters, since they're already handled.
-      return_value.push_back ((from_hex (uri [idx + 1]) << 4) | from_hex (uri [idx + 2]));
-      idx += 2;
-    } else {
-
-      // Normal plain character.
-      return_value.push_back (uri [idx]);
-    }
-  }
-
-  // Returning decoded URI to caller as string.
-  return string (return_value.begin (), return_value.end ());
+  // Letting the generic implementation do the heavy lifting.
+  string return_value;
+  decode (uri.data (), uri.data () + uri.size (), return_value);
+  return return_value;
 }
 
 
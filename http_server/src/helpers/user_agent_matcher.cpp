@@ -0,0 +1,155 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <queue>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include "http_server/include/helpers/user_agent_matcher.hpp"
+
+namespace rosetta {
+namespace http_server {
+
+using std::pair;
+using std::string;
+using std::vector;
+
+
+user_agent_matcher::user_agent_matcher (const string & whitelist, const string & blacklist)
+  : _everything (0),
+    _not_empty (0)
+{
+  // Building a trie out of the entries of both lists, remembering which lists have an entry ending in each state.
+  vector<vector<pair<unsigned char, uint32_t>>> trie (1);
+  _states.push_back ({0, 0, 0, 0});
+  add_list (whitelist, WHITELIST, trie);
+  add_list (blacklist, BLACKLIST, trie);
+
+  // Flattening trie into our transitions, sorted by character for each state, such that they can be binary searched.
+  for (size_t idx = 0; idx < trie.size (); ++idx) {
+    std::sort (trie [idx].begin (), trie [idx].end ());
+    _states [idx].first = static_cast<uint32_t> (_transitions.size ());
+    _states [idx].count = static_cast<uint32_t> (trie [idx].size ());
+    _transitions.insert (_transitions.end (), trie [idx].begin (), trie [idx].end ());
+  }
+
+  // Figuring out failure of every state breadth first, since failure of a state is always closer to root than state itself.
+  // States directly below root fails to root, which they already do.
+  std::queue<uint32_t> queue;
+  for (auto & idx : trie [0])
+    queue.push (idx.second);
+  while (!queue.empty ()) {
+    const uint32_t current = queue.front ();
+    queue.pop ();
+    for (auto & idx : trie [current]) {
+
+      // Following failures of parent, until we find a state with a transition for character, or end up in root.
+      uint32_t failure = _states [current].failure;
+      while (failure != 0 && transition (failure, idx.first) == 0)
+        failure = _states [failure].failure;
+      state & child = _states [idx.second];
+      child.failure = transition (failure, idx.first);
+
+      // Whatever is matched in the state we fail to, is also matched in child, since it is a suffix of what child matches.
+      child.lists |= _states [child.failure].lists;
+      queue.push (idx.second);
+    }
+  }
+}
+
+
+bool user_agent_matcher::accepts (const char * begin, const char * end) const
+{
+  // Checking lists that do not need to look at User-Agent first.
+  uint8_t found = _everything;
+  if (begin != end)
+    found |= _not_empty;
+
+  // Scanning User-Agent once, for entries of both lists, stopping as soon as we find an entry from blacklist.
+  if (!(found & BLACKLIST) && !_transitions.empty ()) {
+    uint32_t current = 0;
+    for (auto idx = begin; idx != end; ++idx) {
+      const unsigned char character = *idx;
+      uint32_t next = transition (current, character);
+      while (next == 0 && current != 0) {
+        current = _states [current].failure;
+        next = transition (current, character);
+      }
+      current = next;
+      found |= _states [current].lists;
+      if (found & BLACKLIST)
+        break;
+    }
+  }
+  return (found & WHITELIST) && !(found & BLACKLIST);
+}
+
+
+void user_agent_matcher::add_list (const string & list, list_bits bit, vector<vector<pair<unsigned char, uint32_t>>> & trie)
+{
+  if (list == "*") {
+
+    // List contains everything.
+    _everything |= bit;
+    return;
+  } else if (list.empty ()) {
+
+    // List contains nothing.
+    return;
+  }
+
+  // Adding every entry of list to trie, where an empty entry is found in every User-Agent, except an empty User-Agent.
+  vector<string> entries;
+  boost::algorithm::split (entries, list, boost::is_any_of ("|"));
+  for (auto & entry : entries) {
+    if (entry.empty ()) {
+      _not_empty |= bit;
+      continue;
+    }
+    uint32_t current = 0;
+    for (const unsigned char character : entry) {
+      uint32_t next = 0;
+      for (auto & idx : trie [current]) {
+        if (idx.first == character)
+          next = idx.second;
+      }
+      if (next == 0) {
+        next = static_cast<uint32_t> (trie.size ());
+        trie [current].push_back ({character, next});
+        trie.emplace_back ();
+        _states.push_back ({0, 0, 0, 0});
+      }
+      current = next;
+    }
+    _states [current].lists |= bit;
+  }
+}
+
+
+uint32_t user_agent_matcher::transition (uint32_t from, unsigned char character) const
+{
+  const auto first = _transitions.begin () + _states [from].first;
+  const auto last = first + _states [from].count;
+  auto iter = std::lower_bound (first, last, character, [] (const pair<unsigned char, uint32_t> & lhs, unsigned char rhs) {
+    return lhs.first < rhs;
+  });
+  return iter != last && iter->first == character ? iter->second : 0;
+}
+
+
+} // namespace http_server
+} // namespace rosetta
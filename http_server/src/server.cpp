@@ -15,11 +15,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctime>
+#include <vector>
 #include <iostream>
+#include <sys/stat.h>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include "http_server/include/server.hpp"
 #include "http_server/include/connection/connection.hpp"
+#include "http_server/include/exceptions/server_exception.hpp"
 #include "http_server/include/exceptions/request_exception.hpp"
 
 using std::string;
@@ -36,10 +40,78 @@ static char const * const SSL_PORT_CONFIG_KEY = "ssl-port";
 static char const * const CERT_FILE = "ssl-certificate";
 static char const * const PRIVATE_KEY_FILE = "ssl-private-key";
 static char const * const SSL_HANDSHAKE_TIMEOUT = "connection-ssl-handshake-timeout";
+static char const * const DISK_IO_THREADS = "disk-io-threads";
+static char const * const DISK_IO_MAX_QUEUED = "disk-io-max-queued";
+static char const * const DISK_IO_REPORT_INTERVAL = "disk-io-report-interval";
+static char const * const GROUP_COMMIT_WINDOW = "put-group-commit-window";
+static char const * const GROUP_COMMIT_MAX_FILES = "put-group-commit-max-files";
+static char const * const GROUP_COMMIT_SYNCFS = "put-group-commit-syncfs";
+static char const * const UPLOAD_PARTIAL_TIMEOUT = "upload-partial-timeout";
+static char const * const UPLOAD_SWEEP_INTERVAL = "upload-sweep-interval";
+static char const * const DELETE_BATCH_SIZE = "delete-batch-size";
+static char const * const TRASH_FOLDER = "trash-folder";
+static char const * const PACK_FILES = "pack-files";
+static char const * const OPEN_FILE_CACHE_SIZE = "open-file-cache-size";
+static char const * const OPEN_FILE_CACHE_VALIDITY = "open-file-cache-validity";
+static char const * const NEGATIVE_CACHE_SIZE = "negative-cache-size";
+static char const * const ROUTE_CACHE_SIZE = "route-cache-size";
+static char const * const USER_AGENT_WHITELIST = "user-agent-whitelist";
+static char const * const USER_AGENT_BLACKLIST = "user-agent-blacklist";
+
+
+/// Returns the packs listed in configuration, separated by commas, ignoring empty names.
+static std::vector<path> pack_files (const class configuration & configuration)
+{
+  std::vector<string> names;
+  const string list = configuration.get<string> (PACK_FILES, "");
+  boost::algorithm::split (names, list, boost::is_any_of (","));
+  std::vector<path> result;
+  for (auto & idx : names) {
+    boost::algorithm::trim (idx);
+    if (!idx.empty ())
+      result.push_back (idx);
+  }
+  return result;
+}
+
+
+/// Returns true if both files or folders are on the same file system, which is required to rename from one of them into the other.
+static bool same_file_system (const path & lhs, const path & rhs)
+{
+  struct stat lhs_info, rhs_info;
+  return ::stat (lhs.c_str (), &lhs_info) == 0 && ::stat (rhs.c_str (), &rhs_info) == 0 && lhs_info.st_dev == rhs_info.st_dev;
+}
+
+
+/// Returns true if configuration has a certificate and a private key, and both of them exists.
+static bool certificate_exists (const class configuration & configuration)
+{
+  const string certificate = configuration.get<string> (CERT_FILE, "server.crt");
+  const string private_key = configuration.get<string> (PRIVATE_KEY_FILE, "server.key");
+  return certificate.size () > 0 && private_key.size () > 0 && exists (certificate) && exists (private_key);
+}
 
 
 server::server (const class configuration & configuration)
-  : _configuration (configuration),
+  : _timeouts (_service),
+    _configuration (configuration),
+    _disk_io (_service, configuration.get<size_t> (DISK_IO_THREADS, 4), configuration.get<size_t> (DISK_IO_MAX_QUEUED, 1024)),
+    _group_commit (_service,
+                   _disk_io,
+                   configuration.get<size_t> (GROUP_COMMIT_WINDOW, 2000),
+                   configuration.get<size_t> (GROUP_COMMIT_MAX_FILES, 256),
+                   configuration.get<bool> (GROUP_COMMIT_SYNCFS, false)),
+    _append_locks (_service),
+    _trash (_disk_io, configuration.get<path> (TRASH_FOLDER, "trash"), configuration.get<size_t> (DELETE_BATCH_SIZE, 1024)),
+    _journal (configuration.get<path> ("www-root", "www-root") / ".journal", configuration.get<string> ("put-durability", "none") != "none"),
+    _packs (pack_files (configuration)),
+    _open_files (configuration.get<size_t> (OPEN_FILE_CACHE_SIZE, 1024),
+                 configuration.get<size_t> (NEGATIVE_CACHE_SIZE, 4096),
+                 configuration.get<size_t> (OPEN_FILE_CACHE_VALIDITY, 5)),
+    _routes (configuration.get<size_t> (ROUTE_CACHE_SIZE, 4096)),
+    _user_agents (configuration.get<string> (USER_AGENT_WHITELIST, "*"), configuration.get<string> (USER_AGENT_BLACKLIST, "")),
+    _has_certificate (certificate_exists (configuration)),
+    _error_responses (configuration, "error-pages"),
     _signals (_service),
     _acceptor (_service),
     _acceptor_ssl (_service),
@@ -60,6 +132,27 @@ server::server (const class configuration & configuration)
     on_stop (signal_number);
   });
 
+  // Starting timer wheel, which takes care of timing out connections.
+  _timeouts.start ();
+
+  // Making sure we periodically remove partial uploads that are never resumed.
+  schedule_upload_sweep ();
+
+  // Making sure we periodically report how busy the disc I/O pool is, if server is configured to do so.
+  schedule_disk_io_report ();
+
+  // Making sure trash is on the same file system as www-root, since folders are moved into it with rename, which cannot cross file systems.
+  const path trash_folder = configuration.get<path> (TRASH_FOLDER, "trash");
+  create_directories (trash_folder);
+  if (!same_file_system (trash_folder, configuration.get<path> ("www-root", "www-root")))
+    throw server_exception ("Trash folder must be on the same file system as www-root.");
+
+  // Removing whatever was left in trash the last time server stopped.
+  _trash.empty ();
+
+  // Finishing whatever set of files was being renamed into place when server stopped, before we accept any requests.
+  _journal.recover ();
+
   // Try to setup server to accept non-SSL, normal HTTP requests.
   setup_http_server ();
 
@@ -208,13 +301,14 @@ void server::on_accept ()
   auto socket_ptr = std::make_shared<rosetta_socket_plain> (_service);
   _acceptor.async_accept (socket_ptr->socket(), [this, socket_ptr] (const error_code & error) {
 
-    // Invoking "self" again to accept next request.
-    on_accept();
-
-    // Checking that our acceptor is still open, and not killed
+    // Checking that our acceptor is still open, and not killed, before we accept more requests.
+    // Otherwise, accepting on a closed acceptor fails immediately, and we would spin forever, never running out of work.
     if (!_acceptor.is_open ())
       return;
 
+    // Invoking "self" again to accept next request.
+    on_accept();
+
     if (!error) {
 
       // Creating connection and handling it.
@@ -230,13 +324,14 @@ void server::on_accept_ssl ()
   auto socket = std::make_shared<rosetta_socket_ssl> (_service, _context);
   _acceptor_ssl.async_accept (socket->ssl_stream().lowest_layer (), [this, socket] (const error_code & error) {
 
-    // Invoking "self" again to accept next request.
-    on_accept_ssl ();
-
-    // Checking that our acceptor is still open, and not killed
+    // Checking that our acceptor is still open, and not killed, before we accept more requests.
+    // Otherwise, accepting on a closed acceptor fails immediately, and we would spin forever, never running out of work.
     if (!_acceptor_ssl.is_open ())
       return;
 
+    // Invoking "self" again to accept next request.
+    on_accept_ssl ();
+
     if (!error) {
 
       // Settings options for SSL socket.
@@ -244,29 +339,25 @@ void server::on_accept_ssl ()
       socket->ssl_stream().lowest_layer().set_option (opt);
 
       // Making sure we timeout handshake, to not lock up resources, with a handshake that never comes.
+      // Timeout is owned by handshake handler, which means it is automatically canceled if handshake fails.
       int seconds = _configuration.get<int> (SSL_HANDSHAKE_TIMEOUT, 5);
-      std::shared_ptr<deadline_timer> handshake_timer = std::make_shared<deadline_timer> (_service);
-      handshake_timer->expires_from_now (boost::posix_time::seconds (seconds));
-      handshake_timer->async_wait ([handshake_timer, socket] (const error_code & error) {
+      auto handshake_timeout = std::make_shared<timer_wheel::timeout> ();
+      _timeouts.arm (*handshake_timeout, seconds, [socket] () {
 
-        // Checking that operation was not aborted.
-        if (error != error::operation_aborted) {
-
-          // Closing socket and cleaning up. Client spent too much time on handshake!
-          error_code ec;
-          socket->shutdown (ip::tcp::socket::shutdown_both, ec);
-          socket->close();
-        }
+        // Closing socket and cleaning up. Client spent too much time on handshake!
+        error_code ec;
+        socket->shutdown (ip::tcp::socket::shutdown_both, ec);
+        socket->close();
       });
 
       // Doing SSL handshake.
-      socket->ssl_stream().async_handshake (ssl::stream_base::server, [this, socket, handshake_timer] (const error_code & error) {
+      socket->ssl_stream().async_handshake (ssl::stream_base::server, [this, socket, handshake_timeout] (const error_code & error) {
 
         // Verifying nothing went sour.
         if (!error) {
 
           // Canceling handshake timeout.
-          handshake_timer->cancel ();
+          _timeouts.cancel (*handshake_timeout);
 
           // Creating connection and handling it.
           create_connection (socket)->handle();
@@ -277,10 +368,105 @@ void server::on_accept_ssl ()
 }
 
 
+void server::schedule_upload_sweep ()
+{
+  // Checking if server is configured to remove stale partial uploads at all.
+  if (_configuration.get<int> (UPLOAD_PARTIAL_TIMEOUT, 86400) == -1)
+    return;
+
+  // Arming sweep timeout.
+  _timeouts.arm (_upload_sweep, _configuration.get<size_t> (UPLOAD_SWEEP_INTERVAL, 3600), [this] () {
+    collect_stale_uploads ();
+  });
+}
+
+
+/// Adds every file in folder, that matches predicate, and that nobody has written to since stale_time, to stale files.
+static void find_stale_files (const path & folder, std::time_t stale_time, std::vector<path> & stale, std::function<bool(const path &)> predicate)
+{
+  error_code ec;
+  for (recursive_directory_iterator idx (folder, ec), end; !ec && idx != end; idx.increment (ec)) {
+    error_code ignored;
+    if (!is_regular_file (idx->status (ignored)) || !predicate (idx->path()))
+      continue;
+
+    // File is stale if nobody has written to it for a while.
+    const std::time_t last_write = last_write_time (idx->path(), ignored);
+    if (!ignored && last_write < stale_time)
+      stale.push_back (idx->path());
+  }
+}
+
+
+void server::collect_stale_uploads ()
+{
+  // Partial uploads that have not been written to since this time are considered stale.
+  const std::time_t stale_time = std::time (nullptr) - _configuration.get<int> (UPLOAD_PARTIAL_TIMEOUT, 86400);
+  const path root = _configuration.get<path> ("www-root", "www-root");
+  const path store = blob_store ();
+
+  // Iterating entire www-root folder, and store, on disc I/O thread, since this might be slow.
+  _disk_io.post ([root, store, stale_time] () {
+
+    // Finding stale partial uploads first, and removing them afterwards, since removing files while iterating might make us skip files.
+    // Temporary files of the server are always hidden, and end with ".partial", and clients cannot create hidden files themselves.
+    std::vector<path> stale;
+    find_stale_files (root, stale_time, stale, [] (const path & file) {
+      return file.filename().string().find_first_of ('.') == 0 && file.extension() == ".partial";
+    });
+
+    // Then blobs in the content-addressed store that are no longer linked into www-root.
+    find_stale_files (store, stale_time, stale, [] (const path & file) {
+      error_code ignored;
+      return hard_link_count (file, ignored) == 1;
+    });
+
+    // Removing stale files.
+    for (auto & idx : stale) {
+      error_code ignored;
+      remove (idx, ignored);
+    }
+
+  }, [this] () {
+
+    // Scheduling next sweep.
+    schedule_upload_sweep ();
+  });
+}
+
+
+void server::schedule_disk_io_report ()
+{
+  // Checking if server is configured to report disc I/O metrics at all.
+  const size_t interval = _configuration.get<size_t> (DISK_IO_REPORT_INTERVAL, 0);
+  if (interval == 0)
+    return;
+
+  // Arming report timeout, writing metrics to std::cerr, which is where we log everything else too.
+  _timeouts.arm (_disk_io_report, interval, [this] () {
+    std::cerr << "disk-io: queued " << _disk_io.queue_depth ()
+              << ", completed " << _disk_io.completed ()
+              << ", average wait " << _disk_io.average_wait () << "us"
+              << ", max wait " << _disk_io.max_wait () << "us" << std::endl;
+    schedule_disk_io_report ();
+  });
+}
+
+
 void server::on_stop (int signal_number)
 {
   // Making sure we do not accept anymore incoming requests.
   _acceptor.close ();
+  _acceptor_ssl.close ();
+
+  // Stopping timer wheel, such that io_service runs out of work.
+  _timeouts.stop ();
+
+  // Making sure trash bin does not queue more work, since we're about to stop disc I/O pool.
+  _trash.stop ();
+
+  // Waiting for all pending disc operations, such that their completion handlers are posted before io_service runs out of work.
+  _disk_io.stop ();
 
   // Closing all open connections.
   for (auto idxClient : _connections) {
@@ -179,16 +179,43 @@ void create_default_configuration_file()
   config.set ("max-header-length", 8192);
   config.set ("max-header-count", 25);
   config.set ("max-request-content-length", 4194304); // 4 MB
+  config.set ("max-extract-content-length", 104857600); // 100 MB, archives PUT with "?extract"
+  config.set ("max-extract-size", 1073741824); // 1 GB, size of archives once extracted
   config.set ("max-post-request-content-length", 4096); // 4KB, post is only used for changing passwords and such
+  config.set ("max-multi-files", 64); // Files GET at once with "?multi"
+  config.set ("max-multi-file-size", 262144); // 256 KB, larger files GET with "?multi" must be retrieved individually
   config.set ("request-content-read-timeout", 300); // 5 minutes
   config.set ("request-post-content-read-timeout", 30); // 30 seconds
   config.set ("upgrade-insecure-requests", true);
+  config.set ("response-chunk-max-size", 262144); // 256 KB
+  config.set ("put-write-behind-size", 262144); // 256 KB
+  config.set ("put-durability", "none"); // "none", "fdatasync" or "group"
+  config.set ("put-group-commit-window", 2000); // 2 milliseconds
+  config.set ("put-group-commit-max-files", 256);
+  config.set ("put-group-commit-syncfs", false);
+  config.set ("put-deduplicate", false); // Saves disc space, not time, since a duplicate is written in full, and read back twice to verify it
+  config.set ("put-deduplicate-verify", true); // If false, a duplicate is trusted by its SHA-1 hash and size, without reading it back
+  config.set ("blob-store", "blobs"); // Content-addressed store of deduplicated uploads, must be on the same file system as www-root
+  config.set ("upload-partial-timeout", 86400); // 1 day, partial uploads not written to in this time are removed
+  config.set ("upload-sweep-interval", 3600); // 1 hour
+  config.set ("delete-batch-size", 1024); // Files removed in each background job when deleting folders recursively
+  config.set ("trash-folder", "trash"); // Folders deleted recursively are moved here first, must be on the same file system as www-root
+  config.set ("pack-files", ""); // Comma separated list of packs created with "rosetta-pack", files are served from before www-root
+  config.set ("open-file-cache-size", 1024); // Files kept open, with their metadata, 0 disables cache
+  config.set ("open-file-cache-validity", 5); // Seconds before a cached file is stat'ed again, files are also watched with inotify
+  config.set ("negative-cache-size", 4096); // Files remembered as not existing, answered with 404 without touching the file system
+  config.set ("route-cache-size", 4096); // Requests for files remembered by method, role and path, with how they are handled
 
   // Connection settings.
   config.set ("connection-ssl-handshake-timeout", 20);
   config.set ("connection-keep-alive-timeout", 20);
   config.set ("max-connections-per-client", 8);
 
+  // Disc I/O settings.
+  config.set ("disk-io-threads", 4);
+  config.set ("disk-io-max-queued", 1024);
+  config.set ("disk-io-report-interval", 0); // Seconds between writing disc I/O queue depth and wait times to stderr, 0 disables
+
   // Request Handlers, according to file extensions.
   config.set ("handler.html", "get-file-handler");
   config.set ("handler", "get-file-handler");
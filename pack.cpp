@@ -0,0 +1,83 @@
+
+
+/*
+ * Rosetta web server, copyright(c) 2016, Thomas Hansen, phosphorusfive@gmail.com.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License, as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include "common/include/configuration.hpp"
+#include "http_server/include/helpers/pack_writer.hpp"
+#include "http_server/include/helpers/folder_walker.hpp"
+
+using std::endl;
+using std::string;
+using namespace rosetta::common;
+using namespace rosetta::http_server;
+
+
+/// Main entry point for tool creating pack files from a folder, to be served by Rosetta without touching the file system.
+/// Usage; "rosetta-pack <folder> <pack> [--prefix <uri>] [--config <configuration file>]", where every file below folder is
+/// served as prefix followed by its path relative to folder. If a configuration file is given, the MIME types of files are
+/// stored in pack, according to its "mime" settings, otherwise server looks them up when serving files.
+int main (int argc, char * argv[])
+{
+  // Making sure we trap everything that can go wrong, to give some sane feedback to std::cerr if an exception occurs.
+  try {
+
+    // Parsing arguments.
+    std::vector<string> positional;
+    string prefix;
+    std::unique_ptr<configuration> config;
+    for (int idx = 1; idx < argc; ++idx) {
+      const string arg = argv [idx];
+      if (arg == "--prefix" && idx + 1 < argc) {
+        prefix = argv [++idx];
+        while (!prefix.empty () && prefix.back () == '/')
+          prefix.pop_back ();
+      } else if (arg == "--config" && idx + 1 < argc) {
+        config.reset (new configuration (argv [++idx]));
+      } else {
+        positional.push_back (arg);
+      }
+    }
+    if (positional.size () != 2 || !boost::filesystem::is_directory (positional [0])) {
+      std::cerr << "Usage; rosetta-pack <folder> <pack> [--prefix <uri>] [--config <configuration file>]" << endl;
+      return 1;
+    }
+
+    // Adding every file below folder to pack, the same way they would have been served from the file system.
+    pack_writer writer (positional [1]);
+    folder_walker walker (positional [0]);
+    boost::filesystem::path file;
+    string name;
+    size_t count = 0;
+    while (walker.next (file, name)) {
+      const string mime = config ? config->get<string> ("mime" + file.extension ().string (), "") : "";
+      writer.add (prefix + "/" + name, file, mime);
+      ++count;
+    }
+    writer.finish ();
+    std::cout << "Packed " << count << " files into '" << positional [1] << "'" << endl;
+  } catch (const std::exception & err) {
+
+    // Giving feedback to std error with exception message.
+    std::cerr << "Unhandled exception; '" << err.what() << "'" << endl;
+    return 1;
+  }
+}